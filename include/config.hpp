@@ -15,4 +15,20 @@
 #else
 #define PSYDAPT_THROW(exception, msg) throw exception(msg)
 #endif
+
+// Runtime ISA dispatch for the QUEST+ kernels: GCC/Clang emit one clone per
+// target, and the dynamic loader picks the best one for the running CPU.
+#if defined(PSYDAPT_RUNTIME_DISPATCH) && defined(__x86_64__) && defined(__ELF__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define PSYDAPT_DISPATCH 1
+#define PSYDAPT_TARGET_CLONES __attribute__((target_clones("default", "arch=haswell", "arch=skylake-avx512")))
+#define PSYDAPT_PRAGMA(x) _Pragma(#x)
+#define PSYDAPT_SIMD_SUM(var) PSYDAPT_PRAGMA(omp simd reduction(+ : var))
+// for helpers of a cloned kernel, so each clone gets its own copy
+#define PSYDAPT_CLONE_INLINE __attribute__((always_inline))
+#else
+#define PSYDAPT_TARGET_CLONES
+#define PSYDAPT_SIMD_SUM(var)
+#define PSYDAPT_CLONE_INLINE
+#endif
 #endif
@@ -19,8 +19,10 @@ You should have received a copy of the GNU General Public License
 along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "psydapt/staircase/staircase.hpp"
+#include "psydapt/quest/quest.hpp"
 #include "psydapt/questplus/weibull.hpp"
 #include "psydapt/questplus/norm_cdf.hpp"
 #include "psydapt/questplus/csf.hpp"
+#include "psydapt/questplus/particle.hpp"
 
 #endif // PSYDAPT_HPP
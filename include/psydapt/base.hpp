@@ -19,9 +19,15 @@ You should have received a copy of the GNU General Public License
 along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cstdint>
 #include <optional>
 #include <array>
 #include <vector>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "logging/sink.hpp"
 
 /** @file
  * @brief Class @ref psydapt::Base, enum @ref psydapt::Scale 
@@ -51,6 +57,31 @@ namespace psydapt
         std::vector<stim_type> stimulus_history;
         stim_type next_stimulus; // if stimulus not passed in update, use this
         bool should_continue = true;
+        std::shared_ptr<logging::TrialSink<DimStim>> sink;
+        std::uint64_t trial_index = 0;
+
+        // derived update()s call this once the trial has been recorded
+        void log_trial(const stim_type &stimulus, int response, std::optional<double> posterior_entropy = std::nullopt)
+        {
+            if (sink)
+            {
+                logging::TrialRecord<DimStim> rec{trial_index, {}, response, posterior_entropy};
+                if constexpr (std::is_scalar_v<stim_type>)
+                {
+                    rec.stimulus[0] = stimulus;
+                }
+                else
+                {
+                    rec.stimulus = stimulus;
+                }
+                sink->record(rec);
+            }
+            trial_index++;
+        }
+        bool sink_wants_summary() const
+        {
+            return sink && sink->wants_summary();
+        }
 
     public:
         /** @brief Generate the next stimulus (or stimuli) */
@@ -69,6 +100,21 @@ namespace psydapt
         {
             return static_cast<T *>(this)->update(response, stimulus);
         }
+        /** @brief Responses so far, oldest first (a reference, so bindings can wrap it without copying). */
+        const std::vector<int> &get_response_history() const
+        {
+            return response_history;
+        }
+        /** @brief Stimuli so far, oldest first (contiguous, `DimStim` doubles per trial). */
+        const std::vector<stim_type> &get_stimulus_history() const
+        {
+            return stimulus_history;
+        }
+        /** @brief Stream every subsequent trial to `trial_sink` (pass `nullptr` to stop). */
+        void set_sink(std::shared_ptr<logging::TrialSink<DimStim>> trial_sink)
+        {
+            sink = std::move(trial_sink);
+        }
     };
 } // namespace psydapt
 #endif
@@ -0,0 +1,149 @@
+#ifndef PSYDAPT_COMPRESSION_HPP
+#define PSYDAPT_COMPRESSION_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "../config.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::CompressedArray
+ */
+namespace psydapt
+{
+    /**
+     * @brief Lossless byte-shuffle + run-length encoding of an array of doubles.
+     *
+     * The bytes are regrouped into eight planes (byte 0 of every value, then
+     * byte 1, ...), so that the sign/exponent planes of a smooth or mostly
+     * negligible array become long runs. Each plane is then PackBits-encoded:
+     * a control byte `c < 128` is followed by `c + 1` literal bytes, and
+     * `c >= 128` by one byte repeated `c - 125` times (3 to 130).
+     * Exact zeros compress to ~2 bytes per 130 values.
+     */
+    class CompressedArray
+    {
+    public:
+        CompressedArray() = default;
+        CompressedArray(const double *data, std::size_t n) : count(n)
+        {
+            const unsigned char *raw = reinterpret_cast<const unsigned char *>(data);
+            const std::size_t total = n * sizeof(double);
+            // byte `j` of the shuffled stream
+            const auto at = [raw, n](std::size_t j)
+            {
+                return raw[(j % n) * sizeof(double) + j / n];
+            };
+            std::size_t literal_start = 0, literal_len = 0;
+            const auto flush = [&]()
+            {
+                if (literal_len)
+                {
+                    bytes.push_back(static_cast<std::uint8_t>(literal_len - 1));
+                    for (std::size_t k = 0; k < literal_len; k++)
+                    {
+                        bytes.push_back(at(literal_start + k));
+                    }
+                    literal_len = 0;
+                }
+            };
+            std::size_t j = 0;
+            while (j < total)
+            {
+                const unsigned char b = at(j);
+                std::size_t run = 1;
+                while (run < 130 && j + run < total && at(j + run) == b)
+                {
+                    run++;
+                }
+                if (run >= 3)
+                {
+                    flush();
+                    bytes.push_back(static_cast<std::uint8_t>(run + 125));
+                    bytes.push_back(b);
+                    j += run;
+                    continue;
+                }
+                if (!literal_len)
+                {
+                    literal_start = j;
+                }
+                literal_len++;
+                j++;
+                if (literal_len == 128)
+                {
+                    flush();
+                }
+            }
+            flush();
+            bytes.shrink_to_fit();
+        }
+
+        /** @brief Write the original `size()` values to `out`. */
+        void decompress(double *out) const
+        {
+            unsigned char *raw = reinterpret_cast<unsigned char *>(out);
+            const std::size_t n = count;
+            std::size_t j = 0;
+            const auto put = [raw, n, &j](unsigned char b)
+            {
+                raw[(j % n) * sizeof(double) + j / n] = b;
+                j++;
+            };
+            for (std::size_t i = 0; i < bytes.size();)
+            {
+                const std::uint8_t c = bytes[i++];
+                if (c < 128)
+                {
+                    for (std::size_t k = 0; k <= c; k++)
+                    {
+                        put(bytes[i++]);
+                    }
+                }
+                else
+                {
+                    for (std::size_t k = 0; k < static_cast<std::size_t>(c) - 125; k++)
+                    {
+                        put(bytes[i]);
+                    }
+                    i++;
+                }
+            }
+            if (j != n * sizeof(double))
+            {
+                PSYDAPT_THROW(std::runtime_error, "Corrupt compressed array.");
+            }
+        }
+
+        /** @brief Number of doubles encoded. */
+        std::size_t size() const { return count; }
+        /** @brief Bytes used by the encoded data. */
+        std::size_t memory_bytes() const { return bytes.capacity(); }
+
+    private:
+        std::vector<std::uint8_t> bytes;
+        std::size_t count = 0;
+    };
+} // namespace psydapt
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef PSYDAPT_HISTORY_HPP
+#define PSYDAPT_HISTORY_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "../config.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::CompactHistory
+ */
+namespace psydapt
+{
+    /**
+     * @brief Trial history stored as grid indices and bit-packed responses.
+     *
+     * Each trial costs `2 * DimStim` bytes plus 1-8 bits, rather than
+     * `8 * DimStim + 4` bytes for the plain vectors in @ref Base. With a nonzero
+     * capacity it becomes a ring buffer that keeps only the most recent trials.
+     */
+    template <std::size_t DimStim>
+    class CompactHistory
+    {
+    public:
+        using index_type = std::uint16_t;
+        using stim_index = std::array<index_type, DimStim>;
+        struct Entry
+        {
+            stim_index stimulus; /// Index into each stimulus axis.
+            int response;
+        };
+
+        /**
+         * @param n_resp Number of possible responses (sets the bits per response).
+         * @param capacity Keep at most this many trials (`0` for unbounded).
+         */
+        explicit CompactHistory(std::size_t n_resp = 2, std::size_t capacity = 0) : cap(capacity)
+        {
+            if (n_resp < 2 || n_resp > 256)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "CompactHistory supports between 2 and 256 responses.");
+            }
+            // round up to a power of two so that no response straddles a word
+            while ((std::size_t{1} << bits) < n_resp)
+            {
+                bits *= 2;
+            }
+            if (cap)
+            {
+                stimuli.resize(cap * DimStim);
+                responses.resize((cap * bits + 63) / 64);
+            }
+        }
+
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        /** @brief Trials ever recorded, including ones that have rotated out of the ring buffer. */
+        std::size_t total() const { return n_total; }
+        /** @brief Ring-buffer capacity (`0` if unbounded). */
+        std::size_t capacity() const { return cap; }
+        /** @brief Bytes used by the stored trials. */
+        std::size_t memory_bytes() const
+        {
+            return stimuli.capacity() * sizeof(index_type) + responses.capacity() * sizeof(std::uint64_t);
+        }
+
+        void reserve(std::size_t n)
+        {
+            if (!cap)
+            {
+                stimuli.reserve(n * DimStim);
+                responses.reserve((n * bits + 63) / 64);
+            }
+        }
+
+        void push_back(const stim_index &stimulus, int response)
+        {
+            std::size_t slot = n_total;
+            if (cap)
+            {
+                slot %= cap;
+                count += count < cap ? 1 : 0;
+            }
+            else
+            {
+                stimuli.resize(stimuli.size() + DimStim);
+                if (responses.size() * 64 < (slot + 1) * bits)
+                {
+                    responses.push_back(0);
+                }
+                count++;
+            }
+            for (std::size_t i = 0; i < DimStim; i++)
+            {
+                stimuli[slot * DimStim + i] = stimulus[i];
+            }
+            const std::size_t bit = slot * bits;
+            const std::uint64_t mask = ((std::uint64_t{1} << bits) - 1) << (bit % 64);
+            auto &word = responses[bit / 64];
+            word = (word & ~mask) | ((static_cast<std::uint64_t>(response) << (bit % 64)) & mask);
+            n_total++;
+        }
+
+        /** @brief Drop the most recent trial. Trials already overwritten in ring mode stay gone. */
+        void pop_back()
+        {
+            if (!count)
+            {
+                PSYDAPT_THROW(std::out_of_range, "The history is empty.");
+            }
+            count--;
+            n_total--;
+            if (!cap)
+            {
+                stimuli.resize(stimuli.size() - DimStim);
+                responses.resize((n_total * bits + 63) / 64);
+            }
+        }
+
+        /** @brief Trial `i`, where 0 is the oldest retained trial. */
+        Entry operator[](std::size_t i) const
+        {
+            const std::size_t slot = cap ? (n_total - count + i) % cap : i;
+            Entry out;
+            for (std::size_t j = 0; j < DimStim; j++)
+            {
+                out.stimulus[j] = stimuli[slot * DimStim + j];
+            }
+            const std::size_t bit = slot * bits;
+            out.response = static_cast<int>((responses[bit / 64] >> (bit % 64)) & ((std::uint64_t{1} << bits) - 1));
+            return out;
+        }
+        Entry back() const { return (*this)[count - 1]; }
+
+        /** @brief Iterator that unpacks entries (grid indices) on demand; `QuestPlusBase::trials()` decodes them to stimuli. */
+        class const_iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Entry;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = Entry;
+
+            const_iterator(const CompactHistory *h, std::size_t i) : hist(h), idx(i) {}
+            Entry operator*() const { return (*hist)[idx]; }
+            const_iterator &operator++()
+            {
+                idx++;
+                return *this;
+            }
+            const_iterator operator++(int)
+            {
+                auto tmp = *this;
+                idx++;
+                return tmp;
+            }
+            bool operator==(const const_iterator &o) const { return idx == o.idx && hist == o.hist; }
+            bool operator!=(const const_iterator &o) const { return !(*this == o); }
+
+        private:
+            const CompactHistory *hist;
+            std::size_t idx;
+        };
+        const_iterator begin() const { return {this, 0}; }
+        const_iterator end() const { return {this, count}; }
+
+    private:
+        std::vector<index_type> stimuli;
+        std::vector<std::uint64_t> responses;
+        std::size_t bits = 1;
+        std::size_t cap = 0;
+        std::size_t count = 0;
+        std::size_t n_total = 0;
+    };
+} // namespace psydapt
+
+#endif
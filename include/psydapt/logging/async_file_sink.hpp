@@ -0,0 +1,263 @@
+#ifndef PSYDAPT_LOGGING_ASYNC_FILE_SINK_HPP
+#define PSYDAPT_LOGGING_ASYNC_FILE_SINK_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../../config.hpp"
+#include "sink.hpp"
+#include "spsc_queue.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::logging::AsyncFileSink
+ */
+namespace psydapt::logging
+{
+    enum class Format
+    {
+        CSV,   /// One text row per trial, with a header row for new files.
+        Binary /// Fixed-size little-endian records (on any host) after an 8-byte magic and a uint32 stimulus dimension.
+    };
+
+    struct FileSinkParams
+    {
+        std::string path;                                     /// Output file, appended to if it exists.
+        Format format = Format::CSV;                          /// Output format.
+        std::size_t queue_capacity = 4096;                    /// Records buffered before new ones are dropped.
+        std::size_t batch_size = 256;                         /// Maximum records per write.
+        std::chrono::milliseconds flush_interval{20};         /// Writer sleep when the queue is empty.
+        bool fsync = false;                                   /// fsync after every batch, not just fflush.
+        bool summary = false;                                 /// Ask procedures for the posterior entropy.
+    };
+
+    /**
+     * @brief @ref TrialSink that hands records to a background writer thread.
+     *
+     * The experiment thread only copies the record into a lock-free SPSC queue,
+     * so there is exactly one producer: one procedure (or one thread driving
+     * several procedures) per sink. If the writer falls behind and the queue
+     * fills, records are dropped and counted rather than blocking; records in a
+     * batch the file wouldn't take (disk full, say) are counted as failed.
+     */
+    template <std::size_t DimStim>
+    class AsyncFileSink : public TrialSink<DimStim>
+    {
+    public:
+        explicit AsyncFileSink(const FileSinkParams &params) : settings(params), queue(params.queue_capacity)
+        {
+            file = std::fopen(settings.path.c_str(), settings.format == Format::Binary ? "ab" : "a");
+            if (!file)
+            {
+                PSYDAPT_THROW(std::runtime_error, "Could not open the trial log for writing.");
+            }
+            std::fseek(file, 0, SEEK_END);
+            if (std::ftell(file) == 0 && !write_header())
+            {
+                std::fclose(file);
+                PSYDAPT_THROW(std::runtime_error, "Could not write the trial log header.");
+            }
+            writer = std::thread([this]
+                                 { run(); });
+        }
+        AsyncFileSink(const AsyncFileSink &) = delete;
+        AsyncFileSink &operator=(const AsyncFileSink &) = delete;
+        ~AsyncFileSink() override
+        {
+            stopping.store(true, std::memory_order_release);
+            writer.join();
+            std::fclose(file);
+        }
+
+        void record(const TrialRecord<DimStim> &rec) noexcept override
+        {
+            if (!queue.try_push(rec))
+            {
+                n_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        bool wants_summary() const noexcept override { return settings.summary; }
+
+        /** @brief Records lost because the queue was full. */
+        std::size_t dropped() const { return n_dropped.load(std::memory_order_relaxed); }
+        /** @brief Records lost because writing or flushing their batch failed. */
+        std::size_t failed() const { return n_failed.load(std::memory_order_acquire); }
+        /** @brief Records written (and flushed) so far. */
+        std::size_t written() const { return n_written.load(std::memory_order_acquire); }
+
+    private:
+        const FileSinkParams settings;
+        SpscQueue<TrialRecord<DimStim>> queue;
+        std::FILE *file = nullptr;
+        std::thread writer;
+        std::atomic<bool> stopping{false};
+        std::atomic<std::size_t> n_dropped{0};
+        std::atomic<std::size_t> n_failed{0};
+        std::atomic<std::size_t> n_written{0};
+        std::vector<char> buffer;
+
+        bool write_header()
+        {
+            buffer.clear();
+            if (settings.format == Format::Binary)
+            {
+                put("PSYDLOG1", 8);
+                put_le(DimStim, 4);
+            }
+            else
+            {
+                char line[32];
+                put(line, std::snprintf(line, sizeof(line), "trial"));
+                for (std::size_t i = 0; i < DimStim; i++)
+                {
+                    put(line, std::snprintf(line, sizeof(line), ",stimulus_%zu", i));
+                }
+                put(line, std::snprintf(line, sizeof(line), ",response,posterior_entropy\n"));
+            }
+            return flush_buffer();
+        }
+
+        void append(const TrialRecord<DimStim> &rec)
+        {
+            if (settings.format == Format::Binary)
+            {
+                const double entropy = rec.posterior_entropy ? *rec.posterior_entropy
+                                                             : std::numeric_limits<double>::quiet_NaN();
+                put_le(rec.trial, 8);
+                for (const double s : rec.stimulus)
+                {
+                    put_le(bits(s), 8);
+                }
+                put_le(static_cast<std::uint32_t>(static_cast<std::int32_t>(rec.response)), 4);
+                put_le(bits(entropy), 8);
+            }
+            else
+            {
+                char line[64];
+                put(line, std::snprintf(line, sizeof(line), "%llu", static_cast<unsigned long long>(rec.trial)));
+                for (const double s : rec.stimulus)
+                {
+                    put(line, std::snprintf(line, sizeof(line), ",%.17g", s));
+                }
+                put(line, std::snprintf(line, sizeof(line), ",%d,", rec.response));
+                if (rec.posterior_entropy)
+                {
+                    put(line, std::snprintf(line, sizeof(line), "%.17g", *rec.posterior_entropy));
+                }
+                buffer.push_back('\n');
+            }
+        }
+
+        void put(const void *data, std::size_t n)
+        {
+            const char *p = static_cast<const char *>(data);
+            buffer.insert(buffer.end(), p, p + n);
+        }
+        void put(const char *data, int n)
+        {
+            put(static_cast<const void *>(data), static_cast<std::size_t>(n));
+        }
+        // low `n` bytes of `v`, least significant first, whatever the host's byte order
+        void put_le(std::uint64_t v, std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                buffer.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+            }
+        }
+        static std::uint64_t bits(double x)
+        {
+            std::uint64_t out;
+            std::memcpy(&out, &x, sizeof(out));
+            return out;
+        }
+
+        // write and flush `buffer`; false if the file didn't take all of it
+        bool flush_buffer()
+        {
+            bool ok = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+            ok = std::fflush(file) == 0 && ok;
+            if (ok && settings.fsync)
+            {
+#if defined(_WIN32)
+                ok = _commit(_fileno(file)) == 0;
+#else
+                ok = ::fsync(fileno(file)) == 0;
+#endif
+            }
+            return ok;
+        }
+
+        void run()
+        {
+            TrialRecord<DimStim> rec;
+            for (;;)
+            {
+                // read the flag first, so that a final drain sees everything pushed before it was set
+                const bool last = stopping.load(std::memory_order_acquire);
+                std::size_t n = 0;
+                buffer.clear();
+                while (n < settings.batch_size && queue.try_pop(rec))
+                {
+                    append(rec);
+                    n++;
+                }
+                if (n)
+                {
+                    if (flush_buffer())
+                    {
+                        n_written.fetch_add(n, std::memory_order_release);
+                    }
+                    else
+                    {
+                        // the batch is gone either way; give the next one a clean error flag
+                        std::clearerr(file);
+                        n_failed.fetch_add(n, std::memory_order_release);
+                    }
+                }
+                if (n < settings.batch_size)
+                {
+                    if (last)
+                    {
+                        return;
+                    }
+                    std::this_thread::sleep_for(settings.flush_interval);
+                }
+            }
+        }
+    };
+} // namespace psydapt::logging
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PSYDAPT_LOGGING_SINK_HPP
+#define PSYDAPT_LOGGING_SINK_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <optional>
+
+/** @file
+ * @brief Struct @ref psydapt::logging::TrialRecord, class @ref psydapt::logging::TrialSink
+ */
+namespace psydapt::logging
+{
+    /** @brief One completed trial, as handed to a @ref TrialSink. */
+    template <std::size_t DimStim>
+    struct TrialRecord
+    {
+        std::uint64_t trial;                      /// Zero-based trial index.
+        std::array<double, DimStim> stimulus;     /// Stimulus actually used.
+        int response;                             /// Participant response.
+        std::optional<double> posterior_entropy; /// Posterior entropy after the update (QUEST+, if requested).
+    };
+
+    /**
+     * @brief Receives every trial from @ref psydapt::Base::update().
+     *
+     * `record()` runs on the experiment thread, so implementations must not block.
+     */
+    template <std::size_t DimStim>
+    class TrialSink
+    {
+    public:
+        virtual ~TrialSink() = default;
+        virtual void record(const TrialRecord<DimStim> &rec) noexcept = 0;
+        /** @brief Whether the procedure should fill in `posterior_entropy` (costs a pass over the posterior). */
+        virtual bool wants_summary() const noexcept { return false; }
+    };
+} // namespace psydapt::logging
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef PSYDAPT_LOGGING_SPSC_QUEUE_HPP
+#define PSYDAPT_LOGGING_SPSC_QUEUE_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+/** @file
+ * @brief Class @ref psydapt::logging::SpscQueue
+ */
+namespace psydapt::logging
+{
+    /**
+     * @brief Bounded lock-free single-producer/single-consumer ring buffer.
+     *
+     * Pushing never blocks or allocates: a full queue makes `try_push()` return false.
+     */
+    template <class T>
+    class SpscQueue
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "SpscQueue elements must be trivially copyable.");
+
+    public:
+        /** @param capacity Rounded up to a power of two. */
+        explicit SpscQueue(std::size_t capacity)
+        {
+            std::size_t cap = 2;
+            while (cap < capacity)
+            {
+                cap *= 2;
+            }
+            mask = cap - 1;
+            slots = std::make_unique<T[]>(cap);
+        }
+        SpscQueue(const SpscQueue &) = delete;
+        SpscQueue &operator=(const SpscQueue &) = delete;
+
+        std::size_t capacity() const { return mask + 1; }
+
+        /** @brief Producer side. */
+        bool try_push(const T &value) noexcept
+        {
+            const std::size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head_cache > mask)
+            {
+                head_cache = head.load(std::memory_order_acquire);
+                if (t - head_cache > mask)
+                {
+                    return false;
+                }
+            }
+            slots[t & mask] = value;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** @brief Consumer side. */
+        bool try_pop(T &out) noexcept
+        {
+            const std::size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail_cache)
+            {
+                tail_cache = tail.load(std::memory_order_acquire);
+                if (h == tail_cache)
+                {
+                    return false;
+                }
+            }
+            out = slots[h & mask];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** @brief Approximate; exact only when neither side is running. */
+        bool empty() const noexcept
+        {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        // keep the two sides on separate cache lines
+        alignas(64) std::atomic<std::size_t> head{0};
+        std::size_t tail_cache = 0; // consumer's view of tail
+        alignas(64) std::atomic<std::size_t> tail{0};
+        std::size_t head_cache = 0; // producer's view of head
+        alignas(64) std::size_t mask;
+        std::unique_ptr<T[]> slots;
+    };
+} // namespace psydapt::logging
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef PSYDAPT_MULTI_PROCEDURE_HPP
+#define PSYDAPT_MULTI_PROCEDURE_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../../config.hpp"
+#include "../base.hpp"
+#include "../parallel/thread_pool.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::multi::MultiProcedure
+ */
+namespace psydapt::multi
+{
+    namespace detail
+    {
+        template <class Procedure>
+        using stim_t = std::decay_t<decltype(std::declval<Procedure &>().next())>;
+
+        // std::variant with duplicate alternatives removed, so that e.g. two
+        // scalar-stimulus procedures don't make construction by type ambiguous
+        template <class V, class... Ts>
+        struct unique_variant
+        {
+            using type = V;
+        };
+        template <class... Vs, class T, class... Ts>
+        struct unique_variant<std::variant<Vs...>, T, Ts...>
+            : std::conditional_t<(std::is_same_v<T, Vs> || ...),
+                                 unique_variant<std::variant<Vs...>, Ts...>,
+                                 unique_variant<std::variant<Vs..., T>, Ts...>>
+        {
+        };
+    } // namespace detail
+
+    /** @brief How the next condition is chosen. */
+    enum class Order
+    {
+        Sequential, /// Cycle through conditions in the order given.
+        Random      /// Visit every active condition once per pass, in a freshly shuffled order.
+    };
+
+    struct Params
+    {
+        Order order = Order::Random; /// Condition selection rule.
+        unsigned int random_seed = 1; /// Seed for `Order::Random`.
+        unsigned int n_threads = 1;   /// Workers in the internal pool (ignored if a pool is passed in).
+    };
+
+    /**
+     * @brief Interleaves several adaptive procedures, in the spirit of PsychoPy's MultiStairHandler.
+     *
+     * After a condition is updated, its next stimulus is computed on a worker pool
+     * while other conditions' trials run, so `next()` usually just collects a finished
+     * result. Each condition still sees exactly the same next()/update() sequence it
+     * would on its own, so results don't depend on the interleaving or thread count.
+     *
+     * Procedures must not be inspected through @ref procedure() while their next
+     * stimulus is being computed (i.e. between update() and the next time that
+     * condition is returned from next()).
+     */
+    template <class... Procedures>
+    class MultiProcedure
+    {
+    public:
+        using procedure_type = std::variant<Procedures...>;
+        using stim_type = typename detail::unique_variant<std::variant<>, detail::stim_t<Procedures>...>::type;
+        struct Trial
+        {
+            std::size_t condition; /// Index into the procedures passed to the constructor.
+            stim_type stimulus;    /// Stimulus for this condition.
+        };
+
+        /**
+         * @param procedures One procedure per condition.
+         * @param params Scheduling settings.
+         * @param pool Optional pool shared with other components; otherwise one is created.
+         */
+        MultiProcedure(std::vector<procedure_type> procedures, const Params &params = Params{},
+                       std::shared_ptr<parallel::ThreadPool> pool = nullptr)
+            : procedures(std::move(procedures)), settings(params),
+              pool(pool ? std::move(pool) : std::make_shared<parallel::ThreadPool>(params.n_threads)),
+              rng(params.random_seed)
+        {
+            if (this->procedures.empty())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "At least one procedure is required.");
+            }
+            const auto n = this->procedures.size();
+            pending.resize(n);
+            active.assign(n, true);
+            for (std::size_t c = 0; c < n; c++)
+            {
+                prefetch(c);
+            }
+        }
+        MultiProcedure(const MultiProcedure &) = delete;
+        MultiProcedure &operator=(const MultiProcedure &) = delete;
+        ~MultiProcedure()
+        {
+            // workers hold pointers into `procedures`
+            for (auto &p : pending)
+            {
+                if (p.valid())
+                {
+                    p.wait();
+                }
+            }
+        }
+
+        /** @brief Pick the next condition and return its stimulus.
+         *
+         * If that condition's next() threw, the exception is rethrown here and the
+         * condition stays first in line, with its next() asked again for the following call.
+         */
+        Trial next()
+        {
+            if (current)
+            {
+                PSYDAPT_THROW(std::runtime_error, "update() must be called before the next call to next().");
+            }
+            if (queue.empty())
+            {
+                refill();
+            }
+            if (queue.empty())
+            {
+                PSYDAPT_THROW(std::runtime_error, "All procedures have finished.");
+            }
+            const std::size_t c = queue.front();
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            try
+            {
+#endif
+                stim_type stim = pending[c].get();
+                queue.pop_front();
+                current = c;
+                return Trial{c, std::move(stim)};
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            }
+            catch (...)
+            {
+                // the future is spent; ask again so the next call retries `c` instead of finding nothing
+                prefetch(c);
+                throw;
+            }
+#endif
+        }
+
+        /** @brief Update the condition last returned by next().
+         * @return Whether any condition is still running.
+         */
+        bool update(int response)
+        {
+            if (!current)
+            {
+                PSYDAPT_THROW(std::runtime_error, "next() must be called before update().");
+            }
+            const std::size_t c = *current;
+            current.reset();
+            const bool cont = std::visit([response](auto &proc)
+                                         { return proc.update(response); },
+                                         procedures[c]);
+            if (cont)
+            {
+                prefetch(c);
+            }
+            else
+            {
+                active[c] = false;
+                queue.erase(std::remove(queue.begin(), queue.end(), c), queue.end());
+            }
+            return std::find(active.begin(), active.end(), true) != active.end();
+        }
+
+        /** @brief Number of conditions. */
+        std::size_t size() const { return procedures.size(); }
+        /** @brief Whether condition `c` has stopped. */
+        bool finished(std::size_t c) const { return !active[c]; }
+        /** @brief Access the procedure for condition `c` (see class notes on concurrency). */
+        template <class P>
+        const P &procedure(std::size_t c) const { return std::get<P>(procedures[c]); }
+
+    private:
+        std::vector<procedure_type> procedures;
+        const Params settings;
+        std::shared_ptr<parallel::ThreadPool> pool;
+        std::vector<std::future<stim_type>> pending; // next() results, one per condition
+        std::vector<bool> active;
+        std::deque<std::size_t> queue; // remaining conditions in the current pass
+        std::optional<std::size_t> current;
+        std::mt19937 rng;
+
+        void prefetch(std::size_t c)
+        {
+            auto *proc = &procedures[c];
+            pending[c] = pool->submit([proc]
+                                      { return std::visit([](auto &p)
+                                                          { return stim_type{p.next()}; },
+                                                          *proc); });
+        }
+
+        void refill()
+        {
+            for (std::size_t c = 0; c < procedures.size(); c++)
+            {
+                if (active[c])
+                {
+                    queue.push_back(c);
+                }
+            }
+            if (settings.order == Order::Random)
+            {
+                std::shuffle(queue.begin(), queue.end(), rng);
+            }
+        }
+    };
+} // namespace psydapt::multi
+
+#endif
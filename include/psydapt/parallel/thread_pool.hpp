@@ -0,0 +1,204 @@
+#ifndef PSYDAPT_PARALLEL_THREAD_POOL_HPP
+#define PSYDAPT_PARALLEL_THREAD_POOL_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "../../config.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::parallel::ThreadPool
+ */
+namespace psydapt::parallel
+{
+    /**
+     * @brief Fixed-size pool of worker threads fed from a single FIFO queue.
+     *
+     * Shared by the simulation harness and any other component that wants to
+     * push work off the calling thread.
+     */
+    class ThreadPool
+    {
+    public:
+        /** @param n_threads Number of workers. `0` uses `std::thread::hardware_concurrency()`. */
+        explicit ThreadPool(unsigned int n_threads = 0)
+        {
+            if (n_threads == 0)
+            {
+                n_threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            workers.reserve(n_threads);
+            for (unsigned int i = 0; i < n_threads; i++)
+            {
+                workers.emplace_back([this]
+                                     { work(); });
+            }
+        }
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto &w : workers)
+            {
+                w.join();
+            }
+        }
+
+        /** @brief Number of worker threads. */
+        unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+        /** @brief Queue a callable, returning a future for its result. */
+        template <class F>
+        std::future<std::invoke_result_t<std::decay_t<F>>> submit(F &&f)
+        {
+            using result_type = std::invoke_result_t<std::decay_t<F>>;
+            // std::function needs a copyable target, packaged_task isn't
+            auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+            auto fut = task->get_future();
+            enqueue([task]
+                    { (*task)(); });
+            return fut;
+        }
+
+        /**
+         * @brief Call `f(i)` for every `i` in `[0, n)`, blocking until all are done.
+         *
+         * Indices are handed out dynamically, so uneven per-index cost still balances.
+         * The calling thread participates and never waits on queued tasks, so nesting
+         * this inside a task cannot deadlock. The first exception thrown by `f` is rethrown.
+         */
+        template <class F>
+        void parallel_for(std::size_t n, F &&f)
+        {
+            if (n == 0)
+            {
+                return;
+            }
+            // shared so that tasks still queued after we return find nothing to do,
+            // rather than touching a dead stack frame
+            auto state = std::make_shared<ForState>();
+            auto *fn = &f;
+            auto body = [state, fn, n]
+            {
+                for (std::size_t i = state->next++; i < n; i = state->next++)
+                {
+#if defined(PSYDAPT_DISABLE_EXCEPTIONS)
+                    (*fn)(i);
+#else
+                    try
+                    {
+                        (*fn)(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if (!state->error)
+                        {
+                            state->error = std::current_exception();
+                        }
+                    }
+#endif
+                    if (++state->done == n)
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->cv.notify_all();
+                    }
+                }
+            };
+            const std::size_t n_tasks = std::min<std::size_t>(size(), n - 1);
+            for (std::size_t i = 0; i < n_tasks; i++)
+            {
+                enqueue(body);
+            }
+            body();
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cv.wait(lock, [&state, n]
+                           { return state->done == n; });
+            if (state->error)
+            {
+                std::rethrow_exception(state->error);
+            }
+        }
+
+    private:
+        struct ForState
+        {
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> done{0};
+            std::exception_ptr error;
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping = false;
+
+        void enqueue(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push(std::move(task));
+            }
+            cv.notify_one();
+        }
+
+        void work()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [this]
+                            { return stopping || !tasks.empty(); });
+                    if (stopping && tasks.empty())
+                    {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+    };
+} // namespace psydapt::parallel
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef PSYDAPT_PARALLEL_WORK_STEALING_POOL_HPP
+#define PSYDAPT_PARALLEL_WORK_STEALING_POOL_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "../../config.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::parallel::WorkStealingPool
+ */
+namespace psydapt::parallel
+{
+    /**
+     * @brief Thread pool with one task deque per worker and stealing between them.
+     *
+     * Tasks submitted from a worker go to the back of that worker's own deque and
+     * are popped back LIFO (so follow-up work stays cache-warm); tasks from other
+     * threads are spread round-robin. A worker with an empty deque steals from the
+     * front of the others'. Unlike @ref ThreadPool, there is no single queue for
+     * every submission to contend on, which matters with many short requests
+     * (e.g. the session server's next()/update() calls).
+     *
+     * Deques are mutex-protected rather than lock-free; each lock is held only
+     * for a push or pop.
+     */
+    class WorkStealingPool
+    {
+    public:
+        /** @param n_threads Number of workers. `0` uses `std::thread::hardware_concurrency()`. */
+        explicit WorkStealingPool(unsigned int n_threads = 0)
+        {
+            if (n_threads == 0)
+            {
+                n_threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            queues = std::vector<Queue>(n_threads);
+            workers.reserve(n_threads);
+            for (unsigned int i = 0; i < n_threads; i++)
+            {
+                workers.emplace_back([this, i]
+                                     { work(i); });
+            }
+        }
+        WorkStealingPool(const WorkStealingPool &) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+        /** Runs every task already submitted, then joins the workers. */
+        ~WorkStealingPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                stopping = true;
+            }
+            sleep_cv.notify_all();
+            for (auto &w : workers)
+            {
+                w.join();
+            }
+        }
+
+        /** @brief Number of worker threads. */
+        unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+        /** @brief Queue a callable, returning a future for its result. */
+        template <class F>
+        std::future<std::invoke_result_t<std::decay_t<F>>> submit(F &&f)
+        {
+            using result_type = std::invoke_result_t<std::decay_t<F>>;
+            auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+            auto fut = task->get_future();
+            post([task]
+                 { (*task)(); });
+            return fut;
+        }
+
+        /** @brief Queue a callable without a future (exceptions it throws are dropped). */
+        void post(std::function<void()> task)
+        {
+            push(std::move(task), true);
+        }
+
+        /**
+         * @brief Like post(), but behind the work already waiting.
+         *
+         * From a worker, the task goes to the steal end of its own deque, so the
+         * worker runs everything else it has first and idle workers take it first.
+         * For tasks that requeue themselves (e.g. a session's next job).
+         */
+        void defer(std::function<void()> task)
+        {
+            push(std::move(task), false);
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<Queue> queues;
+        std::vector<std::thread> workers;
+        std::atomic<std::size_t> next_queue{0};
+        std::atomic<std::size_t> queued{0}; // tasks in the deques (changed under the deque's lock)
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_cv;
+        bool stopping = false;
+
+        // which pool (if any) the current thread works for, so submissions from tasks stay local
+        static inline thread_local const WorkStealingPool *current_pool = nullptr;
+        static inline thread_local std::size_t current_worker = 0;
+
+        // `lifo`: push where the owner pops next; otherwise where thieves (and, last, the owner) do
+        void push(std::function<void()> task, bool lifo)
+        {
+            const std::size_t q = current_pool == this ? current_worker
+                                                       : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+            {
+                std::lock_guard<std::mutex> lock(queues[q].mutex);
+                if (lifo)
+                {
+                    queues[q].tasks.push_back(std::move(task));
+                }
+                else
+                {
+                    queues[q].tasks.push_front(std::move(task));
+                }
+                queued.fetch_add(1);
+            }
+            {
+                // pairs with the predicate check in work(), so no wake-up is lost
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+            }
+            sleep_cv.notify_one();
+        }
+
+        bool pop(std::size_t i, std::function<void()> &task)
+        {
+            {
+                auto &own = queues[i];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tasks.empty())
+                {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    queued.fetch_sub(1);
+                    return true;
+                }
+            }
+            for (std::size_t k = 1; k < queues.size(); k++)
+            {
+                auto &victim = queues[(i + k) % queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    queued.fetch_sub(1);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(std::size_t i)
+        {
+            current_pool = this;
+            current_worker = i;
+            std::function<void()> task;
+            for (;;)
+            {
+                if (pop(i, task))
+                {
+#if defined(PSYDAPT_DISABLE_EXCEPTIONS)
+                    task();
+#else
+                    try
+                    {
+                        task();
+                    }
+                    catch (...)
+                    {
+                        // submit() tasks report through their future; post() callers opted out
+                    }
+#endif
+                    task = nullptr;
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                sleep_cv.wait(lock, [this]
+                              { return stopping || queued.load() > 0; });
+                if (stopping && queued.load() == 0)
+                {
+                    return;
+                }
+            }
+        }
+    };
+} // namespace psydapt::parallel
+
+#endif
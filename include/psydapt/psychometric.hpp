@@ -0,0 +1,60 @@
+#ifndef PSYDAPT_PSYCHOMETRIC_HPP
+#define PSYDAPT_PSYCHOMETRIC_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+
+#include "base.hpp"
+
+/** @file
+ * @brief Functions @ref psydapt::psychometric::weibull, @ref psydapt::psychometric::norm_cdf
+ *
+ * Scalar psychometric functions shared by the QUEST+ models (which build their
+ * likelihood tables from them) and the simulated observers.
+ */
+namespace psydapt::psychometric
+{
+    /** @brief Probability of a `1` response to `x` under a Weibull with the given threshold, on `scale`. */
+    inline double weibull(double x, double threshold, double slope, double lower_asymptote, double lapse_rate, Scale scale)
+    {
+        double z = 0;
+        switch (scale)
+        {
+        case Scale::Linear:
+            z = std::pow(x / threshold, slope);
+            break;
+        case Scale::Log10:
+            z = std::pow(10.0, slope * (x - threshold));
+            break;
+        case Scale::dB:
+            z = std::pow(10.0, slope * (x - threshold) * 0.05);
+            break;
+        }
+        return 1 - lapse_rate - (1 - lower_asymptote - lapse_rate) * std::exp(-z);
+    }
+
+    /** @brief Probability of a `1` response to `x` under a cumulative normal (linear scale only). */
+    inline double norm_cdf(double x, double location, double scale, double lower_asymptote, double lapse_rate)
+    {
+        return lower_asymptote + (1 - lower_asymptote - lapse_rate) * (std::erfc(-((x - location) / scale) * std::sqrt(0.5)) * 0.5);
+    }
+} // namespace psydapt::psychometric
+
+#endif
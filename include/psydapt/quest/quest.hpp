@@ -0,0 +1,404 @@
+#ifndef PSYDAPT_QUEST_QUEST_HPP
+#define PSYDAPT_QUEST_QUEST_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "../../config.hpp"
+#include "../base.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::quest::Quest
+ */
+namespace psydapt::quest
+{
+    /** @brief Which summary of the threshold posterior next() places the stimulus at. */
+    enum class Estimator
+    {
+        Mean,    /// Posterior mean (ZEST; King-Smith et al., 1994).
+        Mode,    /// Posterior mode (the original QUEST).
+        Quantile /// Posterior quantile given by `Params::quantile` (Pelli, 1987).
+    };
+
+    /**
+     * @brief QUEST/ZEST for a single threshold with a fixed Weibull slope (Watson & Pelli, 1983).
+     *
+     * The threshold lives on an evenly spaced grid of `grain` around `t_guess`, and
+     * stimuli are placed on the same lattice. Because the psychometric function only
+     * depends on `stimulus - threshold` on a log scale, the log-likelihood of each
+     * response is one template, built once, and every update() adds a shifted window
+     * of it to the log-posterior: O(N) per trial, with no table over stimuli.
+     *
+     * The psychometric function is the one used by @ref questplus::Weibull, so
+     * Watson & Pelli's `gamma` is `lower_asymptote` and their `delta` corresponds to
+     * `lapse_rate = delta * (1 - gamma)`.
+     */
+    class Quest : public Base<Quest, 1>
+    {
+    public:
+        struct Params
+        {
+            double t_guess;                                   /// Prior mean of the threshold.
+            double t_guess_sd;                                /// Prior standard deviation of the threshold.
+            unsigned int n_trials;                            /// Number of trials.
+            Scale stim_scale = Scale::Log10;                  /// Scale of the stimulus (`Log10` or `dB`).
+            double slope = 3.5;                               /// Weibull slope (`beta`).
+            double lower_asymptote = 0.5;                     /// Guess rate (`gamma`).
+            double lapse_rate = 0.01;                         /// Lapse rate.
+            std::optional<double> p_threshold = std::nullopt; /// Proportion correct at threshold (unset uses the Weibull's own, as in @ref questplus::Weibull).
+            double grain = 0.01;                              /// Spacing of the threshold grid and the stimulus lattice.
+            double range = 5;                                 /// Width of the threshold grid, centred on `t_guess`.
+            Estimator estimator = Estimator::Mean;            /// Where next() places the stimulus.
+            double quantile = 0.5;                            /// Quantile used by `Estimator::Quantile`.
+            std::optional<double> stop_sd = std::nullopt;     /// Also stop once the posterior standard deviation falls below this.
+            std::optional<double> min_val = std::nullopt;     /// Smallest allowed stimulus.
+            std::optional<double> max_val = std::nullopt;     /// Largest allowed stimulus.
+        };
+
+        Quest(const Params &params) : settings(params)
+        {
+            if (settings.stim_scale == Scale::Linear)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "Quest needs a logarithmic stim_scale (Log10 or dB).");
+            }
+            if (!(settings.grain > 0) || !(settings.range >= settings.grain) || !(settings.t_guess_sd > 0) || !(settings.slope > 0))
+            {
+                PSYDAPT_THROW(std::invalid_argument, "grain, range, t_guess_sd and slope must be positive, with range at least grain.");
+            }
+            if (!(settings.lower_asymptote >= 0) || !(settings.lapse_rate >= 0) || !(settings.lower_asymptote + settings.lapse_rate < 1))
+            {
+                PSYDAPT_THROW(std::invalid_argument, "lower_asymptote and lapse_rate must be non-negative and sum to less than 1.");
+            }
+            if (settings.p_threshold && !(*settings.p_threshold > settings.lower_asymptote && *settings.p_threshold < 1 - settings.lapse_rate))
+            {
+                PSYDAPT_THROW(std::invalid_argument, "p_threshold must lie between lower_asymptote and 1 - lapse_rate.");
+            }
+            if (settings.estimator == Estimator::Quantile && !(settings.quantile > 0 && settings.quantile < 1))
+            {
+                PSYDAPT_THROW(std::invalid_argument, "quantile must lie in (0, 1).");
+            }
+
+            half = static_cast<std::ptrdiff_t>(std::ceil(settings.range / (2 * settings.grain) - 1e-9));
+            const std::size_t n = static_cast<std::size_t>(2 * half + 1);
+            // Gaussian prior, as a log-density on the grid
+            log_posterior.resize(n);
+            for (std::size_t k = 0; k < n; k++)
+            {
+                const double z = grid_offset(k) / settings.t_guess_sd;
+                log_posterior[k] = -0.5 * z * z;
+            }
+            peak = static_cast<std::size_t>(half);
+
+            // template index m covers stimulus - threshold = (m - reach - half) * grain, for
+            // stimuli up to `reach` lattice steps from t_guess and every grid threshold
+            reach = 2 * half;
+            const std::size_t n_template = static_cast<std::size_t>(2 * reach + 2 * half + 1);
+            log_template[0].resize(n_template);
+            log_template[1].resize(n_template);
+            const double tiny = std::numeric_limits<double>::min(); // keeps log(0) finite when there's no guessing or lapsing
+            for (std::size_t m = 0; m < n_template; m++)
+            {
+                const double d = static_cast<double>(static_cast<std::ptrdiff_t>(m) - reach - half) * settings.grain;
+                const double p = psychometric(settings, d, 0.0);
+                log_template[0][m] = std::log(std::max(1 - p, tiny));
+                log_template[1][m] = std::log(std::max(p, tiny));
+            }
+
+            next_stimulus = place(estimate());
+            response_history.reserve(settings.n_trials);
+            stimulus_history.reserve(settings.n_trials);
+            snapshots.reserve(settings.n_trials);
+        }
+
+        /** @brief Probability of a `1` response to `x` for an observer whose threshold is `threshold`. */
+        static double psychometric(const Params &params, double x, double threshold)
+        {
+            const double k = params.stim_scale == Scale::dB ? 20.0 : 1.0;
+            double shift = 0;
+            if (params.p_threshold)
+            {
+                // move the curve so that p(threshold) == p_threshold
+                const double z = -std::log((1 - params.lapse_rate - *params.p_threshold) /
+                                           (1 - params.lower_asymptote - params.lapse_rate));
+                shift = k * std::log10(z) / params.slope;
+            }
+            const double z = std::pow(10.0, params.slope * (x - threshold + shift) / k);
+            return 1 - params.lapse_rate - (1 - params.lower_asymptote - params.lapse_rate) * std::exp(-z);
+        }
+
+        double next()
+        {
+            if (!should_continue)
+            {
+                PSYDAPT_THROW(std::runtime_error, "The procedure has already finished.");
+            }
+            next_stimulus = place(estimate());
+            return next_stimulus;
+        }
+
+        /** @brief Add the trial's shifted log-likelihood template to the log-posterior.
+         *
+         * The stimulus is rounded to the `grain` lattice, and stimuli more than `range`
+         * from `t_guess` count as if they were `range` away.
+         */
+        bool update(int response, std::optional<double> stimulus = std::nullopt)
+        {
+            if (response != 0 && response != 1)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "Quest responses must be 0 or 1.");
+            }
+            const double x = stimulus ? *stimulus : next_stimulus;
+            const std::ptrdiff_t j = lattice_index(x);
+            snapshots.push_back({next_stimulus, should_continue, j});
+            stimulus_history.push_back(x);
+            response_history.push_back(response);
+            shift_add(log_template[response], j, 1.0);
+
+            if (sink_wants_summary())
+            {
+                log_trial(x, response, entropy());
+            }
+            else
+            {
+                log_trial(x, response);
+            }
+            should_continue = stimulus_history.size() < settings.n_trials && !(settings.stop_sd && sd() < *settings.stop_sd);
+            return should_continue;
+        }
+
+        /**
+         * @brief Apply many trials at once (next() doesn't change the posterior, so this is just repeated update()s).
+         *
+         * Stops at the first trial after which the procedure should stop; later trials are not applied.
+         * @return Whether to continue the procedure.
+         */
+        bool update_many(const std::vector<int> &responses, const std::vector<double> &stimuli)
+        {
+            if (responses.size() != stimuli.size())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "There must be one stimulus per response.");
+            }
+            for (std::size_t t = 0; t < responses.size(); t++)
+            {
+                if (!update(responses[t], stimuli[t]))
+                {
+                    return false;
+                }
+            }
+            return should_continue;
+        }
+
+        /** @brief Revert the most recent update() by subtracting its template; call again to go further back. */
+        void undo()
+        {
+            if (snapshots.empty())
+            {
+                PSYDAPT_THROW(std::runtime_error, "There is no trial to undo.");
+            }
+            const auto &snap = snapshots.back();
+            shift_add(log_template[response_history.back()], snap.index, -1.0);
+            next_stimulus = snap.next_stimulus;
+            should_continue = snap.should_continue;
+            snapshots.pop_back();
+            stimulus_history.pop_back();
+            response_history.pop_back();
+            trial_index--;
+        }
+
+        /** @brief Posterior mean of the threshold. */
+        double mean() const
+        {
+            double total = 0, first = 0;
+            for_each_weight([&](std::size_t k, double w)
+                            {
+                                total += w;
+                                first += w * grid_offset(k);
+                            });
+            return settings.t_guess + first / total;
+        }
+        /** @brief Posterior standard deviation of the threshold. */
+        double sd() const
+        {
+            double total = 0, first = 0, second = 0;
+            for_each_weight([&](std::size_t k, double w)
+                            {
+                                const double t = grid_offset(k);
+                                total += w;
+                                first += w * t;
+                                second += w * t * t;
+                            });
+            const double m = first / total;
+            return std::sqrt(std::max(0.0, second / total - m * m));
+        }
+        /** @brief Posterior mode of the threshold (a grid point). */
+        double mode() const
+        {
+            return settings.t_guess + grid_offset(peak);
+        }
+        /** @brief Posterior quantile `q` of the threshold, interpolated between grid points. */
+        double quantile(double q) const
+        {
+            std::vector<double> pdf = posterior();
+            double cum = 0;
+            for (std::size_t k = 0; k < pdf.size(); k++)
+            {
+                if (cum + pdf[k] >= q && pdf[k] > 0)
+                {
+                    // the mass of grid point k is spread over its cell
+                    const double frac = (q - cum) / pdf[k];
+                    return settings.t_guess + grid_offset(k) + (frac - 0.5) * settings.grain;
+                }
+                cum += pdf[k];
+            }
+            return settings.t_guess + grid_offset(pdf.size() - 1);
+        }
+        /** @brief Normalised posterior over @ref threshold_grid. */
+        std::vector<double> posterior() const
+        {
+            std::vector<double> pdf(log_posterior.size());
+            double total = 0;
+            for_each_weight([&](std::size_t k, double w)
+                            {
+                                pdf[k] = w;
+                                total += w;
+                            });
+            for (auto &p : pdf)
+            {
+                p /= total;
+            }
+            return pdf;
+        }
+        /** @brief Threshold values the posterior is defined on. */
+        std::vector<double> threshold_grid() const
+        {
+            std::vector<double> grid(log_posterior.size());
+            for (std::size_t k = 0; k < grid.size(); k++)
+            {
+                grid[k] = settings.t_guess + grid_offset(k);
+            }
+            return grid;
+        }
+
+    private:
+        // state at the start of each update(), for undo()
+        struct Snapshot
+        {
+            double next_stimulus;
+            bool should_continue;
+            std::ptrdiff_t index; // lattice index the trial's template was applied at
+        };
+        std::vector<Snapshot> snapshots;
+        const Params settings;
+        std::ptrdiff_t half = 0;             // grid is t_guess + (k - half) * grain, k in [0, 2 * half]
+        std::ptrdiff_t reach = 0;            // furthest stimulus lattice index the template covers
+        std::vector<double> log_posterior;   // unnormalised
+        std::vector<double> log_template[2]; // log p(response | stimulus - threshold), per response
+        std::size_t peak = 0;                // argmax of log_posterior
+
+        double grid_offset(std::size_t k) const
+        {
+            return static_cast<double>(static_cast<std::ptrdiff_t>(k) - half) * settings.grain;
+        }
+
+        std::ptrdiff_t lattice_index(double x) const
+        {
+            const double j = std::round((x - settings.t_guess) / settings.grain);
+            return static_cast<std::ptrdiff_t>(std::clamp(j, static_cast<double>(-reach), static_cast<double>(reach)));
+        }
+
+        // log_posterior[k] += sign * tmpl[j - k + reach + 2 * half], tracking the new peak
+        void shift_add(const std::vector<double> &tmpl, std::ptrdiff_t j, double sign)
+        {
+            const double *window = tmpl.data() + (j + reach + 2 * half);
+            const std::size_t n = log_posterior.size();
+            double best = -std::numeric_limits<double>::infinity();
+            for (std::size_t k = 0; k < n; k++)
+            {
+                log_posterior[k] += sign * window[-static_cast<std::ptrdiff_t>(k)];
+                if (log_posterior[k] > best)
+                {
+                    best = log_posterior[k];
+                    peak = k;
+                }
+            }
+        }
+
+        // f(k, w) with w proportional to the posterior at grid point k
+        template <class F>
+        void for_each_weight(F &&f) const
+        {
+            const double top = log_posterior[peak];
+            for (std::size_t k = 0; k < log_posterior.size(); k++)
+            {
+                f(k, std::exp(log_posterior[k] - top));
+            }
+        }
+
+        double entropy() const
+        {
+            double h = 0;
+            for (const double p : posterior())
+            {
+                if (p > 0)
+                {
+                    h -= p * std::log(p);
+                }
+            }
+            return h;
+        }
+
+        double estimate() const
+        {
+            switch (settings.estimator)
+            {
+            case Estimator::Mode:
+                return mode();
+            case Estimator::Quantile:
+                return quantile(settings.quantile);
+            case Estimator::Mean:
+            default:
+                return mean();
+            }
+        }
+
+        // snap to the stimulus lattice (what update() would assume), then apply the limits
+        double place(double x) const
+        {
+            double s = settings.t_guess + std::round((x - settings.t_guess) / settings.grain) * settings.grain;
+            if (settings.max_val)
+            {
+                s = std::min(s, *settings.max_val);
+            }
+            if (settings.min_val)
+            {
+                s = std::max(s, *settings.min_val);
+            }
+            return s;
+        }
+    };
+} // namespace psydapt::quest
+
+#endif
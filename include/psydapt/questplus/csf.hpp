@@ -19,6 +19,10 @@ You should have received a copy of the GNU General Public License
 along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <vector>
 #include <optional>
 
@@ -28,6 +32,7 @@ along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "../../config.hpp"
 #include "../base.hpp"
+#include "../psychometric.hpp"
 #include "questplus.hpp"
 
 /** @file
@@ -49,6 +54,12 @@ namespace psydapt::questplus
             std::vector<double> contrast;      /// Array of possible contrast thresholds.
             std::vector<double> spatial_freq;  /// Array of possible spatial frequencies.
             std::vector<double> temporal_freq; /// Array of possible temporal frequencies.
+            /// Return `false` for (contrast, spatial_freq, temporal_freq) combinations that can't be
+            /// presented; they are left out of the likelihood table and never selected. Unset keeps all.
+            std::function<bool(const std::array<double, 3> &)> stimulus_filter;
+            /// Return `false` for impossible parameter combinations (in @ref parameter_domain order),
+            /// e.g. known-bad c0/min_thresh pairs; those cells are not stored. Unset keeps all.
+            std::function<bool(const std::array<double, 7> &)> parameter_filter;
             // params
             std::vector<double> c0;                    /// Array of possible values for this coefficient.
             std::vector<double> cf;                    /// Array of possible values for this coefficient.
@@ -71,6 +82,40 @@ namespace psydapt::questplus
             QPB::setup();
         }
 
+        /** @brief Parameter axes in posterior order: c0, cf, cw, min_thresh, slope, lower asymptote, lapse rate. */
+        static std::array<std::vector<double>, 7> parameter_domain(const Params &params)
+        {
+            return {params.c0, params.cf, params.cw, params.min_thresh,
+                    params.slope, params.lower_asymptote, params.lapse_rate};
+        }
+        /** @brief Priors matching @ref parameter_domain (unset means flat). */
+        static std::array<std::optional<std::vector<double>>, 7> parameter_priors(const Params &params)
+        {
+            return {params.c0_prior, params.cf_prior, params.cw_prior, params.min_thresh_prior,
+                    params.slope_prior, params.lower_asymptote_prior, params.lapse_rate_prior};
+        }
+        /** @brief Stimulus axes: contrast, spatial frequency, temporal frequency. */
+        static std::array<std::vector<double>, 3> stimulus_domain(const Params &params)
+        {
+            return {params.contrast, params.spatial_freq, params.temporal_freq};
+        }
+        /** @brief Memory and per-trial work for `params`, without building anything (see @ref Cost). */
+        static Cost estimate_cost(const Params &params)
+        {
+            return QPB::cost_of({params.contrast.size(), params.spatial_freq.size(), params.temporal_freq.size()},
+                                {params.c0.size(), params.cf.size(), params.cw.size(), params.min_thresh.size(),
+                                 params.slope.size(), params.lower_asymptote.size(), params.lapse_rate.size()},
+                                params);
+        }
+        /** @brief Probability of a `1` response for one stimulus and one parameter vector. */
+        static double psychometric(const Params &params, const std::array<double, 3> &x, const std::array<double, 7> &theta)
+        {
+            const double c0 = theta[0], cf = theta[1], cw = theta[2], min_thresh = theta[3];
+            const double slope = theta[4], lower = theta[5], lapse = theta[6];
+            const double t = std::max(min_thresh, c0 + cf * x[1] + cw * x[2]);
+            return psydapt::psychometric::weibull(x[0], t, slope, lower, lapse, params.stim_scale);
+        }
+
     protected:
         const Params settings;
 
@@ -81,6 +126,11 @@ namespace psydapt::questplus
             stimuli[2] = xt::adapt<xt::layout_type::row_major>(settings.temporal_freq, {settings.temporal_freq.size()});
         }
 
+        void make_params()
+        {
+            parameters = parameter_domain(settings);
+        }
+
         xt::xtensor<double, CSF::dim_param> generate_prior()
         {
             const auto c0_prior = prior_helper(settings.c0, settings.c0_prior, 0);
@@ -93,44 +143,6 @@ namespace psydapt::questplus
             xt::xtensor<double, CSF::dim_param> prior = c0_prior * cf_prior * cw_prior * min_thresh_prior * slope_prior * lower_prior * lapse_prior;
             return prior / xt::sum(prior, xt::evaluation_strategy::immediate);
         }
-
-        xt::xtensor<double, CSF::dim_param + CSF::dim_stim + 1> generate_likelihoods()
-        {
-            // (7 param, 3 stim)
-            const Params &set = settings;
-            using sz = std::array<std::size_t, CSF::dim_param + CSF::dim_stim>;
-            // const auto &row_major = xt::layout_type::row_major;
-            // stim
-            const auto x = xt::adapt<xt::layout_type::row_major>(set.contrast, sz{set.contrast.size(), 1, 1, 1, 1, 1, 1, 1, 1, 1});
-            const auto f = xt::adapt<xt::layout_type::row_major>(set.spatial_freq, sz{1, set.spatial_freq.size(), 1, 1, 1, 1, 1, 1, 1, 1});
-            const auto w = xt::adapt<xt::layout_type::row_major>(set.temporal_freq, sz{1, 1, set.temporal_freq.size(), 1, 1, 1, 1, 1, 1, 1});
-            // param
-            const auto c0 = xt::adapt<xt::layout_type::row_major>(set.c0, sz{1, 1, 1, set.c0.size(), 1, 1, 1, 1, 1, 1});
-            const auto cf = xt::adapt<xt::layout_type::row_major>(set.cf, sz{1, 1, 1, 1, set.cf.size(), 1, 1, 1, 1, 1});
-            const auto cw = xt::adapt<xt::layout_type::row_major>(set.cw, sz{1, 1, 1, 1, 1, set.cw.size(), 1, 1, 1, 1});
-            const auto min_thresh = xt::adapt<xt::layout_type::row_major>(set.min_thresh, sz{1, 1, 1, 1, 1, 1, set.min_thresh.size(), 1, 1, 1});
-            const auto slope = xt::adapt<xt::layout_type::row_major>(set.slope, sz{1, 1, 1, 1, 1, 1, 1, set.slope.size(), 1, 1});
-            const auto lower = xt::adapt<xt::layout_type::row_major>(set.lower_asymptote, sz{1, 1, 1, 1, 1, 1, 1, 1, set.lower_asymptote.size(), 1});
-            const auto lapse = xt::adapt<xt::layout_type::row_major>(set.lapse_rate, sz{1, 1, 1, 1, 1, 1, 1, 1, 1, set.lapse_rate.size()});
-
-            const auto t = xt::maximum(min_thresh, c0 + cf * f + cw * w);
-            xt::xtensor<double, CSF::dim_param + CSF::dim_stim> p;
-            switch (settings.stim_scale)
-            {
-            case Scale::Linear:
-                p = 1 - lapse - (1 - lower - lapse) * xt::exp(-xt::pow(x / t, slope));
-                break;
-            case Scale::Log10:
-                p = 1 - lapse - (1 - lower - lapse) * xt::exp(-xt::pow(10, slope * (x - t)));
-                break;
-            case Scale::dB:
-                p = 1 - lapse - (1 - lower - lapse) * xt::exp(-xt::pow(10, slope * (x - t) * 0.05));
-                break;
-            }
-            // in this, we diverge from hoechenberger/questplus
-            // store 0/incorrect as 0th element, so that we can index using the response
-            return xt::stack(xt::xtuple(1.0 - p, p));
-        }
     };
 } // namespace psydapt::questplus
 
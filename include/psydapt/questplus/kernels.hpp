@@ -0,0 +1,492 @@
+#ifndef PSYDAPT_QUESTPLUS_KERNELS_HPP
+#define PSYDAPT_QUESTPLUS_KERNELS_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "../../config.hpp"
+
+#if defined(PSYDAPT_USE_BLAS)
+#include <cblas.h>
+#endif
+
+/** @file
+ * @brief Per-candidate expected-entropy kernels used by @ref psydapt::questplus::QuestPlusBase
+ *
+ * These work on the flattened likelihood table, which is row-major
+ * `(response, stimulus..., parameter...)`; i.e. the row for response `r` and
+ * flat stimulus index `s` starts at `(r * n_stim + s) * n_param`.
+ *
+ * With `PSYDAPT_RUNTIME_DISPATCH` (GCC/Clang, x86-64), @ref expected_entropy and
+ * @ref make_candidate_bounds are compiled for SSE2, AVX2 and AVX-512, and the
+ * entropy reduction uses a branch-free logarithm so that it vectorises. Results
+ * then agree with the default build to ~1e-15 relative, not bit for bit, and
+ * can differ in the last bits between machines.
+ *
+ * With `PSYDAPT_USE_BLAS`, @ref expected_entropy_blas scores every stimulus at
+ * once through CBLAS; QuestPlusBase uses it for exhaustive sweeps.
+ *
+ * A table can also be stored as 16- or 8-bit codes (@ref QuantizedTable); its
+ * @ref expected_entropy overload converts one block at a time back to double
+ * into a buffer that stays in L1, then runs the same per-block sums.
+ */
+namespace psydapt::questplus::detail
+{
+    /** @brief `sum(l * post)`: probability of the response that row `l` belongs to. */
+    PSYDAPT_CLONE_INLINE inline double response_probability(const double *l, const double *post, std::size_t n_param)
+    {
+        double pk = 0;
+        PSYDAPT_SIMD_SUM(pk)
+        for (std::size_t i = 0; i < n_param; i++)
+        {
+            pk += l[i] * post[i];
+        }
+        return pk;
+    }
+
+#if defined(PSYDAPT_DISPATCH)
+    /**
+     * @brief Natural log of a positive, finite, normal `x` without branches or calls.
+     *
+     * Splits `x = 2^e m` with `m` in `[sqrt(1/2), sqrt(2))`, then sums the series
+     * `log m = 2 atanh(s)`, `s = (m - 1) / (m + 1)`, up to `s^23` (|s| < 0.172).
+     * Max relative error is ~5e-16.
+     */
+    PSYDAPT_CLONE_INLINE inline double fast_log(double x) noexcept
+    {
+        constexpr std::uint64_t sqrt_half = 0x3fe6a09e667f3bcdULL;
+        // memcpy rather than a bit_cast builtin, which GCC only has from 11; both compile to a register move
+        std::uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        const std::uint64_t adj = bits + (0x3ff0000000000000ULL - sqrt_half);
+        const int e = static_cast<int>(adj >> 52) - 1023;
+        const std::uint64_t m_bits = (adj & 0x000fffffffffffffULL) + sqrt_half;
+        double m;
+        std::memcpy(&m, &m_bits, sizeof(m));
+        const double s = (m - 1) / (m + 1);
+        const double s2 = s * s;
+        double p = 1.0 / 23;
+        p = p * s2 + 1.0 / 21;
+        p = p * s2 + 1.0 / 19;
+        p = p * s2 + 1.0 / 17;
+        p = p * s2 + 1.0 / 15;
+        p = p * s2 + 1.0 / 13;
+        p = p * s2 + 1.0 / 11;
+        p = p * s2 + 1.0 / 9;
+        p = p * s2 + 1.0 / 7;
+        p = p * s2 + 1.0 / 5;
+        p = p * s2 + 1.0 / 3;
+        p = p * s2 + 1.0;
+        return static_cast<double>(e) * 0.6931471805599453 + 2 * s * p;
+    }
+#endif
+
+    /** @brief Entropy of the posterior `l * post / pk` (cells with zero mass contribute nothing). */
+    PSYDAPT_CLONE_INLINE inline double posterior_entropy(const double *l, const double *post, std::size_t n_param, double pk)
+    {
+        if (!(pk > 0))
+        {
+            return 0;
+        }
+        double h = 0;
+#if defined(PSYDAPT_DISPATCH)
+        // q = 0 gives 0 * log(DBL_MIN) = 0; the offset is far below any q that matters
+        const double inv = 1 / pk;
+        PSYDAPT_SIMD_SUM(h)
+        for (std::size_t i = 0; i < n_param; i++)
+        {
+            const double q = l[i] * post[i] * inv;
+            h -= q * fast_log(q + std::numeric_limits<double>::min());
+        }
+#else
+        for (std::size_t i = 0; i < n_param; i++)
+        {
+            const double q = l[i] * post[i] / pk;
+            if (q > 0)
+            {
+                h -= q * std::log(q);
+            }
+        }
+#endif
+        return h;
+    }
+
+    /**
+     * @brief Expected posterior entropy for flat stimulus index `s`.
+     *
+     * If given, `pk` and `H` (both `n_resp * n_stim`, row-major) receive the
+     * per-response probabilities and entropies for this stimulus.
+     */
+    PSYDAPT_TARGET_CLONES inline double expected_entropy(const double *likelihoods, const double *post,
+                                   std::size_t n_resp, std::size_t n_stim, std::size_t n_param,
+                                   std::size_t s, double *pk = nullptr, double *H = nullptr)
+    {
+        double eh = 0;
+        for (std::size_t r = 0; r < n_resp; r++)
+        {
+            const double *l = likelihoods + (r * n_stim + s) * n_param;
+            const double p = response_probability(l, post, n_param);
+            const double h = posterior_entropy(l, post, n_param, p);
+            if (pk)
+            {
+                pk[r * n_stim + s] = p;
+                H[r * n_stim + s] = h;
+            }
+            eh += p * h;
+        }
+        return eh;
+    }
+
+    /** @brief Longest block of a @ref QuantizedTable (the size of the kernels' stack buffer). */
+    constexpr std::size_t max_quantized_block = 1024;
+
+    /**
+     * @brief A likelihood table stored as `Code`s (`std::uint16_t` or `std::uint8_t`).
+     *
+     * Each row is split into blocks of `block` cells; a cell is stored as the nearest of
+     * the evenly spaced levels between its block's smallest and largest value, so the error
+     * is at most half a step. Exact zeros stay zero, and no other cell rounds to zero.
+     */
+    template <class Code>
+    struct QuantizedTable
+    {
+        std::size_t n_param = 0;    // cells per row
+        std::size_t block = 1;      // cells per block (the last one of each row may be short)
+        std::size_t n_blocks = 0;   // per row
+        std::vector<Code> codes;    // laid out like the double table
+        std::vector<double> offset; // (row, block): value of code 0
+        std::vector<double> step;   // (row, block): value between consecutive codes
+
+        /** @brief Write the values of block `b` of row `row` to `out`; returns the block's length. */
+        PSYDAPT_CLONE_INLINE std::size_t dequantize(std::size_t row, std::size_t b, double *out) const
+        {
+            const std::size_t lo = b * block;
+            const std::size_t n = std::min(block, n_param - lo);
+            const Code *c = codes.data() + row * n_param + lo;
+            const double o = offset[row * n_blocks + b];
+            const double st = step[row * n_blocks + b];
+            for (std::size_t i = 0; i < n; i++)
+            {
+                out[i] = o + st * static_cast<double>(c[i]);
+            }
+            return n;
+        }
+        /** @brief Cell `i` of row `row`. */
+        double at(std::size_t row, std::size_t i) const
+        {
+            const std::size_t b = i / block;
+            return offset[row * n_blocks + b] + step[row * n_blocks + b] * static_cast<double>(codes[row * n_param + i]);
+        }
+        /** @brief Write all of row `row` to `out` (`n_param` values). */
+        void dequantize_row(std::size_t row, double *out) const
+        {
+            for (std::size_t b = 0; b < n_blocks; b++)
+            {
+                dequantize(row, b, out + b * block);
+            }
+        }
+    };
+
+    /** @brief Quantise an `n_rows x n_param` table in blocks of `block` cells (clamped to @ref max_quantized_block). */
+    template <class Code>
+    QuantizedTable<Code> quantize(const double *table, std::size_t n_rows, std::size_t n_param, std::size_t block)
+    {
+        constexpr double levels = std::numeric_limits<Code>::max();
+        QuantizedTable<Code> out;
+        out.n_param = n_param;
+        out.block = std::clamp<std::size_t>(block, 1, max_quantized_block);
+        out.n_blocks = (n_param + out.block - 1) / out.block;
+        out.codes.resize(n_rows * n_param);
+        out.offset.resize(n_rows * out.n_blocks);
+        out.step.resize(n_rows * out.n_blocks);
+        for (std::size_t row = 0; row < n_rows; row++)
+        {
+            for (std::size_t b = 0; b < out.n_blocks; b++)
+            {
+                const std::size_t lo = row * n_param + b * out.block;
+                const std::size_t hi = row * n_param + std::min(n_param, (b + 1) * out.block);
+                const auto [mn, mx] = std::minmax_element(table + lo, table + hi);
+                const double o = *mn;
+                const double st = (*mx - *mn) / levels;
+                out.offset[row * out.n_blocks + b] = o;
+                out.step[row * out.n_blocks + b] = st;
+                for (std::size_t i = lo; i < hi; i++)
+                {
+                    double c = st > 0 ? std::clamp(std::round((table[i] - o) / st), 0.0, levels) : 0;
+                    if (table[i] > 0 && !(o + st * c > 0))
+                    {
+                        c = 1; // only when o == 0
+                    }
+                    out.codes[i] = static_cast<Code>(c);
+                }
+            }
+        }
+        return out;
+    }
+
+    /** @brief `sum(m)` and `sum(m log m)` over `m = l * post` (cells with zero mass contribute nothing to the latter). */
+    PSYDAPT_CLONE_INLINE inline void mass_and_entropy_sums(const double *l, const double *post, std::size_t n, double &pk, double &mlogm)
+    {
+        double a = 0, b = 0;
+#if defined(PSYDAPT_DISPATCH)
+        PSYDAPT_PRAGMA(omp simd reduction(+ : a, b))
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const double m = l[i] * post[i];
+            a += m;
+            b += m * fast_log(m + std::numeric_limits<double>::min());
+        }
+#else
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const double m = l[i] * post[i];
+            a += m;
+            b += m > 0 ? m * std::log(m) : 0;
+        }
+#endif
+        pk += a;
+        mlogm += b;
+    }
+
+    // each block is converted once, and scored in a single pass using
+    // H = -sum(q log q) with q = m / pk, i.e. H = log(pk) - sum(m log m) / pk
+    template <class Code>
+    PSYDAPT_CLONE_INLINE inline double quantized_expected_entropy(const QuantizedTable<Code> &table, const double *post,
+                                             std::size_t n_resp, std::size_t n_stim, std::size_t s,
+                                             double *pk, double *H)
+    {
+        double buf[max_quantized_block];
+        double eh = 0;
+        for (std::size_t r = 0; r < n_resp; r++)
+        {
+            const std::size_t row = r * n_stim + s;
+            double p = 0, mlogm = 0;
+            for (std::size_t b = 0; b < table.n_blocks; b++)
+            {
+                const std::size_t n = table.dequantize(row, b, buf);
+                mass_and_entropy_sums(buf, post + b * table.block, n, p, mlogm);
+            }
+            const double h = p > 0 ? std::max(0.0, std::log(p) - mlogm / p) : 0;
+            if (pk)
+            {
+                pk[row] = p;
+                H[row] = h;
+            }
+            eh += p * h;
+        }
+        return eh;
+    }
+
+    /** @brief @ref expected_entropy for a 16-bit @ref QuantizedTable. */
+    PSYDAPT_TARGET_CLONES inline double expected_entropy(const QuantizedTable<std::uint16_t> &table, const double *post,
+                                                         std::size_t n_resp, std::size_t n_stim, std::size_t s,
+                                                         double *pk = nullptr, double *H = nullptr)
+    {
+        return quantized_expected_entropy(table, post, n_resp, n_stim, s, pk, H);
+    }
+    /** @brief @ref expected_entropy for an 8-bit @ref QuantizedTable. */
+    PSYDAPT_TARGET_CLONES inline double expected_entropy(const QuantizedTable<std::uint8_t> &table, const double *post,
+                                                         std::size_t n_resp, std::size_t n_stim, std::size_t s,
+                                                         double *pk = nullptr, double *H = nullptr)
+    {
+        return quantized_expected_entropy(table, post, n_resp, n_stim, s, pk, H);
+    }
+
+#if defined(PSYDAPT_USE_BLAS)
+    /** @brief `l log l` for each entry of the likelihood table (`0` where `l` is `0`). */
+    inline std::vector<double> likelihood_log_likelihood(const double *likelihoods, std::size_t n)
+    {
+        std::vector<double> out(n);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const double l = likelihoods[i];
+            out[i] = l > 0 ? l * std::log(l) : 0;
+        }
+        return out;
+    }
+
+    /**
+     * @brief Expected posterior entropy of every stimulus, as dense matrix products.
+     *
+     * Treats the table as an `(n_resp * n_stim) x n_param` matrix `L`. Expanding
+     * `log(l * post / pk)` gives `pk = L post` and
+     * `H = log(pk) - (L (post log post) + (L log L) post) / pk`,
+     * so one DGEMM against `[post, post log post]` and one DGEMV against the
+     * precomputed `llogl` replace the per-cell logarithms. Each table is streamed
+     * once, by whatever tuned (and possibly multithreaded) kernels the BLAS has.
+     * Agrees with @ref expected_entropy to ~1e-14 relative.
+     *
+     * `pk` and `H` are `n_resp * n_stim`, `EH` is `n_stim`, and `work` needs
+     * `2 * (n_param + n_resp * n_stim)` doubles.
+     */
+    inline void expected_entropy_blas(const double *likelihoods, const double *llogl, const double *post,
+                                      std::size_t n_resp, std::size_t n_stim, std::size_t n_param,
+                                      double *pk, double *H, double *EH, double *work)
+    {
+        const std::size_t n_rows = n_resp * n_stim;
+        double *rhs = work;               // (n_param, 2): post, post log post
+        double *prod = work + 2 * n_param; // (n_rows, 2): L post, L (post log post)
+        for (std::size_t i = 0; i < n_param; i++)
+        {
+            const double q = post[i];
+            rhs[2 * i] = q;
+            rhs[2 * i + 1] = q > 0 ? q * std::log(q) : 0;
+        }
+        const auto rows = static_cast<int>(n_rows);
+        const auto cols = static_cast<int>(n_param);
+        cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, rows, 2, cols,
+                    1.0, likelihoods, cols, rhs, 2, 0.0, prod, 2);
+        for (std::size_t k = 0; k < n_rows; k++)
+        {
+            pk[k] = prod[2 * k];
+            H[k] = prod[2 * k + 1];
+        }
+        cblas_dgemv(CblasRowMajor, CblasNoTrans, rows, cols, 1.0, llogl, cols, post, 1, 1.0, H, 1);
+        for (std::size_t k = 0; k < n_rows; k++)
+        {
+            H[k] = pk[k] > 0 ? std::log(pk[k]) - H[k] / pk[k] : 0;
+        }
+        for (std::size_t s = 0; s < n_stim; s++)
+        {
+            double eh = 0;
+            for (std::size_t r = 0; r < n_resp; r++)
+            {
+                eh += pk[r * n_stim + s] * H[r * n_stim + s];
+            }
+            EH[s] = eh;
+        }
+    }
+#endif
+
+    /**
+     * @brief Per-block likelihood summaries for bounding the expected entropy.
+     *
+     * The parameter cells are split into contiguous blocks of the flattened
+     * posterior. For each stimulus and block we keep the smallest and largest
+     * likelihood of each response, and the smallest response entropy
+     * `h(s, θ) = -sum_r L log L`.
+     */
+    struct CandidateBounds
+    {
+        std::size_t block = 1;    // cells per block (the last one may be short)
+        std::size_t n_blocks = 0;
+        std::vector<double> lmin; // (n_resp, n_stim, n_blocks)
+        std::vector<double> lmax; // (n_resp, n_stim, n_blocks)
+        std::vector<double> hmin; // (n_stim, n_blocks)
+    };
+
+    /** @param block Cells per block; `0` picks `max(8, sqrt(n_param) / 8)`. */
+    PSYDAPT_TARGET_CLONES inline CandidateBounds make_candidate_bounds(const double *likelihoods, std::size_t n_resp,
+                                                                       std::size_t n_stim, std::size_t n_param,
+                                                                       std::size_t block = 0)
+    {
+        CandidateBounds out;
+        if (!block)
+        {
+            block = std::max<std::size_t>(8, static_cast<std::size_t>(std::sqrt(static_cast<double>(n_param)) / 8));
+        }
+        out.block = std::min(block, std::max<std::size_t>(n_param, 1));
+        out.n_blocks = (n_param + out.block - 1) / out.block;
+        const std::size_t nb = out.n_blocks;
+        out.lmin.assign(n_resp * n_stim * nb, std::numeric_limits<double>::infinity());
+        out.lmax.assign(n_resp * n_stim * nb, 0);
+        out.hmin.assign(n_stim * nb, std::numeric_limits<double>::infinity());
+        for (std::size_t s = 0; s < n_stim; s++)
+        {
+            for (std::size_t i = 0; i < n_param; i++)
+            {
+                const std::size_t b = i / out.block;
+                double h = 0;
+                for (std::size_t r = 0; r < n_resp; r++)
+                {
+                    const double l = likelihoods[(r * n_stim + s) * n_param + i];
+                    auto &lo = out.lmin[(r * n_stim + s) * nb + b];
+                    auto &hi = out.lmax[(r * n_stim + s) * nb + b];
+                    lo = std::min(lo, l);
+                    hi = std::max(hi, l);
+                    h -= l > 0 ? l * std::log(l) : 0;
+                }
+                auto &hm = out.hmin[s * nb + b];
+                hm = std::min(hm, h);
+            }
+        }
+        return out;
+    }
+
+    /** @brief Posterior mass in each block of @ref CandidateBounds. */
+    inline void block_mass(const double *post, std::size_t n_param, const CandidateBounds &bounds, double *mass)
+    {
+        std::fill(mass, mass + bounds.n_blocks, 0.0);
+        for (std::size_t i = 0; i < n_param; i++)
+        {
+            mass[i / bounds.block] += post[i];
+        }
+    }
+
+    /**
+     * @brief Lower bound on the expected entropy of stimulus `s`.
+     *
+     * Uses `EH(s) = H(post) - H(pk(s)) + sum_θ post(θ) h(s, θ)`, which holds whenever
+     * each stimulus' likelihoods sum to one over responses. The last term is bounded
+     * below by the block minima of `h`, and `H(pk)` above by maximising `-x log x`
+     * over the range each `pk_r` can take given the block likelihood ranges.
+     */
+    inline double expected_entropy_bound(const CandidateBounds &bounds, const double *mass, double h_post,
+                                         std::size_t n_resp, std::size_t n_stim, std::size_t s)
+    {
+        const std::size_t nb = bounds.n_blocks;
+        const double *hmin = bounds.hmin.data() + s * nb;
+        double cond = 0;
+        for (std::size_t b = 0; b < nb; b++)
+        {
+            cond += mass[b] * hmin[b];
+        }
+        constexpr double inv_e = 0.36787944117144233;
+        const auto phi = [](double x)
+        {
+            return x > 0 ? -x * std::log(x) : 0.0;
+        };
+        double h_pk = 0;
+        for (std::size_t r = 0; r < n_resp; r++)
+        {
+            const double *lmin = bounds.lmin.data() + (r * n_stim + s) * nb;
+            const double *lmax = bounds.lmax.data() + (r * n_stim + s) * nb;
+            double lo = 0, hi = 0;
+            for (std::size_t b = 0; b < nb; b++)
+            {
+                lo += mass[b] * lmin[b];
+                hi += mass[b] * lmax[b];
+            }
+            lo = std::clamp(lo, 0.0, 1.0);
+            hi = std::clamp(hi, 0.0, 1.0);
+            h_pk += lo <= inv_e && inv_e <= hi ? inv_e : std::max(phi(lo), phi(hi));
+        }
+        h_pk = std::min(h_pk, std::log(static_cast<double>(n_resp)));
+        return h_post - h_pk + cond;
+    }
+} // namespace psydapt::questplus::detail
+
+#endif
@@ -19,18 +19,20 @@ You should have received a copy of the GNU General Public License
 along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <array>
 #include <vector>
 #include <optional>
 #include <cmath>
+#include <functional>
 #include <stdexcept>
 
 #include "xtensor/xtensor.hpp"
 #include "xtensor/xadapt.hpp"
 #include "xtensor/xmath.hpp"
-#include "xtensor/xvectorize.hpp"
 
 #include "../../config.hpp"
 #include "../base.hpp"
+#include "../psychometric.hpp"
 #include "questplus.hpp"
 
 /** @file
@@ -38,15 +40,6 @@ along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
  */
 namespace psydapt::questplus
 {
-    namespace detail
-    {
-        template <typename T>
-        T norm_cdf(T x)
-        {
-            return std::erfc(-x * std::sqrt(0.5)) * 0.5;
-        }
-        static auto vec_norm_cdf = xt::vectorize(norm_cdf<double>);
-    } // namespace detail
     class NormCDF : public QuestPlusBase<NormCDF, 1, 4, 2>
     {
         typedef QuestPlusBase<NormCDF, 1, 4, 2> QPB;
@@ -57,6 +50,8 @@ namespace psydapt::questplus
         {
             Scale stim_scale = Scale::Linear;                         /// Scale of the stimulus.
             std::vector<double> intensity;                            /// Array of possible stimulus values.
+            std::function<bool(const std::array<double, 1> &)> stimulus_filter; /// Return `false` for stimuli that can't be presented (unset keeps all).
+            std::function<bool(const std::array<double, 4> &)> parameter_filter; /// Return `false` for impossible parameter combinations, in @ref parameter_domain order (unset keeps all).
             std::vector<double> location;                             /// Array of possible location parameter values.
             std::vector<double> scale{3.5};                           /// Array of possible scale parameter values.
             std::vector<double> lower_asymptote{0.01};                /// Array of possible lower asymptote parameter values.
@@ -71,6 +66,38 @@ namespace psydapt::questplus
             QPB::setup();
         }
 
+        /** @brief Parameter axes in posterior order: location, scale, lower asymptote, lapse rate. */
+        static std::array<std::vector<double>, 4> parameter_domain(const Params &params)
+        {
+            return {params.location, params.scale, params.lower_asymptote, params.lapse_rate};
+        }
+        /** @brief Priors matching @ref parameter_domain (unset means flat). */
+        static std::array<std::optional<std::vector<double>>, 4> parameter_priors(const Params &params)
+        {
+            return {params.location_prior, params.scale_prior, params.lower_asymptote_prior, params.lapse_rate_prior};
+        }
+        /** @brief Stimulus axes. */
+        static std::array<std::vector<double>, 1> stimulus_domain(const Params &params)
+        {
+            return {params.intensity};
+        }
+        /** @brief Memory and per-trial work for `params`, without building anything (see @ref Cost). */
+        static Cost estimate_cost(const Params &params)
+        {
+            return QPB::cost_of({params.intensity.size()},
+                                {params.location.size(), params.scale.size(), params.lower_asymptote.size(), params.lapse_rate.size()},
+                                params);
+        }
+        /** @brief Probability of a `1` response for one stimulus and one parameter vector. */
+        static double psychometric(const Params &params, const std::array<double, 1> &x, const std::array<double, 4> &theta)
+        {
+            if (params.stim_scale != Scale::Linear)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "Only 'Linear' stimulus scale is implemented for NormCDF.");
+            }
+            return psydapt::psychometric::norm_cdf(x[0], theta[0], theta[1], theta[2], theta[3]);
+        }
+
     protected:
         const Params settings;
 
@@ -79,6 +106,11 @@ namespace psydapt::questplus
             stimuli[0] = xt::adapt<xt::layout_type::row_major>(settings.intensity, {settings.intensity.size()});
         }
 
+        void make_params()
+        {
+            parameters = parameter_domain(settings);
+        }
+
         xt::xtensor<double, NormCDF::dim_param> generate_prior()
         {
             const auto loc_prior = prior_helper(settings.location, settings.location_prior, 0);
@@ -88,28 +120,6 @@ namespace psydapt::questplus
             xt::xtensor<double, NormCDF::dim_param> prior = loc_prior * scale_prior * lower_prior * lapse_prior;
             return prior / xt::sum(prior, xt::evaluation_strategy::immediate);
         }
-
-        xt::xtensor<double, NormCDF::dim_param + NormCDF::dim_stim + 1> generate_likelihoods()
-        {
-            using sz = std::array<std::size_t, NormCDF::dim_param + NormCDF::dim_stim>;
-            const auto x = xt::adapt<xt::layout_type::row_major>(settings.intensity, sz{settings.intensity.size(), 1, 1, 1, 1});
-            const auto loc = xt::adapt<xt::layout_type::row_major>(settings.location, sz{1, settings.location.size(), 1, 1, 1});
-            const auto scale = xt::adapt<xt::layout_type::row_major>(settings.scale, sz{1, 1, settings.scale.size(), 1, 1});
-            const auto lower = xt::adapt<xt::layout_type::row_major>(settings.lower_asymptote, sz{1, 1, 1, settings.lower_asymptote.size(), 1});
-            const auto lapse = xt::adapt<xt::layout_type::row_major>(settings.lapse_rate, sz{1, 1, 1, 1, settings.lapse_rate.size()});
-
-            xt::xtensor<double, NormCDF::dim_param + NormCDF::dim_stim> p;
-            switch (settings.stim_scale)
-            {
-            case Scale::Linear:
-                p = lower + (1 - lower - lapse) * detail::vec_norm_cdf((x - loc) / scale);
-                break;
-            default:
-                PSYDAPT_THROW(std::invalid_argument, "Only 'Linear' stimulus scale is implemented for NormCDF.");
-                break;
-            }
-            return xt::stack(xt::xtuple(1.0 - p, p));
-        }
     };
 } // namespace psydapt::questplus
 
@@ -0,0 +1,362 @@
+#ifndef PSYDAPT_QUESTPLUS_PARTICLE_HPP
+#define PSYDAPT_QUESTPLUS_PARTICLE_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../../config.hpp"
+#include "../base.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::questplus::ParticleFilter
+ */
+namespace psydapt::questplus
+{
+    struct ParticleParams
+    {
+        std::size_t n_particles = 2000; /// Number of particles.
+        double resample_threshold = 0.5; /// Resample when the effective sample size drops below this fraction.
+        double jitter = 0.1;            /// Rejuvenation bandwidth `h` (Liu-West shrinkage, 0 disables).
+        unsigned int random_seed = 1;   /// Seed for initialisation and resampling.
+    };
+
+    /**
+     * @brief Sequential Monte Carlo alternative to the dense QUEST+ posterior.
+     *
+     * Takes the same `Params` as `Model` (`Weibull`, `NormCDF`, `CSF`), but represents the
+     * posterior as weighted particles drawn from the prior over the parameter domain,
+     * and evaluates `Model::psychometric()` on the fly instead of storing a likelihood table.
+     * Memory is `O(n_particles)`; next() costs `O(n_particles * n_stimuli)`.
+     *
+     * Expected entropy uses the entropy of the reweighted particle weights, which
+     * tracks the posterior's differential entropy up to a constant while the particles
+     * are approximately prior draws.
+     *
+     * When the effective sample size falls below `resample_threshold`, particles are
+     * systematically resampled and rejuvenated with Liu-West kernel shrinkage, clipped
+     * to each parameter's domain. Single-valued parameters stay fixed.
+     */
+    template <class Model>
+    class ParticleFilter : public Base<ParticleFilter<Model>, Model::dim_stim>
+    {
+        friend Base<ParticleFilter, Model::dim_stim>;
+        static constexpr std::size_t DimStim = Model::dim_stim;
+        static constexpr std::size_t DimParam = Model::dim_param;
+
+    public:
+        using Params = typename Model::Params;
+        using stim_type = typename Base<ParticleFilter, DimStim>::stim_type;
+        using param_type = std::array<double, DimParam>;
+
+        ParticleFilter(const Params &params, const ParticleParams &particle_params = ParticleParams{})
+            : settings(params), pf_settings(particle_params), rng(particle_params.random_seed)
+        {
+            if (pf_settings.n_particles == 0)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "At least one particle is required.");
+            }
+            domain = Model::parameter_domain(settings);
+            const auto priors = Model::parameter_priors(settings);
+            std::array<std::discrete_distribution<std::size_t>, DimParam> prior_dists;
+            for (std::size_t a = 0; a < DimParam; a++)
+            {
+                if (domain[a].empty())
+                {
+                    PSYDAPT_THROW(std::invalid_argument, "Every parameter needs at least one value.");
+                }
+                if (priors[a] && priors[a]->size() != domain[a].size())
+                {
+                    PSYDAPT_THROW(std::invalid_argument, "The prior and parameter domain sizes must match.");
+                }
+                const std::vector<double> w = priors[a] ? *priors[a] : std::vector<double>(domain[a].size(), 1.0);
+                prior_dists[a] = std::discrete_distribution<std::size_t>(w.begin(), w.end());
+                const auto [lo, hi] = std::minmax_element(domain[a].begin(), domain[a].end());
+                bounds[a] = {*lo, *hi};
+            }
+            // draw grid points from the (separable) prior, then spread them uniformly over
+            // each point's cell so that particles are distinct; draws that fail the parameter
+            // filter are redrawn
+            std::uniform_real_distribution<double> unif(-0.5, 0.5);
+            particles.resize(pf_settings.n_particles);
+            for (auto &p : particles)
+            {
+                std::size_t attempts = 0;
+                do
+                {
+                    if (++attempts > 1000)
+                    {
+                        PSYDAPT_THROW(std::invalid_argument, "The parameter filter rejects almost every prior draw.");
+                    }
+                    for (std::size_t a = 0; a < DimParam; a++)
+                    {
+                        const auto &axis = domain[a];
+                        const std::size_t i = prior_dists[a](rng);
+                        double cell = 0;
+                        if (axis.size() > 1)
+                        {
+                            cell = i + 1 < axis.size() ? axis[i + 1] - axis[i] : axis[i] - axis[i - 1];
+                        }
+                        p[a] = std::clamp(axis[i] + unif(rng) * cell, bounds[a].first, bounds[a].second);
+                    }
+                } while (settings.parameter_filter && !settings.parameter_filter(p));
+            }
+            weights.assign(pf_settings.n_particles, 1.0 / static_cast<double>(pf_settings.n_particles));
+
+            const auto stim_axes = Model::stimulus_domain(settings);
+            std::size_t n_stim = 1;
+            for (const auto &axis : stim_axes)
+            {
+                n_stim *= axis.size();
+            }
+            candidates.reserve(n_stim);
+            for (std::size_t s = 0; s < n_stim; s++)
+            {
+                std::array<double, DimStim> x;
+                std::size_t rem = s;
+                for (std::size_t i = DimStim; i-- != 0;)
+                {
+                    x[i] = stim_axes[i][rem % stim_axes[i].size()];
+                    rem /= stim_axes[i].size();
+                }
+                if (!settings.stimulus_filter || settings.stimulus_filter(x))
+                {
+                    candidates.push_back(x);
+                }
+            }
+            if (candidates.empty())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "No stimulus passes the stimulus filter.");
+            }
+            EH.resize(candidates.size());
+            this->next_stimulus = to_stim(candidates[0]);
+            this->response_history.reserve(500);
+            this->stimulus_history.reserve(500);
+        }
+
+        stim_type next()
+        {
+            for (std::size_t s = 0; s < candidates.size(); s++)
+            {
+                // single pass: with q_i = w_i p_i / pk,  H = log(pk) - sum(w_i p_i log(w_i p_i)) / pk
+                double pk1 = 0, a1 = 0, pk0 = 0, a0 = 0;
+                for (std::size_t i = 0; i < particles.size(); i++)
+                {
+                    const double p = Model::psychometric(settings, candidates[s], particles[i]);
+                    const double m1 = weights[i] * p;
+                    const double m0 = weights[i] - m1;
+                    pk1 += m1;
+                    pk0 += m0;
+                    a1 += m1 > 0 ? m1 * std::log(m1) : 0;
+                    a0 += m0 > 0 ? m0 * std::log(m0) : 0;
+                }
+                const double h1 = pk1 > 0 ? std::log(pk1) - a1 / pk1 : 0;
+                const double h0 = pk0 > 0 ? std::log(pk0) - a0 / pk0 : 0;
+                EH[s] = pk1 * h1 + pk0 * h0;
+            }
+            const auto best = std::min_element(EH.begin(), EH.end()) - EH.begin();
+            this->next_stimulus = to_stim(candidates[best]);
+            return this->next_stimulus;
+        }
+
+        bool update(int response, std::optional<stim_type> stimulus = std::nullopt)
+        {
+            if (response < 0 || response > 1)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The response is outside the valid range.");
+            }
+            const stim_type stim = stimulus ? *stimulus : this->next_stimulus;
+            this->stimulus_history.push_back(stim);
+            this->response_history.push_back(response);
+
+            std::array<double, DimStim> x;
+            if constexpr (std::is_scalar_v<stim_type>)
+            {
+                x[0] = stim;
+            }
+            else
+            {
+                x = stim;
+            }
+            double total = 0;
+            for (std::size_t i = 0; i < particles.size(); i++)
+            {
+                const double p = Model::psychometric(settings, x, particles[i]);
+                weights[i] *= response ? p : 1 - p;
+                total += weights[i];
+            }
+            if (!(total > 0))
+            {
+                PSYDAPT_THROW(std::runtime_error, "All particle weights vanished.");
+            }
+            double sum_sq = 0;
+            for (auto &w : weights)
+            {
+                w /= total;
+                sum_sq += w * w;
+            }
+            if (1 / sum_sq < pf_settings.resample_threshold * static_cast<double>(particles.size()))
+            {
+                resample();
+            }
+            if (this->sink_wants_summary())
+            {
+                this->log_trial(stim, response, weight_entropy());
+            }
+            else
+            {
+                this->log_trial(stim, response);
+            }
+            return true;
+        }
+
+        /** @brief Posterior mean of each parameter. */
+        param_type mean() const
+        {
+            param_type out{};
+            for (std::size_t i = 0; i < particles.size(); i++)
+            {
+                for (std::size_t a = 0; a < DimParam; a++)
+                {
+                    out[a] += weights[i] * particles[i][a];
+                }
+            }
+            return out;
+        }
+        /** @brief Effective sample size of the current weights. */
+        double effective_sample_size() const
+        {
+            double sum_sq = 0;
+            for (const double w : weights)
+            {
+                sum_sq += w * w;
+            }
+            return 1 / sum_sq;
+        }
+        const std::vector<param_type> &get_particles() const { return particles; }
+        const std::vector<double> &get_weights() const { return weights; }
+
+    private:
+        const Params settings;
+        const ParticleParams pf_settings;
+        std::array<std::vector<double>, DimParam> domain;
+        std::array<std::pair<double, double>, DimParam> bounds;
+        std::vector<param_type> particles;
+        std::vector<double> weights;
+        std::vector<std::array<double, DimStim>> candidates;
+        std::vector<double> EH;
+        std::mt19937 rng;
+
+        static stim_type to_stim(const std::array<double, DimStim> &x)
+        {
+            if constexpr (std::is_scalar_v<stim_type>)
+            {
+                return x[0];
+            }
+            else
+            {
+                return x;
+            }
+        }
+
+        double weight_entropy() const
+        {
+            double h = 0;
+            for (const double w : weights)
+            {
+                h -= w > 0 ? w * std::log(w) : 0;
+            }
+            return h;
+        }
+
+        void resample()
+        {
+            const std::size_t n = particles.size();
+            // weighted moments before resampling, for the rejuvenation kernel
+            param_type m{}, var{};
+            for (std::size_t i = 0; i < n; i++)
+            {
+                for (std::size_t a = 0; a < DimParam; a++)
+                {
+                    m[a] += weights[i] * particles[i][a];
+                }
+            }
+            for (std::size_t i = 0; i < n; i++)
+            {
+                for (std::size_t a = 0; a < DimParam; a++)
+                {
+                    var[a] += weights[i] * (particles[i][a] - m[a]) * (particles[i][a] - m[a]);
+                }
+            }
+            // systematic resampling
+            std::vector<param_type> out(n);
+            const double step = 1.0 / static_cast<double>(n);
+            double u = std::uniform_real_distribution<double>(0, step)(rng);
+            double cum = weights[0];
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                while (u > cum && j + 1 < n)
+                {
+                    cum += weights[++j];
+                }
+                out[i] = particles[j];
+                u += step;
+            }
+            const double h = pf_settings.jitter;
+            if (h > 0)
+            {
+                const double shrink = std::sqrt(1 - h * h);
+                std::normal_distribution<double> norm(0, 1);
+                for (auto &p : out)
+                {
+                    param_type moved = p;
+                    for (std::size_t a = 0; a < DimParam; a++)
+                    {
+                        if (domain[a].size() < 2)
+                        {
+                            continue;
+                        }
+                        moved[a] = shrink * p[a] + (1 - shrink) * m[a] + h * std::sqrt(var[a]) * norm(rng);
+                        moved[a] = std::clamp(moved[a], bounds[a].first, bounds[a].second);
+                    }
+                    // a move into an excluded region keeps the resampled copy as is
+                    if (!settings.parameter_filter || settings.parameter_filter(moved))
+                    {
+                        p = moved;
+                    }
+                }
+            }
+            particles = std::move(out);
+            std::fill(weights.begin(), weights.end(), step);
+        }
+    };
+} // namespace psydapt::questplus
+
+#endif
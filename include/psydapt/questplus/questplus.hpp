@@ -20,11 +20,23 @@ along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <cstddef>
+#include <cmath>
+#include <chrono>
 #include <vector>
 #include <random>
 #include <array>
+#include <deque>
+#include <iterator>
 #include <tuple>
 #include <stdexcept>
+#include <optional>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <utility>
 
 #include "xtensor/xtensor.hpp"
 #include "xtensor/xadapt.hpp"
@@ -36,6 +48,10 @@ along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "../../config.hpp"
 #include "../base.hpp"
+#include "../compression.hpp"
+#include "../history.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "kernels.hpp"
 
 /** @file
  * @brief Class @ref psydapt::questplus::QuestPlusBase
@@ -62,15 +78,68 @@ namespace psydapt::questplus
             }
             return false;
         }
+
+        // sizes before, along and after `axis` of a row-major shape
+        template <class Shape>
+        std::array<std::size_t, 3> split_shape(const Shape &shape, std::size_t axis)
+        {
+            std::array<std::size_t, 3> out{1, shape[axis], 1};
+            for (std::size_t i = 0; i < axis; i++)
+            {
+                out[0] *= shape[i];
+            }
+            for (std::size_t i = axis + 1; i < shape.size(); i++)
+            {
+                out[2] *= shape[i];
+            }
+            return out;
+        }
+
+        // linear interpolation along the middle axis of an (outer, n, inner) row-major block;
+        // points beyond the old axis take the edge value
+        inline void interpolate_axis(const double *in, double *out, std::size_t outer, std::size_t inner,
+                                     const std::vector<double> &old_axis, const std::vector<double> &new_axis)
+        {
+            const std::size_t n_old = old_axis.size();
+            const std::size_t n_new = new_axis.size();
+            for (std::size_t j = 0; j < n_new; j++)
+            {
+                const double y = new_axis[j];
+                std::size_t lo = 0;
+                double w = 0;
+                if (y >= old_axis[n_old - 1])
+                {
+                    lo = n_old - 1;
+                }
+                else if (y > old_axis[0])
+                {
+                    lo = static_cast<std::size_t>(std::upper_bound(old_axis.begin(), old_axis.end(), y) - old_axis.begin()) - 1;
+                    w = (y - old_axis[lo]) / (old_axis[lo + 1] - old_axis[lo]);
+                }
+                const std::size_t hi = std::min(lo + 1, n_old - 1);
+                for (std::size_t o = 0; o < outer; o++)
+                {
+                    const double *a = in + (o * n_old + lo) * inner;
+                    const double *b = in + (o * n_old + hi) * inner;
+                    double *dst = out + (o * n_new + j) * inner;
+                    for (std::size_t k = 0; k < inner; k++)
+                    {
+                        dst[k] = (1 - w) * a[k] + w * b[k];
+                    }
+                }
+            }
+        }
     }
     /** @brief Stimulus selection method.
          *  
-         * `MinNEntropy` is currently ignored.
+         * `MinNEntropy` is currently ignored. `TwoStepEntropy` looks one trial further
+         * ahead (see @ref LookaheadParams).
          */
     enum class StimSelectionMethod
     {
         MinEntropy,
-        MinNEntropy
+        MinNEntropy,
+        TwoStepEntropy
     };
     /** @brief Parameter estimation method.
          * 
@@ -88,11 +157,175 @@ namespace psydapt::questplus
         unsigned int max_consecutive_reps = 2; /// Number of times stimulus will be presented (`MinNEntropy` only).
         unsigned int random_seed = 1;          /// Random seed used by `StimSelectionMethod`.
     };
+    struct HistoryParams
+    {
+        bool compact = false;       /// Store stimuli as grid indices and responses bit-packed (off-grid stimuli are snapped).
+        std::size_t capacity = 0;   /// If nonzero (and `compact`), keep only the most recent `capacity` trials.
+        std::size_t undo_depth = 0;  /// Updates that undo() reverts in O(posterior size); older ones are replayed. Costs every update() a pass over the row, so opt-in.
+    };
+    /** @brief Coarse-to-fine refinement of the parameter grid.
+     *
+     * Every `every` trials, each parameter axis with more than one value is
+     * re-spaced (keeping its length) over the central `mass` of its marginal
+     * posterior. The posterior is interpolated onto the new grid and the
+     * likelihood table regenerated, so a coarse grid ends up with fine spacing
+     * where it matters. Axes must be sorted in ascending order.
+     *
+     * Re-spacing an axis moves every one of its points, and every table cell depends
+     * on one of them, so the whole table (and the pruning bounds, if any) is rebuilt:
+     * a refinement costs about as much as construction, which is usually many times
+     * a next() sweep since each cell needs a model evaluation. It is spread over
+     * `construction_params.n_threads` like construction is. Only refinements that
+     * actually change an axis rebuild anything.
+     */
+    struct RefinementParams
+    {
+        unsigned int every = 0; /// Refine after every `every` trials (`0` disables refinement).
+        double mass = 0.99;     /// Marginal posterior mass kept inside each refined axis.
+        double min_width = 0.1; /// Refined axes never shrink below this fraction of their original span.
+    };
+    /** @brief Evaluate only a subset of candidate stimuli in next().
+     *
+     * Each trial scores `fraction` of the stimulus grid, drawn with the procedure's
+     * random generator, plus the `n_refine` best candidates from the previous trial
+     * and their immediate grid neighbours. The cost of next() scales with `fraction`,
+     * at the price of sometimes missing the exact minimum-entropy stimulus.
+     */
+    struct SubsampleParams
+    {
+        double fraction = 1;          /// Fraction of the stimulus grid scored per trial (`1` scores everything).
+        bool low_discrepancy = false; /// Use a golden-ratio sequence with a random start instead of uniform draws.
+        unsigned int n_refine = 3;    /// Best candidates carried over (with their neighbours) to the next trial.
+    };
+    /** @brief Branch-and-bound pruning of candidate stimuli in next().
+     *
+     * Before scoring candidates, next() computes a cheap lower bound on each one's
+     * expected entropy from per-block summaries of the likelihood table and the
+     * posterior mass in each block. Candidates are scored in order of their bound,
+     * stopping once no remaining bound can beat the best score so far. The chosen
+     * stimulus is the same as with an exhaustive sweep, but candidates that were
+     * never scored hold `+inf` in `get_expected_entropy()`, so it is opt-in.
+     */
+    struct PruningParams
+    {
+        bool enabled = false;       /// Skip candidates that provably can't be the minimum.
+        std::size_t block_size = 0; /// Posterior cells per block (`0` picks one); smaller is tighter but uses more memory.
+    };
+    /** @brief Two-step lookahead for `StimSelectionMethod::TwoStepEntropy`.
+     *
+     * After the usual one-step sweep, the `top_k` candidates with the lowest expected
+     * entropy are re-scored by the expected entropy after the best second trial: for
+     * each response to the first, the posterior that response would produce is formed
+     * once and every stimulus is scored against it (with pruning, if enabled). That is
+     * about `top_k * n_resp` extra sweeps per trial, so check it fits the inter-trial
+     * interval. The (candidate, response) pairs can be spread over threads; the choice
+     * doesn't depend on the thread count. The one-step sweep is exhaustive, so this can't
+     * be combined with a subsample fraction below 1 (the constructor throws) or with
+     * next(deadline) (which throws).
+     */
+    struct LookaheadParams
+    {
+        unsigned int top_k = 4;     /// First-step candidates looked ahead from.
+        unsigned int n_threads = 1; /// Threads scoring the second step (`0` for all cores).
+    };
+    /** @brief How the likelihood table is built (at setup and after each refinement).
+     *
+     * The table is filled one row of the first stimulus axis at a time, each row
+     * written straight into its place in the final table. With more than one
+     * thread the rows are shared out over a temporary thread pool; every row is
+     * computed by the same code either way, so the table is bitwise identical
+     * for any thread count.
+     */
+    struct ConstructionParams
+    {
+        unsigned int n_threads = 1; /// Threads used to build the likelihood table (`0` for all cores).
+        std::size_t max_bytes = 0;  /// Refuse to build if `estimate_cost().total_bytes()` exceeds this (`0` for no limit).
+    };
+    /** @brief How each likelihood is stored; see @ref StorageParams. */
+    enum class LikelihoodPrecision
+    {
+        Double,
+        UInt16,
+        UInt8
+    };
+    /** @brief Storage of the likelihood table.
+     *
+     * next() streams the whole table every trial, so its speed is bound by memory
+     * bandwidth on large grids. With `UInt16` or `UInt8`, each row of the table is cut
+     * into blocks of `block_size` cells and every cell is stored as a code between its
+     * block's smallest and largest value, taking a quarter or an eighth of the memory.
+     * The error per cell is at most `(max - min) / 131070` or `/ 510` of its block.
+     * next() converts a block at a time back to double just before scoring it, and
+     * update() and undo() a row at a time.
+     *
+     * Choices can differ from the double table only where two candidates' scores are
+     * within the quantisation error (they don't on the grids in the tests), and pruning
+     * bounds come from the double values, so pruned and exhaustive sweeps then agree only
+     * to the same tolerance. With `PSYDAPT_USE_BLAS`, quantised tables use the direct sweep.
+     * The double table is still built first, so the peak memory during construction
+     * doesn't shrink.
+     */
+    struct StorageParams
+    {
+        LikelihoodPrecision precision = LikelihoodPrecision::Double; /// Storage type of each likelihood.
+        std::size_t block_size = 256;                                /// Cells per scaling block (at most 1024).
+    };
+    /** @brief Resources a configuration needs, from the model's static `estimate_cost()`.
+     *
+     * Computed from the axis lengths alone, without allocating. Stimulus and parameter
+     * filters are ignored, so for filtered grids these are upper bounds. Operation counts
+     * treat each add, multiply, divide and log as one; next() assumes an exhaustive sweep
+     * of the (subsampled) candidates, which pruning only shortens.
+     */
+    struct Cost
+    {
+        std::size_t likelihood_bytes = 0; /// Likelihood table and pruning bounds (shared between copies).
+        std::size_t posterior_bytes = 0;  /// Posterior.
+        std::size_t scratch_bytes = 0;    /// Per-stimulus scores and search buffers used by next().
+        double next_flops = 0;            /// Operations per next().
+        double update_flops = 0;          /// Operations per update().
+
+        std::size_t total_bytes() const
+        {
+            const std::size_t a = likelihood_bytes + posterior_bytes;
+            const std::size_t b = a + scratch_bytes;
+            return a < likelihood_bytes || b < a ? std::numeric_limits<std::size_t>::max() : b;
+        }
+    };
+    /** @brief Stop once a marginal credible interval is narrow enough. */
+    struct CredibleIntervalRule
+    {
+        std::size_t parameter = 0; /// Parameter index, in the model's `parameter_domain()` order.
+        double width = 0;          /// Stop once the interval is at most this wide (in parameter units).
+        double mass = 0.95;        /// Central marginal posterior mass inside the interval.
+    };
+    /** @brief When update() reports that the procedure should stop.
+     *
+     * The procedure stops after `max_trials`, or (once `min_trials` have run) when
+     * the posterior entropy is at most `entropy`, or when every rule in
+     * `credible_intervals` is met. The entropy normally comes straight from the
+     * scores next() computed; marginals are accumulated while normalising the posterior.
+     */
+    struct StoppingParams
+    {
+        std::optional<double> entropy;                        /// Posterior entropy (nats) to stop at.
+        std::vector<CredibleIntervalRule> credible_intervals; /// All must be met to stop.
+        unsigned int max_trials = 0;                          /// Stop after this many trials (`0` for no limit).
+        unsigned int min_trials = 0;                          /// Never stop on the other criteria before this many trials.
+    };
     struct BaseParams
     {
         StimSelectionMethod stim_selection_method = StimSelectionMethod::MinEntropy; /// Method used to select next stimulus.
         ParamEstimationMethod param_estimation_method = ParamEstimationMethod::Mean; /// Method used to estimate parameters (ignored).
         MinNEntropyParams min_n_entropy_params;
+        HistoryParams history_params; /// Trial history storage.
+        RefinementParams refinement_params; /// Coarse-to-fine parameter grid refinement.
+        SubsampleParams subsample_params; /// Candidate subsampling in next().
+        PruningParams pruning_params; /// Exact candidate pruning in next().
+        ConstructionParams construction_params; /// Likelihood table construction.
+        StorageParams storage_params; /// Likelihood table storage.
+        LookaheadParams lookahead_params; /// `TwoStepEntropy` selection.
+        StoppingParams stopping_params; /// Stopping rules.
     };
     template <class T, std::size_t DimStim, std::size_t DimParam, std::size_t NResp = 2>
     class QuestPlusBase : public Base<QuestPlusBase<T, DimStim, DimParam, NResp>, DimStim>
@@ -100,176 +333,2092 @@ namespace psydapt::questplus
         friend Base<QuestPlusBase, DimStim>;
 
     public:
+        static constexpr std::size_t dim_stim = DimStim;
+        static constexpr std::size_t dim_param = DimParam;
+        static constexpr std::size_t n_resp = NResp;
+
         QuestPlusBase(unsigned int seed) : rng{seed} {}
         using stim_type = typename Base<QuestPlusBase, DimStim>::stim_type;
 
         stim_type next()
         {
-            // new_posterior = xt::eval(posterior * likelihoods);
-            // this way allows us to appeal to the fact that all latter dimensions
-            // match, so we can use the fast broadcasting
-            const auto shp = likelihoods.shape();
-            if constexpr (std::is_scalar_v<stim_type>)
+            resume();
+            const auto &settings = static_cast<T *>(this)->settings;
+            if (settings.subsample_params.fraction < 1)
+            {
+                next_subsampled(settings.subsample_params);
+            }
+            else
+            {
+                const bool two_step = settings.stim_selection_method == StimSelectionMethod::TwoStepEntropy;
+                std::size_t best = settings.pruning_params.enabled && !two_step ? pruned_argmin() : exhaustive_argmin();
+                if (two_step)
+                {
+                    best = two_step_argmin(settings.lookahead_params);
+                }
+                if (settings.stim_selection_method == StimSelectionMethod::MinEntropy || two_step)
+                {
+                    set_next_stimulus(best);
+                }
+                else if (settings.stim_selection_method == StimSelectionMethod::MinNEntropy)
+                {
+                }
+                previous_best.assign(1, best);
+            }
+            complete = true;
+            scores_current = true;
+            return this->next_stimulus;
+        }
+        /**
+         * @brief next(), but return by `deadline` with the best candidate scored so far.
+         *
+         * Candidates are scored in priority order: the previous trial's best few (see
+         * `subsample_params.n_refine`) and their grid neighbours first, then the rest
+         * best-first by a cheap key. With pruning the key is the candidate's lower bound;
+         * otherwise it is its expected entropy against `max(32, sqrt(n))` of the `n` posterior
+         * cells, drawn evenly by mass, so stimuli that are informative where the posterior
+         * mass is come first. Keys are computed coarse-to-fine over the grid, so a pass cut
+         * short still covers all of it.
+         *
+         * At least one candidate, and about one candidate's worth of keys, are always
+         * computed. After that the clock is checked between keys and between candidates; the
+         * only other work is one pass over the posterior and a heap build over the keys, both
+         * far cheaper than scoring a candidate. So the overrun is about two candidates' cost.
+         * `subsample_params.fraction` is ignored. There's no anytime version of the two-step
+         * lookahead, so this throws with `StimSelectionMethod::TwoStepEntropy`.
+         *
+         * If @ref sweep_complete() is true afterwards, the stimulus is the one next() would
+         * have chosen; otherwise it's the best among the candidates scored (the rest hold
+         * `+inf` in @ref get_expected_entropy()).
+         */
+        stim_type next(std::chrono::steady_clock::time_point deadline)
+        {
+            if (static_cast<T *>(this)->settings.stim_selection_method == StimSelectionMethod::TwoStepEntropy)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "next(deadline) can't run a TwoStepEntropy lookahead.");
+            }
+            resume();
+            set_next_stimulus(anytime_argmin(deadline));
+            scores_current = true;
+            return this->next_stimulus;
+        }
+        /** @brief Whether the last next() scored or (by pruning) ruled out every candidate; false after a subsampled one. */
+        bool sweep_complete() const
+        {
+            return complete;
+        }
+        bool update(int response, std::optional<stim_type> stimulus = std::nullopt)
+        {
+            if (response < 0 || static_cast<std::size_t>(response) >= n_resp)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The response is outside the valid range.");
+            }
+            resume();
+            const auto &settings = static_cast<T *>(this)->settings;
+            const auto &stopping = settings.stopping_params;
+            const stim_type last_stim = stimulus ? *stimulus : this->next_stimulus;
+            const auto idx = nearest_index(last_stim);
+            const std::size_t row = table_row(idx);
+            push_history(idx, last_stim, response);
+            // multiply in the likelihood row for this response and stimulus
+            const std::size_t n_stim = EH.size();
+            const std::size_t n_param = posterior.size();
+            const std::size_t lrow = static_cast<std::size_t>(response) * n_stim + row;
+            const double *l = likelihood_row(lrow);
+            double *post = posterior.data();
+            const std::size_t undo_depth = settings.history_params.undo_depth;
+            if (undo_depth)
             {
-                for (std::size_t i = 0; i < shp[0]; i++)
+                // dividing `l` back out can't recover the cells it zeroes, so keep those
+                if (undo_log.size() == undo_depth)
+                {
+                    undo_log.pop_front();
+                }
+                UndoRecord rec{lrow, last_stim, this->should_continue, 0, {}, {}};
+                for (std::size_t i = 0; i < n_param; i++)
                 {
-                    for (std::size_t j = 0; j < shp[1]; j++)
+                    if (!(l[i] > 0))
                     {
-                        xt::noalias(xt::view(new_posterior, i, j)) = xt::view(likelihoods, i, j) * posterior;
+                        rec.cells.push_back(i);
+                        rec.values.push_back(post[i]);
                     }
                 }
+                undo_log.push_back(std::move(rec));
+            }
+            double total = 0;
+            for (std::size_t i = 0; i < n_param; i++)
+            {
+                post[i] *= l[i];
+                total += post[i];
+            }
+            if (undo_depth)
+            {
+                undo_log.back().total = total;
+            }
+            // if next() scored this stimulus against the current posterior, it already has the
+            // entropy of the result (same products, same sum); otherwise fold it into normalisation
+            std::optional<double> entropy;
+            const bool want_entropy = stopping.entropy || this->sink_wants_summary();
+            if (want_entropy && scores_current && EH.data()[row] < std::numeric_limits<double>::infinity())
+            {
+                entropy = H.data()[lrow];
+            }
+            const double h = normalise(total, want_entropy && !entropy);
+            if (want_entropy && !entropy)
+            {
+                entropy = h;
+            }
+            scores_current = false;
+            if (this->sink_wants_summary())
+            {
+                this->log_trial(last_stim, response, entropy);
             }
             else
             {
-                std::array<std::size_t, DimStim + 1> upper;
-                std::array<std::size_t, DimStim + 1> idx{0};
-                upper[0] = shp[0];
-                for (std::size_t i = 0; i < DimStim; i++)
+                this->log_trial(last_stim, response);
+            }
+
+            const bool stop = stopping_rules_met(entropy);
+            const auto &refinement = settings.refinement_params;
+            if (refinement.every && this->trial_index % refinement.every == 0)
+            {
+                refine();
+            }
+            this->should_continue = !stop;
+            return this->should_continue;
+        }
+
+        /**
+         * @brief Apply many trials at once, e.g. to rebuild a session from archived data.
+         *
+         * Gives the same posterior as calling update() for each trial in turn (up to
+         * rounding), but multiplies in each distinct (stimulus, response) pair once, raised
+         * to its count, in the log domain, and normalises once. The cost is
+         * O(distinct pairs * posterior size) rather than O(trials * posterior size).
+         * Grid refinement still happens after the same trials as with update().
+         *
+         * Like the other procedures' update_many(), this stops at the first trial after
+         * which the procedure should stop, and later trials are not applied. `max_trials`
+         * is met exactly. The entropy and credible-interval rules need a posterior, which
+         * the batch only forms at the end of each group of trials up to a refinement (or
+         * at the end, without refinement), so they are checked there.
+         *
+         * Every applied trial is added to the history and sent to the trial sink (only the
+         * last one with a posterior entropy). Batched trials can't be undone by division, so
+         * undo() replays the history for them. Nothing changes if any response or stimulus
+         * is invalid, or if the trials rule out every parameter value (which throws).
+         *
+         * @return Whether to continue the procedure.
+         */
+        bool update_many(const std::vector<int> &responses, const std::vector<stim_type> &stimuli_in)
+        {
+            if (responses.size() != stimuli_in.size())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "There must be one stimulus per response.");
+            }
+            if (responses.empty())
+            {
+                return this->should_continue;
+            }
+            resume();
+            const auto &settings = static_cast<T *>(this)->settings;
+            const std::size_t n_stim = EH.size();
+            const std::size_t n_param = posterior.size();
+            // check everything before touching any state
+            std::vector<std::size_t> lrows(responses.size());
+            std::vector<std::array<std::size_t, DimStim>> idxs(responses.size());
+            for (std::size_t t = 0; t < responses.size(); t++)
+            {
+                if (responses[t] < 0 || static_cast<std::size_t>(responses[t]) >= n_resp)
                 {
-                    upper[i + 1] = shp[i + 1];
+                    PSYDAPT_THROW(std::invalid_argument, "The response is outside the valid range.");
                 }
-                do
-                {
-                    auto tmp_posterior = std::apply([&np = this->new_posterior](auto &&...xs)
-                                                    { return xt::view(np, xs...); },
-                                                    idx);
-                    auto tmp_likelihood = std::apply([&lk = this->likelihoods](auto &&...xs)
-                                                     { return xt::view(lk, xs...); },
-                                                     idx);
-                    xt::noalias(tmp_posterior) = tmp_likelihood * posterior;
-                } while (detail::increment<DimStim + 1>(idx, upper));
+                idxs[t] = nearest_index(stimuli_in[t]);
+                lrows[t] = static_cast<std::size_t>(responses[t]) * n_stim + table_row(idxs[t]);
             }
-            std::array<std::size_t, DimParam> param_idx;
-            std::iota(param_idx.begin(), param_idx.end(), 1 + DimStim);
-            pk = xt::sum(new_posterior, param_idx, xt::evaluation_strategy::immediate);
-            const auto pkt = xt::transpose(pk);
-            auto postt = xt::transpose(new_posterior);
-            xt::noalias(postt) = postt / pkt;
-            // xt::transpose(new_posterior) /= xt::transpose(pk);
 
-            // entropy
-            H = -xt::nansum(new_posterior * xt::log(new_posterior), param_idx, xt::evaluation_strategy::immediate);
-            // expected entropies for stimuli
-            EH = xt::sum(pk * H, 0, xt::evaluation_strategy::immediate);
-            // TODO: just do min_entropy by default until figure out retrieving settings
-            // find index of minimum entropy, then figure out which stimuli are there
-            const auto settings = static_cast<T *>(this)->settings;
-            if (settings.stim_selection_method == StimSelectionMethod::MinEntropy)
+            const auto &stopping = settings.stopping_params;
+            const auto every = settings.refinement_params.every;
+            const std::size_t first_index = static_cast<std::size_t>(this->trial_index);
+            // update() stops after the trial that reaches max_trials (or the next one, if already past)
+            std::size_t n_trials = responses.size();
+            if (stopping.max_trials)
             {
-
-                if constexpr (std::is_scalar_v<stim_type>)
+                n_trials = std::min(n_trials, first_index < stopping.max_trials ? stopping.max_trials - first_index : 1);
+            }
+            const bool want_entropy = stopping.entropy || this->sink_wants_summary();
+            // the sink only hears of the trials once they have all been applied
+            auto held_sink = std::move(this->sink);
+            // a group after a refinement can still throw, so keep what to roll back to
+            std::optional<QuestPlusBase> backup;
+            if (every && every - first_index % every < n_trials)
+            {
+                backup.emplace(*this);
+            }
+            std::optional<double> entropy;
+            bool stop = false;
+            std::vector<std::size_t> group;
+            std::vector<double> log_post(n_param);
+            std::size_t t0 = 0;
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            try
+            {
+#endif
+                while (t0 < n_trials && !stop)
                 {
-                    this->next_stimulus = stimuli[0][xt::argmin(EH)];
+                    // trials up to the next refinement, which must see the grid of its own time
+                    std::size_t t1 = n_trials;
+                    if (every)
+                    {
+                        const std::size_t done = static_cast<std::size_t>(this->trial_index);
+                        t1 = std::min(n_trials, t0 + every - done % every);
+                    }
+                    group.assign(lrows.begin() + static_cast<std::ptrdiff_t>(t0), lrows.begin() + static_cast<std::ptrdiff_t>(t1));
+                    std::sort(group.begin(), group.end());
+                    double *post = posterior.data();
+                    for (std::size_t i = 0; i < n_param; i++)
+                    {
+                        log_post[i] = post[i] > 0 ? std::log(post[i]) : -std::numeric_limits<double>::infinity();
+                    }
+                    for (std::size_t g = 0; g < group.size();)
+                    {
+                        const std::size_t lrow = group[g];
+                        std::size_t count = 0;
+                        while (g < group.size() && group[g] == lrow)
+                        {
+                            count++;
+                            g++;
+                        }
+                        const double c = static_cast<double>(count);
+                        const double *l = likelihood_row(lrow);
+                        for (std::size_t i = 0; i < n_param; i++)
+                        {
+                            log_post[i] += l[i] > 0 ? c * std::log(l[i]) : -std::numeric_limits<double>::infinity();
+                        }
+                    }
+                    const double top = *std::max_element(log_post.begin(), log_post.end());
+                    if (!(top > -std::numeric_limits<double>::infinity()))
+                    {
+                        PSYDAPT_THROW(std::runtime_error, "The trials rule out every parameter value.");
+                    }
+                    undo_log.clear();
+                    scores_current = false;
+                    double total = 0;
+                    for (std::size_t i = 0; i < n_param; i++)
+                    {
+                        post[i] = std::exp(log_post[i] - top);
+                        total += post[i];
+                    }
+                    const double h = normalise(total, want_entropy);
+                    if (want_entropy)
+                    {
+                        entropy = h;
+                    }
+                    for (std::size_t t = t0; t < t1; t++)
+                    {
+                        push_history(idxs[t], stimuli_in[t], responses[t]);
+                        this->log_trial(stimuli_in[t], responses[t]);
+                    }
+                    stop = stopping_rules_met(entropy);
+                    if (every && this->trial_index % every == 0)
+                    {
+                        refine();
+                    }
+                    t0 = t1;
                 }
-                else
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            }
+            catch (...)
+            {
+                if (backup)
                 {
-                    auto indices = xt::unravel_index(xt::argmin(EH)(), EH.shape(), xt::layout_type::row_major);
-                    for (std::size_t i = 0; i < DimStim; i++)
+                    // hand the backup this object's buffers first, so cached data() pointers stay valid
+                    const auto keep = [](auto &mine, auto &saved)
+                    {
+                        std::copy(saved.begin(), saved.end(), mine.begin());
+                        std::swap(mine, saved);
+                    };
+                    keep(posterior, backup->posterior);
+                    keep(pk, backup->pk);
+                    keep(H, backup->H);
+                    keep(EH, backup->EH);
+                    static_cast<QuestPlusBase &>(*this) = std::move(*backup);
+                }
+                this->sink = std::move(held_sink);
+                throw;
+            }
+#endif
+            this->sink = std::move(held_sink);
+            if (this->sink)
+            {
+                this->trial_index = first_index;
+                for (std::size_t t = 0; t < t0; t++)
+                {
+                    if (t + 1 == t0 && this->sink_wants_summary())
                     {
-                        this->next_stimulus[i] = stimuli[i][indices[i]];
+                        this->log_trial(stimuli_in[t], responses[t], entropy);
+                    }
+                    else
+                    {
+                        this->log_trial(stimuli_in[t], responses[t]);
                     }
                 }
             }
-            else if (settings.stim_selection_method == StimSelectionMethod::MinNEntropy)
+            this->should_continue = !stop;
+            return this->should_continue;
+        }
+
+        /** @brief Number of trials in the (possibly bounded) history. */
+        std::size_t history_size() const
+        {
+            return compact_history ? compact_history->size() : this->response_history.size();
+        }
+        /** @brief Stimulus of trial `i` (0 is the oldest retained trial), decoded if the history is compact. */
+        stim_type stimulus_at(std::size_t i) const
+        {
+            return compact_history ? decode_stimulus((*compact_history)[i].stimulus) : this->stimulus_history[i];
+        }
+        /** @brief Response of trial `i` (0 is the oldest retained trial). */
+        int response_at(std::size_t i) const
+        {
+            return compact_history ? (*compact_history)[i].response : this->response_history[i];
+        }
+        /** @brief One trial of the history, with its stimulus decoded. */
+        struct Trial
+        {
+            stim_type stimulus; /// Stimulus used (snapped to the grid if the history is compact).
+            int response;       /// Participant response.
+        };
+
+        /** @brief Forward range over the retained trials, oldest first, in either history mode (see @ref trials). */
+        class TrialRange
+        {
+        public:
+            class const_iterator
+            {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = Trial;
+                using difference_type = std::ptrdiff_t;
+                using pointer = void;
+                using reference = Trial;
+
+                const_iterator(const QuestPlusBase *q, std::size_t i) : qp(q), idx(i) {}
+                Trial operator*() const { return {qp->stimulus_at(idx), qp->response_at(idx)}; }
+                const_iterator &operator++()
+                {
+                    idx++;
+                    return *this;
+                }
+                const_iterator operator++(int)
+                {
+                    auto tmp = *this;
+                    idx++;
+                    return tmp;
+                }
+                bool operator==(const const_iterator &o) const { return idx == o.idx && qp == o.qp; }
+                bool operator!=(const const_iterator &o) const { return !(*this == o); }
+
+            private:
+                const QuestPlusBase *qp;
+                std::size_t idx;
+            };
+
+            explicit TrialRange(const QuestPlusBase *q) : qp(q) {}
+            const_iterator begin() const { return {qp, 0}; }
+            const_iterator end() const { return {qp, qp->history_size()}; }
+            std::size_t size() const { return qp->history_size(); }
+
+        private:
+            const QuestPlusBase *qp;
+        };
+
+        /** @brief The retained trials as (stimulus, response) pairs, decoding a compact history on the fly. */
+        TrialRange trials() const
+        {
+            return TrialRange{this};
+        }
+
+        /**
+         * @brief Responses so far, oldest first.
+         *
+         * A compact history has no vector to hand out, so this throws then; use @ref trials
+         * or @ref response_at, which work in both modes.
+         */
+        const std::vector<int> &get_response_history() const
+        {
+            if (compact_history)
             {
+                PSYDAPT_THROW(std::runtime_error, "The history is compact; read it through trials() or response_at().");
             }
-            return this->next_stimulus;
+            return this->response_history;
         }
-        bool update(int response, std::optional<stim_type> stimulus = std::nullopt)
+        /** @brief Stimuli so far, oldest first; throws for a compact history, like @ref get_response_history. */
+        const std::vector<stim_type> &get_stimulus_history() const
         {
-            if (response < 0 || static_cast<std::size_t>(response) >= n_resp)
+            if (compact_history)
             {
-                PSYDAPT_THROW(std::invalid_argument, "The response is outside the valid range.");
+                PSYDAPT_THROW(std::runtime_error, "The history is compact; read it through trials() or stimulus_at().");
             }
-            this->stimulus_history.push_back(stimulus ? *stimulus : this->next_stimulus);
-            this->response_history.push_back(response);
-            // find nearest matching response
-            xt::xtensor<double, DimParam + DimStim> likelihood2 = xt::view(likelihoods, response, xt::all());
-            const auto last_stim = this->stimulus_history.back();
+            return this->stimulus_history;
+        }
 
-            xt::xtensor<double, DimParam> likelihood;
+        /** @brief Map grid indices (as stored in a compact history) back to a stimulus. */
+        stim_type decode_stimulus(const typename CompactHistory<DimStim>::stim_index &idx) const
+        {
             if constexpr (std::is_scalar_v<stim_type>)
             {
-                // find index of nearest stimulus input, and take a view from there
-                std::size_t idx = xt::argmin(xt::abs(stimuli[0] - last_stim))[0];
-                likelihood = xt::view(likelihood2, idx, xt::all());
+                return stimuli[0][idx[0]];
             }
             else
             {
-                // need to loop over all of DimStim/whatever the stim length is,
-                // taking progressively more views
-                std::array<std::size_t, DimStim> idx;
+                stim_type out;
                 for (std::size_t i = 0; i < DimStim; i++)
                 {
-                    idx[i] = xt::argmin(xt::abs(stimuli[i] - last_stim[i]))[0];
+                    out[i] = stimuli[i][idx[i]];
                 }
-                likelihood = std::apply([&likelihood2](auto &&...xs)
-                                        { return xt::view(likelihood2, xs...); },
-                                        idx);
+                return out;
             }
-            xt::noalias(posterior) = posterior * likelihood;
-            xt::noalias(posterior) = posterior / xt::sum(posterior, xt::evaluation_strategy::immediate);
+        }
 
-            return true; // unconditionally continue for now
+        /**
+         * @brief Revert the most recent update(); call again to go further back.
+         *
+         * The last `history_params.undo_depth` updates (none by default) are reverted in
+         * O(posterior size) by dividing their likelihood back out (cells it zeroed are
+         * restored from a copy kept by update()). Older trials are reverted by replaying the
+         * rest of the history from the prior, which needs the full history (a compact
+         * history must not have wrapped).
+         * Neither works across a grid refinement.
+         *
+         * The next update() without an explicit stimulus reuses the undone trial's stimulus,
+         * so a mis-keyed response is fixed with `undo()` then `update(correct_response)`.
+         * A trial sink keeps the undone record; the correction is logged with the same trial index.
+         */
+        void undo()
+        {
+            const std::size_t n_hist = history_size();
+            if (!n_hist)
+            {
+                PSYDAPT_THROW(std::runtime_error, "There is no trial to undo.");
+            }
+            resume();
+            const std::size_t n_param = posterior.size();
+            stim_type stim = stimulus_at(n_hist - 1);
+            bool cont = true;
+            if (!undo_log.empty())
+            {
+                const auto &rec = undo_log.back();
+                const double *l = likelihood_row(rec.lrow);
+                double *post = posterior.data();
+                for (std::size_t i = 0; i < n_param; i++)
+                {
+                    post[i] = l[i] > 0 ? post[i] * rec.total / l[i] : 0;
+                }
+                for (std::size_t k = 0; k < rec.cells.size(); k++)
+                {
+                    post[rec.cells[k]] = rec.values[k];
+                }
+                stim = rec.stimulus;
+                cont = rec.should_continue;
+                undo_log.pop_back();
+            }
+            else
+            {
+                if (refined || n_hist != this->trial_index)
+                {
+                    PSYDAPT_THROW(std::runtime_error, "This trial is older than undo_depth, and can't be replayed after a refinement or with a wrapped history.");
+                }
+                // in place, so the storage behind get_posterior() stays put
+                const auto prior = generate_prior();
+                std::copy(prior.begin(), prior.end(), posterior.begin());
+                double *post = posterior.data();
+                const std::size_t n_stim = EH.size();
+                for (std::size_t t = 0; t + 1 < n_hist; t++)
+                {
+                    const std::size_t lrow = static_cast<std::size_t>(response_at(t)) * n_stim +
+                                             table_row(nearest_index(stimulus_at(t)));
+                    const double *l = likelihood_row(lrow);
+                    double total = 0;
+                    for (std::size_t i = 0; i < n_param; i++)
+                    {
+                        post[i] *= l[i];
+                        total += post[i];
+                    }
+                    for (std::size_t i = 0; i < n_param; i++)
+                    {
+                        post[i] /= total;
+                    }
+                }
+            }
+            if (compact_history)
+            {
+                compact_history->pop_back();
+            }
+            else
+            {
+                this->stimulus_history.pop_back();
+                this->response_history.pop_back();
+            }
+            this->trial_index--;
+            this->next_stimulus = stim;
+            this->should_continue = cont;
+            scores_current = false;
         }
 
-    protected:
-        // derived classes must tell us how to calc prior & likelihood
-        xt::xtensor<double, DimParam> generate_prior()
+        /**
+         * @brief Free the scratch buffers and compress the posterior while the procedure is idle.
+         *
+         * The posterior is kept as a @ref CompressedArray and the per-candidate scores and
+         * search buffers are released. resume(), which next(), update() and refine() call
+         * automatically, restores the posterior bit for bit, so suspending doesn't change the
+         * trial sequence. While suspended, the live-state accessors return empty tensors.
+         *
+         * @param threshold If positive, posterior cells below it are dropped (zeroed, with the
+         * rest renormalised) before compressing, which helps once most of the grid is ruled
+         * out. This is lossy: a dropped cell stays at zero for the rest of the session.
+         */
+        void suspend(double threshold = 0)
         {
-            return static_cast<T *>(this)->generate_prior();
+            if (suspended_posterior)
+            {
+                return;
+            }
+            double *post = posterior.data();
+            const std::size_t n_param = posterior.size();
+            if (threshold > 0)
+            {
+                double kept = 0;
+                for (std::size_t i = 0; i < n_param; i++)
+                {
+                    kept += post[i] < threshold ? 0 : post[i];
+                }
+                if (!(kept > 0))
+                {
+                    PSYDAPT_THROW(std::invalid_argument, "The threshold would drop the whole posterior.");
+                }
+                for (std::size_t i = 0; i < n_param; i++)
+                {
+                    post[i] = post[i] < threshold ? 0 : post[i] / kept;
+                }
+            }
+            std::copy(posterior.shape().begin(), posterior.shape().end(), posterior_shape.begin());
+            suspended_posterior.emplace(post, n_param);
+            posterior = xt::xtensor<double, DimParam>();
+            release_scratch();
         }
-        // +1 for response dimension
-        xt::xtensor<double, DimParam + DimStim + 1> generate_likelihoods()
+        /** @brief Undo suspend(), and allocate scratch buffers if they were released (e.g. in a fork). */
+        void resume()
         {
-            return static_cast<T *>(this)->generate_likelihoods();
+            if (suspended_posterior)
+            {
+                posterior = xt::xtensor<double, DimParam>::from_shape(posterior_shape);
+                suspended_posterior->decompress(posterior.data());
+                suspended_posterior.reset();
+            }
+            if (!scratch_ready)
+            {
+                make_scratch();
+            }
         }
-        void make_stimuli()
+        /** @brief Whether the procedure is suspended. */
+        bool suspended() const
         {
-            return static_cast<T *>(this)->make_stimuli();
+            return suspended_posterior.has_value();
         }
-        static constexpr std::size_t dim_stim = DimStim;
-        static constexpr std::size_t dim_param = DimParam;
-        static constexpr std::size_t n_resp = NResp;
-        xt::xtensor<double, DimParam> posterior;
-        xt::xtensor<double, DimParam + DimStim + 1> likelihoods;
-        std::array<xt::xtensor<double, 1>, DimStim> stimuli;
-        xt::xtensor<double, DimParam + DimStim + 1> new_posterior;
-        xt::xtensor<double, 1 + DimStim> pk;
-        xt::xtensor<double, 1 + DimStim> H;
-        xt::xtensor<double, DimStim> EH;
-        std::mt19937 rng; // for 'min_n_entropy'
 
-        void setup()
+        /**
+         * @brief Independent copy of this procedure for what-if analysis or lookahead.
+         *
+         * The likelihood table and pruning bounds are shared (plain copies share them
+         * too; refine() gives a procedure its own new tables instead of modifying
+         * shared ones). The fork copies the posterior, histories, random state and
+         * settings, and allocates its scratch buffers on its first next(), so forking
+         * costs about the size of the posterior. It has no trial sink.
+         */
+        T fork() const
         {
-            // everything else for init, post-assigning settings
-            posterior = generate_prior();
-            likelihoods = generate_likelihoods();
-            new_posterior = xt::xtensor<double, DimParam + DimStim + 1>::from_shape(likelihoods.shape());
-            make_stimuli();
-            // TODO: pick something smarter, once we incorporate termination conditions
-            this->response_history.reserve(500);
-            this->stimulus_history.reserve(500);
-            //
+            T out(*static_cast<const T *>(this));
+            QuestPlusBase &base = out;
+            base.release_scratch();
+            base.sink = nullptr;
+            return out;
         }
 
-        xt::xtensor<double, DimParam> prior_helper(const std::vector<double> &param,
-                                                   const std::optional<std::vector<double>> &prior = std::nullopt,
-                                                   const std::size_t index = 0)
+        /**
+         * @brief Re-grid the parameter axes around the posterior mass (see @ref RefinementParams).
+         *
+         * Called automatically when `refinement_params.every` is set.
+         * @return Whether any axis changed.
+         */
+        bool refine()
         {
-            const auto param_size = param.size();
-            std::array<std::size_t, DimParam> prior_shape;
-            prior_shape.fill(1);
-            prior_shape[index] = param_size;
-            xt::xtensor<double, DimParam> out_prior;
-            if (prior)
+            resume();
+            const auto &refinement = static_cast<T *>(this)->settings.refinement_params;
+            const double tail = 0.5 * (1 - refinement.mass);
+            bool changed = false;
+            for (std::size_t a = 0; a < DimParam; a++)
             {
-                auto &tp = *prior;
-                if (tp.size() != param_size)
+                auto &axis = parameters[a];
+                const std::size_t n = axis.size();
+                if (n < 2 || !std::is_sorted(axis.begin(), axis.end()))
+                {
+                    continue;
+                }
+                const auto dims = detail::split_shape(posterior.shape(), a);
+                const std::size_t outer = dims[0], inner = dims[2];
+                // marginal posterior along this axis
+                std::vector<double> cdf(n, 0.0);
+                const double *post = posterior.data();
+                for (std::size_t o = 0; o < outer; o++)
+                {
+                    for (std::size_t j = 0; j < n; j++)
+                    {
+                        const double *row = post + (o * n + j) * inner;
+                        cdf[j] += std::accumulate(row, row + inner, 0.0);
+                    }
+                }
+                std::partial_sum(cdf.begin(), cdf.end(), cdf.begin());
+                const double total = cdf.back();
+                const std::size_t lo = std::lower_bound(cdf.begin(), cdf.end(), tail * total) - cdf.begin();
+                const std::size_t hi = std::min<std::size_t>(
+                    std::lower_bound(cdf.begin(), cdf.end(), (1 - tail) * total) - cdf.begin(), n - 1);
+                // keep one cell of margin; if the mass runs up against the edge of the
+                // current grid, reach back out towards the original domain instead
+                const double span = axis[n - 1] - axis[0];
+                double new_lo = lo == 0 ? axis[0] - 0.5 * span : axis[lo - 1];
+                double new_hi = hi == n - 1 ? axis[n - 1] + 0.5 * span : axis[hi + 1];
+                new_lo = std::max(new_lo, original_bounds[a].first);
+                new_hi = std::min(new_hi, original_bounds[a].second);
+                const double min_span = refinement.min_width * (original_bounds[a].second - original_bounds[a].first);
+                if (new_hi - new_lo < min_span)
+                {
+                    const double mid = 0.5 * (new_lo + new_hi);
+                    new_lo = std::max(mid - 0.5 * min_span, original_bounds[a].first);
+                    new_hi = std::min(new_lo + min_span, original_bounds[a].second);
+                    new_lo = new_hi - min_span;
+                }
+                std::vector<double> new_axis(n);
+                for (std::size_t j = 0; j < n; j++)
+                {
+                    new_axis[j] = new_lo + (new_hi - new_lo) * static_cast<double>(j) / static_cast<double>(n - 1);
+                }
+                if (new_axis == axis)
                 {
-                    PSYDAPT_THROW(std::invalid_argument, "The prior and parameter domain sizes must match.");
+                    continue;
                 }
-                out_prior = xt::adapt<xt::layout_type::row_major>(tp, prior_shape);
+                // interpolated into a copy, then written back so the storage behind get_posterior() stays put
+                std::vector<double> old_post(posterior.begin(), posterior.end());
+                detail::interpolate_axis(old_post.data(), posterior.data(), outer, inner, axis, new_axis);
+                axis = std::move(new_axis);
+                changed = true;
+            }
+            if (changed)
+            {
+                const double total = std::accumulate(posterior.begin(), posterior.end(), 0.0);
+                std::transform(posterior.begin(), posterior.end(), posterior.begin(), [total](double v)
+                               { return v / total; });
+                parameter_coords = parameters;
+                make_tables();
+                scores_current = false;
+                refined = true;
+                undo_log.clear();
+            }
+            return changed;
+        }
+
+        /** @brief Current parameter axes, in posterior dimension order (these move if refinement is on). */
+        const std::array<std::vector<double>, DimParam> &get_parameters() const
+        {
+            return parameters;
+        }
+        /**
+         * @name Live state
+         *
+         * References to the procedure's own tensors, so bindings can expose them
+         * (`data()`, `shape()`, `strides()`) without copying. The references stay valid for
+         * the procedure's lifetime. next(), update(), update_many(), undo() and refine()
+         * overwrite the tensors in place, so a cached `data()` pointer sees the new values.
+         * Only suspend() (which empties the tensors) and the resume() after it (which
+         * allocates them again) move the storage, as does assigning to the procedure;
+         * re-read `data()` after those.
+         * With a stimulus or parameter filter the filtered dimensions are collapsed
+         * into the first stimulus/parameter axis (see @ref parameter_cell).
+         */
+        ///@{
+        /** @brief Posterior over the parameter grid, normalised to sum to one. */
+        const xt::xtensor<double, DimParam> &get_posterior() const
+        {
+            return posterior;
+        }
+        /** @brief Expected posterior entropy of each candidate from the last next();
+         * candidates that were pruned or not sampled hold `+inf`. */
+        const xt::xtensor<double, DimStim> &get_expected_entropy() const
+        {
+            return EH;
+        }
+        /** @brief Probability of each (response, candidate) from the last next(), for scored candidates. */
+        const xt::xtensor<double, 1 + DimStim> &get_response_probability() const
+        {
+            return pk;
+        }
+        /** @brief Posterior entropy after each (response, candidate) from the last next(), for scored candidates. */
+        const xt::xtensor<double, 1 + DimStim> &get_response_entropy() const
+        {
+            return H;
+        }
+        /** @brief Compact trial history (raw grid indices), if `history_params.compact` was set; @ref trials decodes it. */
+        const std::optional<CompactHistory<DimStim>> &get_compact_history() const
+        {
+            return compact_history;
+        }
+        ///@}
+
+        /** @brief Parameter values of flat posterior cell `i` (cells skip anything a parameter filter removed). */
+        std::array<double, DimParam> parameter_cell(std::size_t i) const
+        {
+            std::array<double, DimParam> out;
+            if (valid_parameters)
+            {
+                for (std::size_t a = 0; a < DimParam; a++)
+                {
+                    out[a] = parameter_coords[a][i];
+                }
+                return out;
+            }
+            for (std::size_t a = DimParam; a-- != 0;)
+            {
+                out[a] = parameter_coords[a][i % parameter_coords[a].size()];
+                i /= parameter_coords[a].size();
+            }
+            return out;
+        }
+
+    protected:
+        // derived classes must tell us how to calc prior & likelihood
+        xt::xtensor<double, DimParam> generate_prior()
+        {
+            return static_cast<T *>(this)->generate_prior();
+        }
+        /**
+         * Build the `(response, stim..., param...)` likelihood table, one slab per index
+         * of the first stimulus axis (see @ref likelihood_slab). Slabs are disjoint, so they
+         * can be filled on several threads without changing a single bit of the result.
+         */
+        xt::xtensor<double, DimParam + DimStim + 1> generate_likelihoods()
+        {
+            std::array<std::size_t, DimParam + DimStim + 1> shape;
+            shape[0] = NResp;
+            for (std::size_t i = 0; i < DimStim; i++)
+            {
+                shape[1 + i] = stimulus_axis_shape<DimStim + DimParam>(i)[i];
+            }
+            for (std::size_t a = 0; a < DimParam; a++)
+            {
+                shape[1 + DimStim + a] = parameter_axis_shape<DimStim + DimParam>(a)[DimStim + a];
+            }
+            auto out = xt::xtensor<double, DimParam + DimStim + 1>::from_shape(shape);
+            std::copy(shape.begin() + 1, shape.end(), slab_shape.begin());
+            slab_shape[0] = 1;
+            const std::size_t n_rows = shape[1];
+            slab_size = out.size() / (NResp * n_rows);
+            const std::size_t resp_stride = n_rows * slab_size;
+            double *data = out.data();
+            const auto fill = [this, data, resp_stride](std::size_t s)
+            {
+                static_cast<T *>(this)->likelihood_slab(s, data + s * slab_size, resp_stride);
+            };
+            const unsigned int n_threads = static_cast<T *>(this)->settings.construction_params.n_threads;
+            if (n_threads == 1 || n_rows == 1)
+            {
+                for (std::size_t s = 0; s < n_rows; s++)
+                {
+                    fill(s);
+                }
+            }
+            else
+            {
+                // the calling thread works too
+                parallel::ThreadPool pool{n_threads == 0 ? 0 : n_threads - 1};
+                pool.parallel_for(n_rows, fill);
+            }
+            return out;
+        }
+        /**
+         * Write the rows of the likelihood table for index `s` of the first stimulus
+         * axis, response `r` at `out + r * resp_stride`, in the layout of @ref slab_view.
+         * Each cell is the derived class's static `psychometric(settings, x, theta)`, so
+         * the table and psychometric() can't disagree. A derived class with more than two
+         * responses (or a faster closed form) shadows this with its own `likelihood_slab`.
+         */
+        void likelihood_slab(std::size_t s, double *out, std::size_t resp_stride)
+        {
+            static_assert(NResp == 2, "Models with more than two responses must provide their own likelihood_slab.");
+            const auto &settings = static_cast<T *>(this)->settings;
+            // stimulus cells in the slab run row-major over stimulus axes 1...; parameter cells inside each
+            std::size_t n_stim = 1;
+            for (std::size_t i = 1; i < DimStim; i++)
+            {
+                n_stim *= slab_shape[i];
+            }
+            const std::size_t n_param = slab_size / n_stim;
+            std::array<double, DimStim> x;
+            std::array<double, DimParam> theta;
+            for (std::size_t c = 0; c < n_stim; c++)
+            {
+                std::size_t rem = c;
+                for (std::size_t i = DimStim; i-- != 0;)
+                {
+                    // with a stimulus filter every coordinate runs along the first axis
+                    const bool along_first = valid_stimuli || i == 0;
+                    x[i] = stimulus_coords[i][along_first ? s : rem % slab_shape[i]];
+                    if (!along_first)
+                    {
+                        rem /= slab_shape[i];
+                    }
+                }
+                // in this, we diverge from hoechenberger/questplus
+                // store 0/incorrect as 0th element, so that we can index using the response
+                double *q = out + c * n_param;
+                double *p = q + resp_stride;
+                std::array<std::size_t, DimParam> idx{};
+                for (std::size_t j = 0; j < n_param; j++)
+                {
+                    // `parameter_coords`, which refinement may move and a filter may thin out
+                    for (std::size_t a = 0; a < DimParam; a++)
+                    {
+                        theta[a] = parameter_coords[a][valid_parameters ? j : idx[a]];
+                    }
+                    p[j] = T::psychometric(settings, x, theta);
+                    q[j] = 1.0 - p[j];
+                    for (std::size_t a = DimParam; a-- != 0 && ++idx[a] == parameter_coords[a].size();)
+                    {
+                        idx[a] = 0;
+                    }
+                }
+            }
+        }
+        void make_stimuli()
+        {
+            return static_cast<T *>(this)->make_stimuli();
+        }
+        void make_params()
+        {
+            return static_cast<T *>(this)->make_params();
+        }
+        xt::xtensor<double, DimParam> posterior;
+        /** Immutable once built, so copies and forks share them; refine() builds new ones. */
+        struct Tables
+        {
+            xt::xtensor<double, DimParam + DimStim + 1> likelihoods; // +1 for response dimension
+            detail::CandidateBounds bounds;                          // for candidate pruning, if enabled
+            LikelihoodPrecision precision = LikelihoodPrecision::Double; // `likelihoods` is empty unless Double
+            detail::QuantizedTable<std::uint16_t> likelihoods16;
+            detail::QuantizedTable<std::uint8_t> likelihoods8;
+#if defined(PSYDAPT_USE_BLAS)
+            std::vector<double> llogl; // likelihoods * log(likelihoods), for detail::expected_entropy_blas
+#endif
+        };
+        std::shared_ptr<const Tables> tables;
+        std::array<xt::xtensor<double, 1>, DimStim> stimuli;
+        std::array<std::vector<double>, DimStim> stimulus_coords; // per-row stimulus values of the likelihood table
+        std::optional<std::vector<std::size_t>> valid_stimuli;   // grid index of each table row, if filtered
+        std::vector<std::size_t> stimulus_row;                   // table row of each grid index, if filtered
+        std::array<std::vector<double>, DimParam> parameters; // likelihoods are generated from these, not the settings
+        std::array<std::vector<double>, DimParam> parameter_coords; // per-cell parameter values of the posterior
+        std::optional<std::vector<std::size_t>> valid_parameters;  // dense grid index of each posterior cell, if filtered
+        std::array<std::pair<double, double>, DimParam> original_bounds;
+        xt::xtensor<double, 1 + DimStim> pk;
+        xt::xtensor<double, 1 + DimStim> H;
+        xt::xtensor<double, DimStim> EH;
+        std::mt19937 rng; // for 'min_n_entropy' and candidate subsampling
+        // candidate pruning state
+        std::vector<double> block_mass;
+        std::vector<double> lower_bounds;
+        std::vector<std::size_t> bound_order;
+        std::optional<CompactHistory<DimStim>> compact_history; // replaces the Base vectors if requested
+        bool scores_current = false;                            // pk/H/EH were computed from the current posterior
+        std::vector<std::vector<double>> marginals;             // one per credible-interval rule
+        std::array<std::size_t, DimParam> parameter_strides;    // of the dense parameter grid
+        std::array<std::size_t, DimStim> stimulus_shape;        // of the likelihood table's stimulus axes
+        std::array<std::size_t, DimStim + DimParam> slab_shape; // one row of the first stimulus axis (see slab_view)
+        std::size_t slab_size = 0;                              // elements in `slab_shape`
+        std::vector<double> row_buffer;                         // a quantised likelihood row, as doubles
+        std::shared_ptr<parallel::ThreadPool> lookahead_pool;   // TwoStepEntropy workers (copies share it)
+        // per-thread buffers for one second-step sweep
+        struct LookaheadScratch
+        {
+            std::vector<double> row;        // a quantised likelihood row, as doubles
+            std::vector<double> post;       // posterior after the first response
+            std::vector<double> mass;       // as block_mass, with pruning
+            std::vector<double> bounds;     // as lower_bounds, with pruning
+            std::vector<std::size_t> order; // as bound_order, with pruning
+        };
+        std::vector<LookaheadScratch> lookahead_scratch; // one per thread scoring the second step
+        std::vector<std::size_t> lookahead_order;        // stimuli by one-step expected entropy
+        std::vector<double> lookahead_value;             // per (candidate, first response): pk * best second-step EH
+#if defined(PSYDAPT_USE_BLAS)
+        std::vector<double> blas_work; // for detail::expected_entropy_blas
+#endif
+        bool scratch_ready = false;                             // pk/H/EH and the search buffers are allocated
+        // undo() state: enough to divide each recent update back out
+        struct UndoRecord
+        {
+            std::size_t lrow;               // likelihood row that was multiplied in
+            stim_type stimulus;             // as presented
+            bool should_continue;           // before the update
+            double total = 0;               // normaliser of the update
+            std::vector<std::size_t> cells; // cells where the likelihood was zero...
+            std::vector<double> values;     // ...and their posterior before the update
+        };
+        std::deque<UndoRecord> undo_log;
+        bool refined = false; // the grid has moved since setup, so the history can't be replayed
+        // suspend() state
+        std::optional<CompressedArray> suspended_posterior;
+        std::array<std::size_t, DimParam> posterior_shape;
+
+        void push_history(const std::array<std::size_t, DimStim> &idx, const stim_type &stim, int response)
+        {
+            if (compact_history)
+            {
+                typename CompactHistory<DimStim>::stim_index cidx;
+                std::copy(idx.begin(), idx.end(), cidx.begin());
+                compact_history->push_back(cidx, response);
+            }
+            else
+            {
+                this->stimulus_history.push_back(stim);
+                this->response_history.push_back(response);
+            }
+        }
+
+        // divide the posterior by `total`, accumulating the marginals for any credible-interval
+        // rules on the way; returns the posterior entropy if `with_entropy` (otherwise 0)
+        double normalise(double total, bool with_entropy)
+        {
+            const auto &stopping = static_cast<T *>(this)->settings.stopping_params;
+            const bool marginal_pass = !stopping.credible_intervals.empty();
+            for (auto &m : marginals)
+            {
+                std::fill(m.begin(), m.end(), 0.0);
+            }
+            double *post = posterior.data();
+            double h = 0;
+            for (std::size_t i = 0; i < posterior.size(); i++)
+            {
+                const double q = post[i] / total;
+                post[i] = q;
+                if (with_entropy)
+                {
+                    h -= q > 0 ? q * std::log(q) : 0;
+                }
+                if (marginal_pass)
+                {
+                    const std::size_t g = valid_parameters ? (*valid_parameters)[i] : i;
+                    for (std::size_t k = 0; k < marginals.size(); k++)
+                    {
+                        const std::size_t a = stopping.credible_intervals[k].parameter;
+                        marginals[k][(g / parameter_strides[a]) % parameters[a].size()] += q;
+                    }
+                }
+            }
+            return h;
+        }
+
+        // stopping rules after `trial_index` trials, given the posterior entropy (needed if
+        // `stopping_params.entropy` is set) and freshly accumulated marginals
+        bool stopping_rules_met(const std::optional<double> &entropy) const
+        {
+            const auto &stopping = static_cast<const T *>(this)->settings.stopping_params;
+            const auto n = this->trial_index;
+            bool stop = stopping.max_trials && n >= stopping.max_trials;
+            if (n >= stopping.min_trials)
+            {
+                stop = stop || (stopping.entropy && *entropy <= *stopping.entropy);
+                if (!marginals.empty())
+                {
+                    bool narrow = true;
+                    for (std::size_t k = 0; k < marginals.size() && narrow; k++)
+                    {
+                        narrow = credible_width(k) <= stopping.credible_intervals[k].width;
+                    }
+                    stop = stop || narrow;
+                }
+            }
+            return stop;
+        }
+
+        // allocate pk/H/EH and the candidate search buffers; nothing is scored yet
+        void make_scratch()
+        {
+            std::array<std::size_t, 1 + DimStim> resp_shape;
+            resp_shape[0] = NResp;
+            std::copy(stimulus_shape.begin(), stimulus_shape.end(), resp_shape.begin() + 1);
+            pk = xt::xtensor<double, 1 + DimStim>::from_shape(resp_shape);
+            H = xt::xtensor<double, 1 + DimStim>::from_shape(resp_shape);
+            EH = xt::xtensor<double, DimStim>::from_shape(stimulus_shape);
+            std::fill(EH.begin(), EH.end(), std::numeric_limits<double>::infinity());
+            const auto &settings = static_cast<T *>(this)->settings;
+            if (settings.pruning_params.enabled)
+            {
+                block_mass.resize(tables->bounds.n_blocks);
+                lower_bounds.resize(EH.size());
+                bound_order.resize(EH.size());
+            }
+            is_candidate.assign(candidate_order.size(), 0);
+            if (settings.stim_selection_method == StimSelectionMethod::TwoStepEntropy)
+            {
+                lookahead_order.resize(EH.size());
+                lookahead_value.resize(std::min<std::size_t>(std::max(settings.lookahead_params.top_k, 1u), EH.size()) * NResp);
+                lookahead_scratch.resize(lookahead_threads(settings.lookahead_params));
+                for (auto &ls : lookahead_scratch)
+                {
+                    ls.row.resize(posterior.size());
+                    ls.post.resize(posterior.size());
+                    if (settings.pruning_params.enabled)
+                    {
+                        ls.mass.resize(tables->bounds.n_blocks);
+                        ls.bounds.resize(EH.size());
+                        ls.order.resize(EH.size());
+                    }
+                }
+            }
+#if defined(PSYDAPT_USE_BLAS)
+            if (tables->precision == LikelihoodPrecision::Double)
+            {
+                blas_work.resize(2 * (posterior.size() + pk.size()));
+            }
+#endif
+            scratch_ready = true;
+        }
+        void release_scratch()
+        {
+            pk = xt::xtensor<double, 1 + DimStim>();
+            H = xt::xtensor<double, 1 + DimStim>();
+            EH = xt::xtensor<double, DimStim>();
+            std::vector<double>().swap(block_mass);
+            std::vector<double>().swap(lower_bounds);
+            std::vector<std::size_t>().swap(bound_order);
+            std::vector<std::size_t>().swap(candidates);
+            std::vector<unsigned char>().swap(is_candidate);
+            std::vector<std::size_t>().swap(coarse_order);
+            std::vector<std::size_t>().swap(focus_cells);
+            std::vector<double>().swap(focus_mass);
+            std::vector<double>().swap(row_buffer);
+            lookahead_pool.reset();
+            std::vector<LookaheadScratch>().swap(lookahead_scratch);
+            std::vector<std::size_t>().swap(lookahead_order);
+            std::vector<double>().swap(lookahead_value);
+#if defined(PSYDAPT_USE_BLAS)
+            std::vector<double>().swap(blas_work);
+#endif
+            scratch_ready = false;
+            scores_current = false;
+        }
+
+        // width of the central credible interval for rule `k`, from its accumulated marginal
+        double credible_width(std::size_t k) const
+        {
+            const auto &rule = static_cast<const T *>(this)->settings.stopping_params.credible_intervals[k];
+            const auto &axis = parameters[rule.parameter];
+            const auto &m = marginals[k];
+            const double tail = 0.5 * (1 - rule.mass);
+            double cdf = 0;
+            std::size_t lo = m.size(), hi = m.size() - 1;
+            for (std::size_t j = 0; j < m.size(); j++)
+            {
+                cdf += m[j];
+                if (lo == m.size() && cdf >= tail)
+                {
+                    lo = j;
+                }
+                if (cdf >= 1 - tail)
+                {
+                    hi = j;
+                    break;
+                }
+            }
+            return std::abs(axis[hi] - axis[std::min(lo, hi)]);
+        }
+
+        // candidate subsampling state
+        std::vector<std::size_t> candidate_order; // partially shuffled flat stimulus indices
+        std::vector<std::size_t> candidates;      // this trial's flat stimulus indices
+        std::vector<std::size_t> previous_best;   // best candidates of the last trial
+        std::vector<unsigned char> is_candidate;
+        std::vector<std::size_t> coarse_order;    // next(deadline): a bit-reversed sweep of the grid
+        std::vector<std::size_t> focus_cells;     // next(deadline) without pruning: cells drawn from the posterior...
+        std::vector<double> focus_mass;           // ...and their share of the draws
+        bool complete = true;                     // see sweep_complete()
+
+        stim_type next_subsampled(const SubsampleParams &sub)
+        {
+            const std::size_t n_stim = EH.size();
+            const std::size_t m = std::clamp<std::size_t>(
+                static_cast<std::size_t>(std::ceil(sub.fraction * static_cast<double>(n_stim))), 1, n_stim);
+            if (candidate_order.size() != n_stim)
+            {
+                candidate_order.resize(n_stim);
+                std::iota(candidate_order.begin(), candidate_order.end(), 0);
+                is_candidate.assign(n_stim, 0);
+            }
+            candidates.clear();
+            auto add = [this](std::size_t s)
+            {
+                if (!is_candidate[s])
+                {
+                    is_candidate[s] = 1;
+                    candidates.push_back(s);
+                }
+            };
+            if (sub.low_discrepancy)
+            {
+                // additive recurrence; gaps between points take at most three distinct sizes
+                constexpr double step = 0.6180339887498949;
+                double u = std::uniform_real_distribution<double>(0, 1)(rng);
+                for (std::size_t k = 0; k < m; k++)
+                {
+                    add(std::min(static_cast<std::size_t>(u * static_cast<double>(n_stim)), n_stim - 1));
+                    u += step;
+                    u -= u >= 1 ? 1 : 0;
+                }
+            }
+            else
+            {
+                // partial Fisher-Yates: the first m entries become a uniform sample without replacement
+                for (std::size_t k = 0; k < m; k++)
+                {
+                    std::uniform_int_distribution<std::size_t> pick(k, n_stim - 1);
+                    std::swap(candidate_order[k], candidate_order[pick(rng)]);
+                    add(candidate_order[k]);
+                }
+            }
+            // local refinement around the previous trial's winners
+            for (const std::size_t best : previous_best)
+            {
+                add(best);
+                for_each_neighbour(best, add);
+            }
+
+            std::fill(EH.begin(), EH.end(), std::numeric_limits<double>::infinity());
+            for (const std::size_t s : candidates)
+            {
+                EH.data()[s] = score(s);
+                is_candidate[s] = 0;
+            }
+            // ties go to the lower index, as with the exhaustive argmin
+            const auto better = [this](std::size_t a, std::size_t b)
+            {
+                return EH.data()[a] < EH.data()[b] || (EH.data()[a] == EH.data()[b] && a < b);
+            };
+            const std::size_t n_keep = std::min<std::size_t>(std::max(sub.n_refine, 1u), candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + n_keep, candidates.end(), better);
+            previous_best.assign(candidates.begin(), candidates.begin() + std::min<std::size_t>(sub.n_refine, n_keep));
+
+            set_next_stimulus(candidates[0]);
+            complete = false;
+            return this->next_stimulus;
+        }
+
+        // call `f` on each immediate grid neighbour of table row `s` (with a stimulus filter the
+        // table has a single stimulus axis, so neighbours are adjacent valid stimuli)
+        template <class F>
+        void for_each_neighbour(std::size_t s, F &&f) const
+        {
+            const auto shp = EH.shape();
+            std::size_t stride = 1;
+            for (std::size_t i = DimStim; i-- != 0;)
+            {
+                const std::size_t pos = (s / stride) % shp[i];
+                if (pos > 0)
+                {
+                    f(s - stride);
+                }
+                if (pos + 1 < shp[i])
+                {
+                    f(s + stride);
+                }
+                stride *= shp[i];
+            }
+        }
+
+        std::size_t anytime_argmin(std::chrono::steady_clock::time_point deadline)
+        {
+            const auto &settings = static_cast<T *>(this)->settings;
+            const std::size_t n_stim = EH.size();
+            if (is_candidate.size() != n_stim)
+            {
+                is_candidate.assign(n_stim, 0);
+            }
+            std::fill(EH.begin(), EH.end(), std::numeric_limits<double>::infinity());
+            candidates.clear(); // scored this trial
+            double best_eh = std::numeric_limits<double>::infinity();
+            std::size_t best = 0;
+            bool expired = false;
+            // false once time is up (after at least one candidate)
+            const auto try_score = [&](std::size_t s)
+            {
+                if (expired || is_candidate[s])
+                {
+                    return !expired;
+                }
+                if (!candidates.empty() && std::chrono::steady_clock::now() >= deadline)
+                {
+                    expired = true;
+                    return false;
+                }
+                is_candidate[s] = 1;
+                candidates.push_back(s);
+                const double eh = score(s);
+                EH.data()[s] = eh;
+                if (eh < best_eh || (eh == best_eh && s < best))
+                {
+                    best_eh = eh;
+                    best = s;
+                }
+                return true;
+            };
+            for (std::size_t k = 0; k < previous_best.size() && !expired; k++)
+            {
+                const std::size_t s = previous_best[k];
+                if (s < n_stim && try_score(s))
+                {
+                    for_each_neighbour(s, try_score);
+                }
+            }
+            bool cut = false; // the keys ran out of time
+            if (!expired)
+            {
+                // key the candidates coarse-to-fine, then score them best-first off a heap
+                const bool pruning = settings.pruning_params.enabled;
+                lower_bounds.resize(n_stim);
+                bound_order.resize(n_stim);
+                double h_post = 0;
+                if (pruning)
+                {
+                    block_mass.resize(tables->bounds.n_blocks);
+                    h_post = prepare_bounds(posterior.data(), block_mass.data());
+                }
+                else
+                {
+                    find_focus_cells();
+                }
+                make_coarse_order();
+                // about one candidate's worth of keys before the clock is consulted
+                const std::size_t key_cost = pruning ? tables->bounds.n_blocks : focus_cells.size();
+                const std::size_t min_keys = std::max<std::size_t>(1, posterior.size() / std::max<std::size_t>(key_cost, 1));
+                std::size_t n_keyed = 0;
+                for (const std::size_t s : coarse_order)
+                {
+                    if (n_keyed >= min_keys && std::chrono::steady_clock::now() >= deadline)
+                    {
+                        cut = true;
+                        break;
+                    }
+                    lower_bounds[s] = pruning ? detail::expected_entropy_bound(tables->bounds, block_mass.data(), h_post,
+                                                                               NResp, n_stim, s)
+                                              : focus_entropy(s);
+                    bound_order[n_keyed++] = s;
+                }
+                const auto later = [this](std::size_t a, std::size_t b)
+                {
+                    return lower_bounds[a] > lower_bounds[b] || (lower_bounds[a] == lower_bounds[b] && a > b);
+                };
+                const auto first = bound_order.begin();
+                auto last = first + static_cast<std::ptrdiff_t>(n_keyed);
+                std::make_heap(first, last, later);
+                const double margin = bound_margin(h_post);
+                while (last != first)
+                {
+                    std::pop_heap(first, last, later);
+                    const std::size_t s = *--last;
+                    // as in pruned_argmin(), stopping early is then exact
+                    if ((pruning && !cut && lower_bounds[s] > best_eh + margin) || !try_score(s))
+                    {
+                        break;
+                    }
+                }
+            }
+            complete = !expired && !cut;
+            // ties go to the lower index, as with the exhaustive argmin
+            const auto better = [this](std::size_t a, std::size_t b)
+            {
+                return EH.data()[a] < EH.data()[b] || (EH.data()[a] == EH.data()[b] && a < b);
+            };
+            const std::size_t n_keep = std::min<std::size_t>(std::max(settings.subsample_params.n_refine, 1u),
+                                                             candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + n_keep, candidates.end(), better);
+            previous_best.assign(candidates.begin(), candidates.begin() + n_keep);
+            for (const std::size_t s : candidates)
+            {
+                is_candidate[s] = 0;
+            }
+            return best;
+        }
+
+        std::size_t exhaustive_argmin()
+        {
+            const std::size_t n_stim = EH.size();
+            std::size_t best = 0;
+#if defined(PSYDAPT_USE_BLAS)
+            if (tables->precision == LikelihoodPrecision::Double)
+            {
+                // all candidates at once, as two matrix products against the table
+                detail::expected_entropy_blas(tables->likelihoods.data(), tables->llogl.data(), posterior.data(), NResp,
+                                              n_stim, posterior.size(), pk.data(), H.data(), EH.data(), blas_work.data());
+                for (std::size_t s = 0; s < n_stim; s++)
+                {
+                    best = EH.data()[s] < EH.data()[best] ? s : best;
+                }
+                return best;
+            }
+#endif
+            for (std::size_t s = 0; s < n_stim; s++)
+            {
+                EH.data()[s] = score(s);
+                best = EH.data()[s] < EH.data()[best] ? s : best;
+            }
+            return best;
+        }
+
+        // expected entropy of table row `s`, also filling its pk and H
+        double score(std::size_t s)
+        {
+            return score(s, posterior.data(), pk.data(), H.data());
+        }
+        // expected entropy of table row `s` against any posterior (`pk` and `H` may be null)
+        double score(std::size_t s, const double *post, double *pk_out = nullptr, double *H_out = nullptr) const
+        {
+            const std::size_t n_stim = EH.size();
+            switch (tables->precision)
+            {
+            case LikelihoodPrecision::UInt16:
+                return detail::expected_entropy(tables->likelihoods16, post, NResp, n_stim, s, pk_out, H_out);
+            case LikelihoodPrecision::UInt8:
+                return detail::expected_entropy(tables->likelihoods8, post, NResp, n_stim, s, pk_out, H_out);
+            default:
+                return detail::expected_entropy(tables->likelihoods.data(), post, NResp, n_stim, posterior.size(), s,
+                                                pk_out, H_out);
+            }
+        }
+
+        // one cell of likelihood row `lrow`
+        double likelihood_at(std::size_t lrow, std::size_t i) const
+        {
+            switch (tables->precision)
+            {
+            case LikelihoodPrecision::UInt16:
+                return tables->likelihoods16.at(lrow, i);
+            case LikelihoodPrecision::UInt8:
+                return tables->likelihoods8.at(lrow, i);
+            default:
+                return tables->likelihoods[lrow * posterior.size() + i];
+            }
+        }
+        // likelihood row `lrow` (response * n_stim + table row), converted into `row_buffer` if quantised
+        const double *likelihood_row(std::size_t lrow)
+        {
+            row_buffer.resize(posterior.size());
+            return likelihood_row(lrow, row_buffer.data());
+        }
+        // as above, converting into `buf` (`n_param` doubles) if need be
+        const double *likelihood_row(std::size_t lrow, double *buf) const
+        {
+            switch (tables->precision)
+            {
+            case LikelihoodPrecision::UInt16:
+                tables->likelihoods16.dequantize_row(lrow, buf);
+                return buf;
+            case LikelihoodPrecision::UInt8:
+                tables->likelihoods8.dequantize_row(lrow, buf);
+                return buf;
+            default:
+                return tables->likelihoods.data() + lrow * posterior.size();
+            }
+        }
+
+        // among the `top_k` best one-step candidates (scored for every stimulus, into pk and EH),
+        // the one with the lowest expected entropy after the best second trial
+        std::size_t two_step_argmin(const LookaheadParams &lookahead)
+        {
+            const std::size_t n_stim = EH.size();
+            const std::size_t n_param = posterior.size();
+            const std::size_t k = std::clamp<std::size_t>(lookahead.top_k, 1, n_stim);
+            auto &top = lookahead_order;
+            std::iota(top.begin(), top.end(), 0);
+            std::partial_sort(top.begin(), top.begin() + static_cast<std::ptrdiff_t>(k), top.end(),
+                              [this](std::size_t a, std::size_t b)
+                              { return EH.data()[a] < EH.data()[b] || (EH.data()[a] == EH.data()[b] && a < b); });
+            // one task per (candidate, first response): pk * min over second stimuli of EH
+            auto &value = lookahead_value;
+            std::fill(value.begin(), value.end(), 0.0);
+            const auto task = [&](std::size_t j, LookaheadScratch &ls)
+            {
+                const std::size_t lrow = (j % NResp) * n_stim + top[j / NResp];
+                const double p = pk.data()[lrow];
+                if (!(p > 0))
+                {
+                    return;
+                }
+                const double *l = likelihood_row(lrow, ls.row.data());
+                for (std::size_t i = 0; i < n_param; i++)
+                {
+                    ls.post[i] = l[i] * posterior.data()[i] / p;
+                }
+                value[j] = p * min_expected_entropy(ls.post.data(), ls);
+            };
+            const std::size_t n_slots = std::min(lookahead_scratch.size(), value.size());
+            if (n_slots == 1)
+            {
+                for (std::size_t j = 0; j < value.size(); j++)
+                {
+                    task(j, lookahead_scratch[0]);
+                }
+            }
+            else
+            {
+                // kept across trials; the calling thread works too
+                if (!lookahead_pool)
+                {
+                    lookahead_pool = std::make_shared<parallel::ThreadPool>(static_cast<unsigned int>(lookahead_scratch.size() - 1));
+                }
+                // one slot per thread, each with its own buffers, taking tasks in turn
+                std::atomic<std::size_t> next_task{0};
+                lookahead_pool->parallel_for(n_slots, [&](std::size_t slot)
+                                             {
+                                                 for (std::size_t j = next_task++; j < value.size(); j = next_task++)
+                                                 {
+                                                     task(j, lookahead_scratch[slot]);
+                                                 } });
+            }
+            std::size_t best = top[0];
+            double best_value = std::numeric_limits<double>::infinity();
+            for (std::size_t c = 0; c < k; c++)
+            {
+                const double v = std::accumulate(value.begin() + static_cast<std::ptrdiff_t>(c * NResp),
+                                                 value.begin() + static_cast<std::ptrdiff_t>((c + 1) * NResp), 0.0);
+                if (v < best_value || (v == best_value && top[c] < best))
+                {
+                    best_value = v;
+                    best = top[c];
+                }
+            }
+            return best;
+        }
+
+        // smallest expected entropy of any candidate against `post`, using `ls` for pruning;
+        // const, so lookahead tasks can share it
+        double min_expected_entropy(const double *post, LookaheadScratch &ls) const
+        {
+            const std::size_t n_stim = EH.size();
+            double best = std::numeric_limits<double>::infinity();
+            if (static_cast<const T *>(this)->settings.pruning_params.enabled)
+            {
+                const double margin = sort_by_bound(post, ls.mass.data(), ls.bounds.data(), ls.order.data());
+                for (const std::size_t s : ls.order)
+                {
+                    if (ls.bounds[s] > best + margin)
+                    {
+                        break;
+                    }
+                    best = std::min(best, score(s, post));
+                }
+                return best;
+            }
+            for (std::size_t s = 0; s < n_stim; s++)
+            {
+                best = std::min(best, score(s, post));
+            }
+            return best;
+        }
+
+        // 0, n/2, n/4, 3n/4, ...: every prefix is spread about evenly over the grid
+        void make_coarse_order()
+        {
+            const std::size_t n_stim = EH.size();
+            if (coarse_order.size() == n_stim)
+            {
+                return;
+            }
+            std::size_t bits = 0;
+            while ((std::size_t{1} << bits) < n_stim)
+            {
+                bits++;
+            }
+            coarse_order.clear();
+            for (std::size_t k = 0; k < (std::size_t{1} << bits); k++)
+            {
+                std::size_t r = 0;
+                for (std::size_t b = 0; b < bits; b++)
+                {
+                    r |= ((k >> b) & 1) << (bits - 1 - b);
+                }
+                if (r < n_stim)
+                {
+                    coarse_order.push_back(r);
+                }
+            }
+        }
+
+        // `max(32, sqrt(n_param))` draws from the posterior, spaced evenly through its cumulative
+        // mass: cells drawn into `focus_cells`, their share of the draws into `focus_mass`. A flat
+        // posterior gives cells spread over the grid, a peaked one its heaviest cells.
+        void find_focus_cells()
+        {
+            const std::size_t n_param = posterior.size();
+            const std::size_t n = std::min(n_param, std::max<std::size_t>(32, static_cast<std::size_t>(std::sqrt(static_cast<double>(n_param)))));
+            const double *post = posterior.data();
+            const double step = std::accumulate(post, post + n_param, 0.0) / static_cast<double>(n);
+            focus_cells.clear();
+            focus_mass.clear();
+            double acc = 0, mark = step / 2;
+            std::size_t drawn = 0;
+            for (std::size_t i = 0; i < n_param && drawn < n; i++)
+            {
+                acc += post[i];
+                std::size_t k = 0;
+                for (; mark < acc && drawn + k < n; k++)
+                {
+                    mark += step;
+                }
+                if (k)
+                {
+                    focus_cells.push_back(i);
+                    focus_mass.push_back(static_cast<double>(k) / static_cast<double>(n));
+                    drawn += k;
+                }
+            }
+        }
+
+        // expected entropy of table row `s` against the focus cells alone
+        double focus_entropy(std::size_t s) const
+        {
+            const std::size_t n_stim = EH.size();
+            double eh = 0;
+            for (std::size_t r = 0; r < NResp; r++)
+            {
+                double p = 0, mlogm = 0;
+                for (std::size_t j = 0; j < focus_cells.size(); j++)
+                {
+                    const double m = focus_mass[j] * likelihood_at(r * n_stim + s, focus_cells[j]);
+                    p += m;
+                    mlogm += m > 0 ? m * std::log(m) : 0;
+                }
+                // p * H with H = log(p) - sum(m log m) / p
+                eh += p > 0 ? p * std::log(p) - mlogm : 0;
+            }
+            return eh;
+        }
+
+        // fill `lower_bounds` and sort `bound_order` by them; returns the slack to allow
+        // when comparing a bound with a computed score
+        double sort_by_bound()
+        {
+            return sort_by_bound(posterior.data(), block_mass.data(), lower_bounds.data(), bound_order.data());
+        }
+        // the same for any posterior, into `mass` (per block), `bounds` and `order` (per stimulus)
+        double sort_by_bound(const double *post, double *mass, double *bounds, std::size_t *order) const
+        {
+            const std::size_t n_stim = EH.size();
+            const double h_post = prepare_bounds(post, mass);
+            for (std::size_t s = 0; s < n_stim; s++)
+            {
+                bounds[s] = detail::expected_entropy_bound(tables->bounds, mass, h_post, NResp, n_stim, s);
+            }
+            std::iota(order, order + n_stim, 0);
+            std::sort(order, order + n_stim, [bounds](std::size_t a, std::size_t b)
+                      { return bounds[a] < bounds[b] || (bounds[a] == bounds[b] && a < b); });
+            return bound_margin(h_post);
+        }
+        // the block masses of `post` into `mass`; returns the entropy of `post`
+        double prepare_bounds(const double *post, double *mass) const
+        {
+            const std::size_t n_param = posterior.size();
+            detail::block_mass(post, n_param, tables->bounds, mass);
+            double h_post = 0;
+            for (std::size_t i = 0; i < n_param; i++)
+            {
+                h_post -= post[i] > 0 ? post[i] * std::log(post[i]) : 0;
+            }
+            return h_post;
+        }
+        // the bound is exact in real arithmetic, so leave room for rounding in both sums
+        static double bound_margin(double h_post)
+        {
+            return std::sqrt(std::numeric_limits<double>::epsilon()) * (1 + h_post);
+        }
+
+        // same result as exhaustive_argmin(); skipped candidates are left at +inf in EH
+        std::size_t pruned_argmin()
+        {
+            const double margin = sort_by_bound();
+            std::fill(EH.begin(), EH.end(), std::numeric_limits<double>::infinity());
+            double best_eh = std::numeric_limits<double>::infinity();
+            std::size_t best = 0;
+            for (const std::size_t s : bound_order)
+            {
+                if (lower_bounds[s] > best_eh + margin)
+                {
+                    break;
+                }
+                const double eh = score(s);
+                EH.data()[s] = eh;
+                if (eh < best_eh || (eh == best_eh && s < best))
+                {
+                    best_eh = eh;
+                    best = s;
+                }
+            }
+            return best;
+        }
+
+        // build the likelihood table (and pruning bounds) from the current stimulus and parameter tables
+        void make_tables()
+        {
+            const auto &pruning = static_cast<T *>(this)->settings.pruning_params;
+            const auto &storage = static_cast<T *>(this)->settings.storage_params;
+            auto t = std::make_shared<Tables>();
+            t->likelihoods = generate_likelihoods();
+            std::copy_n(t->likelihoods.shape().begin() + 1, DimStim, stimulus_shape.begin());
+            const std::size_t n_param = posterior.size();
+            const std::size_t n_stim = t->likelihoods.size() / (NResp * n_param);
+            if (pruning.enabled)
+            {
+                t->bounds = detail::make_candidate_bounds(t->likelihoods.data(), NResp, n_stim, n_param,
+                                                          pruning.block_size);
+            }
+            t->precision = storage.precision;
+            if (storage.precision == LikelihoodPrecision::UInt16)
+            {
+                t->likelihoods16 = detail::quantize<std::uint16_t>(t->likelihoods.data(), NResp * n_stim, n_param,
+                                                                   storage.block_size);
+            }
+            else if (storage.precision == LikelihoodPrecision::UInt8)
+            {
+                t->likelihoods8 = detail::quantize<std::uint8_t>(t->likelihoods.data(), NResp * n_stim, n_param,
+                                                                 storage.block_size);
+            }
+            if (storage.precision != LikelihoodPrecision::Double)
+            {
+                t->likelihoods = xt::xtensor<double, DimParam + DimStim + 1>();
+            }
+#if defined(PSYDAPT_USE_BLAS)
+            else
+            {
+                t->llogl = detail::likelihood_log_likelihood(t->likelihoods.data(), t->likelihoods.size());
+            }
+#endif
+            tables = std::move(t);
+        }
+
+        // `row` indexes the likelihood table, which skips filtered-out stimuli
+        void set_next_stimulus(std::size_t row)
+        {
+            std::size_t flat = valid_stimuli ? (*valid_stimuli)[row] : row;
+            if constexpr (std::is_scalar_v<stim_type>)
+            {
+                this->next_stimulus = stimuli[0][flat];
+            }
+            else
+            {
+                for (std::size_t i = DimStim; i-- != 0;)
+                {
+                    this->next_stimulus[i] = stimuli[i][flat % stimuli[i].size()];
+                    flat /= stimuli[i].size();
+                }
+            }
+        }
+
+        // likelihood table row for the grid point with per-axis indices `idx`
+        std::size_t table_row(const std::array<std::size_t, DimStim> &idx) const
+        {
+            std::size_t flat = 0;
+            for (std::size_t i = 0; i < DimStim; i++)
+            {
+                flat = flat * stimuli[i].size() + idx[i];
+            }
+            if (!valid_stimuli)
+            {
+                return flat;
+            }
+            if (stimulus_row[flat] == std::numeric_limits<std::size_t>::max())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The stimulus is excluded by the stimulus filter.");
+            }
+            return stimulus_row[flat];
+        }
+
+        // collect the stimulus coordinates that the likelihood table is built over
+        void make_stimulus_table()
+        {
+            const auto &filter = static_cast<T *>(this)->settings.stimulus_filter;
+            if (!filter)
+            {
+                for (std::size_t i = 0; i < DimStim; i++)
+                {
+                    stimulus_coords[i].assign(stimuli[i].begin(), stimuli[i].end());
+                }
+                return;
+            }
+            std::size_t n_grid = 1;
+            for (const auto &axis : stimuli)
+            {
+                n_grid *= axis.size();
+            }
+            valid_stimuli.emplace();
+            stimulus_row.assign(n_grid, std::numeric_limits<std::size_t>::max());
+            std::array<double, DimStim> x;
+            for (std::size_t g = 0; g < n_grid; g++)
+            {
+                std::size_t rem = g;
+                for (std::size_t i = DimStim; i-- != 0;)
+                {
+                    x[i] = stimuli[i][rem % stimuli[i].size()];
+                    rem /= stimuli[i].size();
+                }
+                if (filter(x))
+                {
+                    stimulus_row[g] = valid_stimuli->size();
+                    valid_stimuli->push_back(g);
+                    for (std::size_t i = 0; i < DimStim; i++)
+                    {
+                        stimulus_coords[i].push_back(x[i]);
+                    }
+                }
+            }
+            if (valid_stimuli->empty())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "No stimulus passes the stimulus filter.");
+            }
+        }
+
+        /**
+         * Broadcast shape of stimulus coordinate `i` (from `stimulus_coords`) in a
+         * `(stim..., param...)` table. Without a filter each coordinate runs along
+         * its own axis; with one, the valid points all run along the first axis and
+         * the other stimulus axes have length 1.
+         */
+        template <std::size_t Rank>
+        std::array<std::size_t, Rank> stimulus_axis_shape(std::size_t i) const
+        {
+            std::array<std::size_t, Rank> out;
+            out.fill(1);
+            out[valid_stimuli ? 0 : i] = stimulus_coords[i].size();
+            return out;
+        }
+
+        /**
+         * Stimulus coordinate `i` restricted to index `s` of the first stimulus axis,
+         * broadcast like @ref stimulus_axis_shape over one slab of the likelihood table.
+         */
+        template <std::size_t Rank>
+        auto stimulus_slab(std::size_t i, std::size_t s) const
+        {
+            auto shape = stimulus_axis_shape<Rank>(i);
+            const bool along_first = valid_stimuli || i == 0;
+            if (along_first)
+            {
+                shape[0] = 1;
+            }
+            return xt::adapt<xt::layout_type::row_major>(stimulus_coords[i].data() + (along_first ? s : 0),
+                                                         along_first ? 1 : stimulus_coords[i].size(),
+                                                         xt::no_ownership(), shape);
+        }
+
+        // writable `(1, stim..., param...)` view of one response's slab of the likelihood table
+        auto slab_view(double *data) const
+        {
+            return xt::adapt<xt::layout_type::row_major>(data, slab_size, xt::no_ownership(), slab_shape);
+        }
+
+        // collect the parameter cells that the posterior is stored over
+        void make_parameter_table()
+        {
+            const auto &settings = static_cast<T *>(this)->settings;
+            if (!settings.parameter_filter)
+            {
+                parameter_coords = parameters;
+                return;
+            }
+            if (settings.refinement_params.every)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "Grid refinement needs a dense parameter grid, so it can't be combined with a parameter filter.");
+            }
+            std::size_t n_grid = 1;
+            for (const auto &axis : parameters)
+            {
+                n_grid *= axis.size();
+            }
+            valid_parameters.emplace();
+            std::array<double, DimParam> theta;
+            for (std::size_t g = 0; g < n_grid; g++)
+            {
+                std::size_t rem = g;
+                for (std::size_t a = DimParam; a-- != 0;)
+                {
+                    theta[a] = parameters[a][rem % parameters[a].size()];
+                    rem /= parameters[a].size();
+                }
+                if (settings.parameter_filter(theta))
+                {
+                    valid_parameters->push_back(g);
+                    for (std::size_t a = 0; a < DimParam; a++)
+                    {
+                        parameter_coords[a].push_back(theta[a]);
+                    }
+                }
+            }
+            if (valid_parameters->empty())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "No parameter combination passes the parameter filter.");
+            }
+        }
+
+        /**
+         * Broadcast shape of parameter `a` (from `parameter_coords`) in a `(stim..., param...)`
+         * table, analogous to @ref stimulus_axis_shape: with a filter, all retained cells run
+         * along the first parameter axis.
+         */
+        template <std::size_t Rank>
+        std::array<std::size_t, Rank> parameter_axis_shape(std::size_t a) const
+        {
+            std::array<std::size_t, Rank> out;
+            out.fill(1);
+            out[DimStim + (valid_parameters ? 0 : a)] = parameter_coords[a].size();
+            return out;
+        }
+
+        // index of the nearest grid point along each stimulus axis
+        std::array<std::size_t, DimStim> nearest_index(const stim_type &stim) const
+        {
+            std::array<std::size_t, DimStim> idx;
+            if constexpr (std::is_scalar_v<stim_type>)
+            {
+                idx[0] = xt::argmin(xt::abs(stimuli[0] - stim))[0];
+            }
+            else
+            {
+                for (std::size_t i = 0; i < DimStim; i++)
+                {
+                    idx[i] = xt::argmin(xt::abs(stimuli[i] - stim[i]))[0];
+                }
+            }
+            return idx;
+        }
+
+        /**
+         * Cost of a dense `stim_sizes` x `param_sizes` grid under `settings`; models
+         * forward their axis lengths from a static `estimate_cost(const Params &)`.
+         * Byte counts saturate at `SIZE_MAX` instead of wrapping.
+         */
+        static Cost cost_of(const std::array<std::size_t, DimStim> &stim_sizes,
+                            const std::array<std::size_t, DimParam> &param_sizes, const BaseParams &settings)
+        {
+            constexpr std::size_t max = std::numeric_limits<std::size_t>::max();
+            const auto mul = [](std::size_t a, std::size_t b)
+            {
+                return a && b > max / a ? max : a * b;
+            };
+            const auto add = [](std::size_t a, std::size_t b)
+            {
+                return a > max - b ? max : a + b;
+            };
+            std::size_t n_stim = 1, n_param = 1;
+            for (const std::size_t n : stim_sizes)
+            {
+                n_stim = mul(n_stim, n);
+            }
+            for (const std::size_t n : param_sizes)
+            {
+                n_param = mul(n_param, n);
+            }
+            constexpr std::size_t d = sizeof(double);
+            Cost out;
+            out.posterior_bytes = mul(n_param, d);
+            // pk, H (per response and stimulus) and EH
+            out.scratch_bytes = mul(mul(2 * NResp + 1, n_stim), d);
+            const auto &storage = settings.storage_params;
+            const bool quantized = storage.precision != LikelihoodPrecision::Double;
+            if (quantized)
+            {
+                // as in detail::quantize: codes, plus an offset and step per block, and a row converted back
+                const std::size_t code = storage.precision == LikelihoodPrecision::UInt16 ? 2 : 1;
+                const std::size_t block = std::clamp<std::size_t>(storage.block_size, 1, detail::max_quantized_block);
+                const std::size_t n_blocks = n_param / block + (n_param % block != 0);
+                out.likelihood_bytes = add(mul(mul(NResp, n_stim), mul(n_param, code)),
+                                           mul(mul(NResp, n_stim), mul(n_blocks, 2 * d)));
+                out.scratch_bytes = add(out.scratch_bytes, mul(n_param, d));
+            }
+            else
+            {
+                out.likelihood_bytes = mul(mul(NResp, n_stim), mul(n_param, d));
+            }
+            const auto &pruning = settings.pruning_params;
+            std::size_t bound_blocks = 0;
+            if (pruning.enabled)
+            {
+                // as in detail::make_candidate_bounds
+                std::size_t block = pruning.block_size;
+                if (!block)
+                {
+                    block = std::max<std::size_t>(8, static_cast<std::size_t>(std::sqrt(static_cast<double>(n_param)) / 8));
+                }
+                block = std::min(block, std::max<std::size_t>(n_param, 1));
+                const std::size_t n_blocks = n_param / block + (n_param % block != 0);
+                bound_blocks = n_blocks;
+                // lmin and lmax per response, hmin
+                out.likelihood_bytes = add(out.likelihood_bytes, mul(mul(2 * NResp + 1, mul(n_stim, n_blocks)), d));
+                // block_mass, lower_bounds, bound_order
+                out.scratch_bytes = add(out.scratch_bytes, add(mul(n_blocks, d), mul(n_stim, d + sizeof(std::size_t))));
+            }
+#if defined(PSYDAPT_USE_BLAS)
+            // L log L alongside the table, and the operands of the matrix products
+            if (!quantized)
+            {
+                out.likelihood_bytes = add(out.likelihood_bytes, mul(mul(NResp, n_stim), mul(n_param, d)));
+                out.scratch_bytes = add(out.scratch_bytes, mul(mul(2, add(n_param, mul(NResp, n_stim))), d));
+            }
+#endif
+            const double fraction = std::clamp(settings.subsample_params.fraction, 0.0, 1.0);
+            if (fraction < 1)
+            {
+                // candidate_order, is_candidate, candidates
+                out.scratch_bytes = add(out.scratch_bytes, mul(n_stim, 2 * sizeof(std::size_t) + 1));
+            }
+            // per response and cell: a multiply-add for pk, then q = l * post / pk and q * log(q)
+            const double cells = static_cast<double>(n_stim) * static_cast<double>(n_param);
+            out.next_flops = fraction * cells * static_cast<double>(NResp) * 7;
+            if (settings.stim_selection_method == StimSelectionMethod::TwoStepEntropy && fraction == 1)
+            {
+                // a second-step sweep per (candidate, response), and the posterior each one starts from
+                const double k = static_cast<double>(std::clamp<std::size_t>(settings.lookahead_params.top_k, 1, n_stim));
+                out.next_flops *= 1 + k * static_cast<double>(NResp);
+                // lookahead_order, lookahead_value, and per thread a row, a posterior and (with pruning) the bound buffers
+                std::size_t per_thread = mul(2 * d, n_param);
+                if (pruning.enabled)
+                {
+                    per_thread = add(per_thread, add(mul(bound_blocks, d), mul(n_stim, d + sizeof(std::size_t))));
+                }
+                out.scratch_bytes = add(out.scratch_bytes, add(add(mul(n_stim, sizeof(std::size_t)), mul(static_cast<std::size_t>(k) * NResp, d)),
+                                                               mul(lookahead_threads(settings.lookahead_params), per_thread)));
+            }
+            // multiply-add, then normalise (plus the entropy and marginals if the stopping rules need them)
+            const auto &stopping = settings.stopping_params;
+            double per_cell = 3;
+            if (stopping.entropy)
+            {
+                per_cell += 3;
+            }
+            per_cell += static_cast<double>(stopping.credible_intervals.size());
+            out.update_flops = per_cell * static_cast<double>(n_param);
+            return out;
+        }
+
+        // threads scoring the second step, the calling thread included
+        static std::size_t lookahead_threads(const LookaheadParams &lookahead)
+        {
+            return lookahead.n_threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) + std::size_t{1}
+                                            : lookahead.n_threads;
+        }
+
+        void setup()
+        {
+            // everything else for init, post-assigning settings
+            const auto &settings = static_cast<T *>(this)->settings;
+            if (settings.construction_params.max_bytes &&
+                T::estimate_cost(settings).total_bytes() > settings.construction_params.max_bytes)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The configuration needs more memory than construction_params.max_bytes allows (see estimate_cost()).");
+            }
+            make_params();
+            for (std::size_t a = 0; a < DimParam; a++)
+            {
+                const auto [lo, hi] = std::minmax_element(parameters[a].begin(), parameters[a].end());
+                original_bounds[a] = {*lo, *hi};
+            }
+            make_parameter_table();
+            make_stimuli();
+            make_stimulus_table();
+            posterior = generate_prior();
+            make_tables();
+            make_scratch();
+            std::size_t stride = 1;
+            for (std::size_t a = DimParam; a-- != 0;)
+            {
+                parameter_strides[a] = stride;
+                stride *= parameters[a].size();
+            }
+            const auto &stopping = static_cast<T *>(this)->settings.stopping_params;
+            for (const auto &rule : stopping.credible_intervals)
+            {
+                if (rule.parameter >= DimParam || !(rule.mass > 0 && rule.mass < 1))
+                {
+                    PSYDAPT_THROW(std::invalid_argument, "Credible-interval rules need a valid parameter index and a mass in (0, 1).");
+                }
+                marginals.emplace_back(parameters[rule.parameter].size(), 0.0);
+            }
+            const auto &subsample = static_cast<T *>(this)->settings.subsample_params;
+            if (!(subsample.fraction > 0 && subsample.fraction <= 1))
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The subsample fraction must be in (0, 1].");
+            }
+            if (subsample.fraction < 1 &&
+                static_cast<T *>(this)->settings.stim_selection_method == StimSelectionMethod::TwoStepEntropy)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "TwoStepEntropy needs the full one-step sweep, so it can't be subsampled.");
+            }
+            const auto &history_params = static_cast<T *>(this)->settings.history_params;
+            if (history_params.compact)
+            {
+                for (const auto &s : stimuli)
+                {
+                    if (s.size() > std::numeric_limits<typename CompactHistory<DimStim>::index_type>::max())
+                    {
+                        PSYDAPT_THROW(std::invalid_argument, "Stimulus axis is too long for a compact history.");
+                    }
+                }
+                compact_history.emplace(NResp, history_params.capacity);
+                compact_history->reserve(500);
+                return;
+            }
+            // TODO: pick something smarter, once we incorporate termination conditions
+            this->response_history.reserve(500);
+            this->stimulus_history.reserve(500);
+            //
+        }
+
+        xt::xtensor<double, DimParam> prior_helper(const std::vector<double> &param,
+                                                   const std::optional<std::vector<double>> &prior = std::nullopt,
+                                                   const std::size_t index = 0)
+        {
+            const auto param_size = param.size();
+            std::array<std::size_t, DimParam> prior_shape;
+            prior_shape.fill(1);
+            prior_shape[index] = param_size;
+            xt::xtensor<double, DimParam> out_prior;
+            if (prior && prior->size() != param_size)
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The prior and parameter domain sizes must match.");
+            }
+            if (valid_parameters)
+            {
+                // one value per retained cell, laid out like the posterior
+                std::size_t stride = 1;
+                for (std::size_t a = index + 1; a < DimParam; a++)
+                {
+                    stride *= parameters[a].size();
+                }
+                prior_shape[index] = 1;
+                prior_shape[0] = valid_parameters->size();
+                out_prior = xt::xtensor<double, DimParam>::from_shape(prior_shape);
+                for (std::size_t c = 0; c < valid_parameters->size(); c++)
+                {
+                    out_prior.data()[c] = prior ? (*prior)[((*valid_parameters)[c] / stride) % param_size] : 1.0;
+                }
+            }
+            else if (prior)
+            {
+                out_prior = xt::adapt<xt::layout_type::row_major>(*prior, prior_shape);
             }
             else
             {
@@ -19,6 +19,9 @@ You should have received a copy of the GNU General Public License
 along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <array>
+#include <cmath>
+#include <functional>
 #include <vector>
 #include <optional>
 
@@ -28,6 +31,7 @@ along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "../../config.hpp"
 #include "../base.hpp"
+#include "../psychometric.hpp"
 #include "questplus.hpp"
 
 /** @file
@@ -45,6 +49,8 @@ namespace psydapt::questplus
         {
             Scale stim_scale = Scale::Log10;                          /// Scale of the stimulus.
             std::vector<double> intensity;                            /// Array of possible stimulus values.
+            std::function<bool(const std::array<double, 1> &)> stimulus_filter; /// Return `false` for stimuli that can't be presented (unset keeps all).
+            std::function<bool(const std::array<double, 4> &)> parameter_filter; /// Return `false` for impossible parameter combinations, in @ref parameter_domain order (unset keeps all).
             std::vector<double> threshold;                            /// Array of possible threshold parameter values.
             std::vector<double> slope{3.5};                           /// Array of possible slope parameter values.
             std::vector<double> lower_asymptote{0.01};                /// Array of possible lower asymptote parameter values.
@@ -60,6 +66,34 @@ namespace psydapt::questplus
             QPB::setup();
         }
 
+        /** @brief Parameter axes in posterior order: threshold, slope, lower asymptote, lapse rate. */
+        static std::array<std::vector<double>, 4> parameter_domain(const Params &params)
+        {
+            return {params.threshold, params.slope, params.lower_asymptote, params.lapse_rate};
+        }
+        /** @brief Priors matching @ref parameter_domain (unset means flat). */
+        static std::array<std::optional<std::vector<double>>, 4> parameter_priors(const Params &params)
+        {
+            return {params.threshold_prior, params.slope_prior, params.lower_asymptote_prior, params.lapse_rate_prior};
+        }
+        /** @brief Stimulus axes. */
+        static std::array<std::vector<double>, 1> stimulus_domain(const Params &params)
+        {
+            return {params.intensity};
+        }
+        /** @brief Memory and per-trial work for `params`, without building anything (see @ref Cost). */
+        static Cost estimate_cost(const Params &params)
+        {
+            return QPB::cost_of({params.intensity.size()},
+                                {params.threshold.size(), params.slope.size(), params.lower_asymptote.size(), params.lapse_rate.size()},
+                                params);
+        }
+        /** @brief Probability of a `1` response for one stimulus and one parameter vector. */
+        static double psychometric(const Params &params, const std::array<double, 1> &x, const std::array<double, 4> &theta)
+        {
+            return psydapt::psychometric::weibull(x[0], theta[0], theta[1], theta[2], theta[3], params.stim_scale);
+        }
+
     protected:
         const Params settings;
 
@@ -68,6 +102,11 @@ namespace psydapt::questplus
             stimuli[0] = xt::adapt<xt::layout_type::row_major>(settings.intensity, {settings.intensity.size()});
         }
 
+        void make_params()
+        {
+            parameters = parameter_domain(settings);
+        }
+
         xt::xtensor<double, Weibull::dim_param> generate_prior()
         {
             const auto thresh_prior = prior_helper(settings.threshold, settings.threshold_prior, 0);
@@ -77,33 +116,6 @@ namespace psydapt::questplus
             xt::xtensor<double, Weibull::dim_param> prior = thresh_prior * slope_prior * lower_prior * lapse_prior;
             return prior / xt::sum(prior, xt::evaluation_strategy::immediate);
         }
-
-        xt::xtensor<double, Weibull::dim_param + Weibull::dim_stim + 1> generate_likelihoods()
-        {
-            using sz = std::array<std::size_t, Weibull::dim_param + Weibull::dim_stim>;
-            const auto x = xt::adapt<xt::layout_type::row_major>(settings.intensity, sz{settings.intensity.size(), 1, 1, 1, 1});
-            const auto thresh = xt::adapt<xt::layout_type::row_major>(settings.threshold, sz{1, settings.threshold.size(), 1, 1, 1});
-            const auto slope = xt::adapt<xt::layout_type::row_major>(settings.slope, sz{1, 1, settings.slope.size(), 1, 1});
-            const auto lower = xt::adapt<xt::layout_type::row_major>(settings.lower_asymptote, sz{1, 1, 1, settings.lower_asymptote.size(), 1});
-            const auto lapse = xt::adapt<xt::layout_type::row_major>(settings.lapse_rate, sz{1, 1, 1, 1, settings.lapse_rate.size()});
-
-            xt::xtensor<double, Weibull::dim_param + Weibull::dim_stim> p;
-            switch (settings.stim_scale)
-            {
-            case Scale::Linear:
-                p = 1 - lapse - (1 - lower - lapse) * xt::exp(-xt::pow(x / thresh, slope));
-                break;
-            case Scale::Log10:
-                p = 1 - lapse - (1 - lower - lapse) * xt::exp(-xt::pow(10, slope * (x - thresh)));
-                break;
-            case Scale::dB:
-                p = 1 - lapse - (1 - lower - lapse) * xt::exp(-xt::pow(10, slope * (x - thresh) * 0.05));
-                break;
-            }
-            // in this, we diverge from hoechenberger/questplus
-            // store 0/incorrect as 0th element, so that we can index using the response
-            return xt::stack(xt::xtuple(1.0 - p, p));
-        }
     };
 } // namespace psydapt::questplus
 
@@ -0,0 +1,369 @@
+#ifndef PSYDAPT_SERVER_PROTOCOL_HPP
+#define PSYDAPT_SERVER_PROTOCOL_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../../config.hpp"
+
+/** @file
+ * @brief Wire format of @ref psydapt::server::UnixServer
+ *
+ * Every message is a frame: a little-endian `u32` length (of the rest of the
+ * frame), a `u32` request id chosen by the client and echoed in the reply, a
+ * `u8` opcode, then the body:
+ *
+ * | opcode   | request body                                       | reply body                   |
+ * |----------|----------------------------------------------------|------------------------------|
+ * | `Create` | `u32` config                                       | `u64` session                |
+ * | `Next`   | `u64` session                                      | `u8` n, `n` x `f64` stimulus |
+ * | `Update` | `u64` session, `i32` response, `u8` n, `n` x `f64` | `u8` continue                |
+ * | `Close`  | `u64` session                                      | (empty)                      |
+ *
+ * Replies use the request's opcode with the high bit set, or `Error` with a
+ * `u16` length and that many bytes of message. An `Update` with `n = 0` uses the
+ * stimulus from the session's last next(). Doubles are sent as their IEEE-754 bits.
+ * Replies to requests on one session arrive in request order; across sessions,
+ * they may be reordered, hence the request id.
+ */
+namespace psydapt::server::protocol
+{
+    enum class Op : std::uint8_t
+    {
+        Create = 1,
+        Next = 2,
+        Update = 3,
+        Close = 4,
+        Error = 0xff
+    };
+    constexpr std::uint8_t reply_bit = 0x80;
+    constexpr std::size_t max_stim_dim = 8;    // largest stimulus a frame can carry
+    constexpr std::size_t max_frame = 1 << 16; // longer frames are a protocol error
+    constexpr std::size_t header_size = 4 + 4 + 1;
+
+    /** @brief A decoded request (fields unused by `op` are left at their defaults). */
+    struct Request
+    {
+        std::uint32_t id = 0;
+        Op op = Op::Next;
+        std::uint32_t config = 0;   // Create
+        std::uint64_t session = 0;  // Next, Update, Close
+        std::int32_t response = 0;  // Update
+        std::uint8_t n_stim = 0;    // Update
+        std::array<double, max_stim_dim> stimulus{};
+    };
+
+    /** @brief A decoded reply; `op` is the request's opcode, or `Error`. */
+    struct Reply
+    {
+        std::uint32_t id = 0;
+        Op op = Op::Next;
+        std::uint64_t session = 0;   // Create
+        std::uint8_t n_stim = 0;     // Next
+        std::array<double, max_stim_dim> stimulus{};
+        bool should_continue = true; // Update
+        std::string error;           // Error
+    };
+
+    namespace detail
+    {
+        class Writer
+        {
+        public:
+            explicit Writer(std::vector<unsigned char> &out) : out(out), start(out.size())
+            {
+                u32(0); // length, patched by finish()
+            }
+            void u8(std::uint8_t v) { out.push_back(v); }
+            void u16(std::uint16_t v) { uint(v, 2); }
+            void u32(std::uint32_t v) { uint(v, 4); }
+            void u64(std::uint64_t v) { uint(v, 8); }
+            void f64(double v)
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, &v, sizeof bits);
+                u64(bits);
+            }
+            void finish()
+            {
+                const std::uint32_t len = static_cast<std::uint32_t>(out.size() - start - 4);
+                for (std::size_t k = 0; k < 4; k++)
+                {
+                    out[start + k] = static_cast<unsigned char>(len >> (8 * k));
+                }
+            }
+
+        private:
+            std::vector<unsigned char> &out;
+            std::size_t start;
+            void uint(std::uint64_t v, std::size_t n)
+            {
+                for (std::size_t k = 0; k < n; k++)
+                {
+                    out.push_back(static_cast<unsigned char>(v >> (8 * k)));
+                }
+            }
+        };
+
+        // bounds-checked reads; any overrun sets `ok` to false and yields zeros
+        class Reader
+        {
+        public:
+            Reader(const unsigned char *data, std::size_t size) : data(data), size(size) {}
+            bool ok = true;
+            std::uint8_t u8() { return static_cast<std::uint8_t>(uint(1)); }
+            std::uint16_t u16() { return static_cast<std::uint16_t>(uint(2)); }
+            std::uint32_t u32() { return static_cast<std::uint32_t>(uint(4)); }
+            std::uint64_t u64() { return uint(8); }
+            double f64()
+            {
+                const std::uint64_t bits = u64();
+                double v;
+                std::memcpy(&v, &bits, sizeof v);
+                return v;
+            }
+            std::string bytes(std::size_t n)
+            {
+                if (!take(n))
+                {
+                    return {};
+                }
+                return std::string(reinterpret_cast<const char *>(data + pos - n), n);
+            }
+            bool done() const { return ok && pos == size; }
+
+        private:
+            const unsigned char *data;
+            std::size_t size;
+            std::size_t pos = 0;
+            bool take(std::size_t n)
+            {
+                if (!ok || size - pos < n)
+                {
+                    ok = false;
+                    return false;
+                }
+                pos += n;
+                return true;
+            }
+            std::uint64_t uint(std::size_t n)
+            {
+                if (!take(n))
+                {
+                    return 0;
+                }
+                std::uint64_t v = 0;
+                for (std::size_t k = 0; k < n; k++)
+                {
+                    v |= static_cast<std::uint64_t>(data[pos - n + k]) << (8 * k);
+                }
+                return v;
+            }
+        };
+    } // namespace detail
+
+    /**
+     * @brief Size of the complete frame at the start of `data`.
+     * @return `std::nullopt` until `size` covers the whole frame; `0` if the length is invalid.
+     */
+    inline std::optional<std::size_t> frame_size(const unsigned char *data, std::size_t size)
+    {
+        if (size < 4)
+        {
+            return std::nullopt;
+        }
+        const std::size_t len = static_cast<std::size_t>(data[0]) | static_cast<std::size_t>(data[1]) << 8 |
+                                static_cast<std::size_t>(data[2]) << 16 | static_cast<std::size_t>(data[3]) << 24;
+        if (len + 4 < header_size || len + 4 > max_frame)
+        {
+            return 0;
+        }
+        if (size < len + 4)
+        {
+            return std::nullopt;
+        }
+        return len + 4;
+    }
+
+    /** @brief Append the frame for `req` to `out`. */
+    inline void encode(const Request &req, std::vector<unsigned char> &out)
+    {
+        detail::Writer w(out);
+        w.u32(req.id);
+        w.u8(static_cast<std::uint8_t>(req.op));
+        switch (req.op)
+        {
+        case Op::Create:
+            w.u32(req.config);
+            break;
+        case Op::Update:
+            w.u64(req.session);
+            w.u32(static_cast<std::uint32_t>(req.response));
+            w.u8(req.n_stim);
+            for (std::size_t i = 0; i < req.n_stim; i++)
+            {
+                w.f64(req.stimulus[i]);
+            }
+            break;
+        default:
+            w.u64(req.session);
+            break;
+        }
+        w.finish();
+    }
+
+    /** @brief Parse one complete request frame (as measured by @ref frame_size). */
+    inline std::optional<Request> decode_request(const unsigned char *frame, std::size_t size)
+    {
+        detail::Reader r(frame, size);
+        r.u32();
+        Request req;
+        req.id = r.u32();
+        req.op = static_cast<Op>(r.u8());
+        switch (req.op)
+        {
+        case Op::Create:
+            req.config = r.u32();
+            break;
+        case Op::Next:
+        case Op::Close:
+            req.session = r.u64();
+            break;
+        case Op::Update:
+            req.session = r.u64();
+            req.response = static_cast<std::int32_t>(r.u32());
+            req.n_stim = r.u8();
+            if (req.n_stim > max_stim_dim)
+            {
+                return std::nullopt;
+            }
+            for (std::size_t i = 0; i < req.n_stim; i++)
+            {
+                req.stimulus[i] = r.f64();
+            }
+            break;
+        default:
+            return std::nullopt;
+        }
+        if (!r.done())
+        {
+            return std::nullopt;
+        }
+        return req;
+    }
+
+    /** @brief Append the frame for `rep` to `out`. */
+    inline void encode(const Reply &rep, std::vector<unsigned char> &out)
+    {
+        detail::Writer w(out);
+        w.u32(rep.id);
+        if (rep.op == Op::Error)
+        {
+            w.u8(static_cast<std::uint8_t>(Op::Error));
+            const std::size_t n = std::min<std::size_t>(rep.error.size(), max_frame - header_size - 2);
+            w.u16(static_cast<std::uint16_t>(n));
+            for (std::size_t i = 0; i < n; i++)
+            {
+                w.u8(static_cast<std::uint8_t>(rep.error[i]));
+            }
+            w.finish();
+            return;
+        }
+        w.u8(static_cast<std::uint8_t>(rep.op) | reply_bit);
+        switch (rep.op)
+        {
+        case Op::Create:
+            w.u64(rep.session);
+            break;
+        case Op::Next:
+            w.u8(rep.n_stim);
+            for (std::size_t i = 0; i < rep.n_stim; i++)
+            {
+                w.f64(rep.stimulus[i]);
+            }
+            break;
+        case Op::Update:
+            w.u8(rep.should_continue);
+            break;
+        default:
+            break;
+        }
+        w.finish();
+    }
+
+    /** @brief Parse one complete reply frame. */
+    inline std::optional<Reply> decode_reply(const unsigned char *frame, std::size_t size)
+    {
+        detail::Reader r(frame, size);
+        r.u32();
+        Reply rep;
+        rep.id = r.u32();
+        const std::uint8_t op = r.u8();
+        if (op == static_cast<std::uint8_t>(Op::Error))
+        {
+            rep.op = Op::Error;
+            rep.error = r.bytes(r.u16());
+            return r.done() ? std::optional<Reply>(rep) : std::nullopt;
+        }
+        rep.op = static_cast<Op>(op & ~reply_bit);
+        if (!(op & reply_bit))
+        {
+            return std::nullopt;
+        }
+        switch (rep.op)
+        {
+        case Op::Create:
+            rep.session = r.u64();
+            break;
+        case Op::Next:
+            rep.n_stim = r.u8();
+            if (rep.n_stim > max_stim_dim)
+            {
+                return std::nullopt;
+            }
+            for (std::size_t i = 0; i < rep.n_stim; i++)
+            {
+                rep.stimulus[i] = r.f64();
+            }
+            break;
+        case Op::Update:
+            rep.should_continue = r.u8() != 0;
+            break;
+        case Op::Close:
+            break;
+        default:
+            return std::nullopt;
+        }
+        if (!r.done())
+        {
+            return std::nullopt;
+        }
+        return rep;
+    }
+} // namespace psydapt::server::protocol
+
+#endif
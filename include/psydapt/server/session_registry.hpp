@@ -0,0 +1,238 @@
+#ifndef PSYDAPT_SERVER_SESSION_REGISTRY_HPP
+#define PSYDAPT_SERVER_SESSION_REGISTRY_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+#include "../../config.hpp"
+#include "../parallel/work_stealing_pool.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::server::SessionRegistry
+ */
+namespace psydapt::server
+{
+    /**
+     * @brief Thread-safe table of running procedures, keyed by session id.
+     *
+     * Procedures are stored in a `std::variant` (as in @ref psydapt::multi::MultiProcedure),
+     * so one registry can hold QUEST+ models, staircases, etc. side by side. The table is
+     * split into shards with their own reader/writer lock, so lookups for different
+     * sessions rarely contend.
+     *
+     * Work for a session goes through post(), which runs jobs on a pool one at a
+     * time and in the order they were posted (a "strand"), so pipelined requests for
+     * one session can't overtake each other while different sessions run in parallel.
+     * Ids are random 64-bit tokens from `std::random_device` (never `0`, and unique
+     * among live sessions), so a client can't reach a session whose id it wasn't given.
+     */
+    template <class... Procedures>
+    class SessionRegistry
+    {
+    public:
+        using procedure_type = std::variant<Procedures...>;
+        using id_type = std::uint64_t;
+
+        /** @param max_sessions Refuse new sessions beyond this many (`0` for no limit). */
+        explicit SessionRegistry(std::size_t max_sessions = 0) : max_sessions(max_sessions) {}
+        SessionRegistry(const SessionRegistry &) = delete;
+        SessionRegistry &operator=(const SessionRegistry &) = delete;
+
+        /** @brief Take ownership of `proc`, returning its id (`0` if the registry is full). */
+        id_type add(procedure_type proc)
+        {
+            if (count.fetch_add(1) >= max_sessions && max_sessions)
+            {
+                count.fetch_sub(1);
+                return 0;
+            }
+            auto session = std::make_shared<Session>(std::move(proc));
+            for (;;)
+            {
+                const id_type id = random_id();
+                auto &shard = shard_of(id);
+                std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                if (id && shard.sessions.emplace(id, session).second)
+                {
+                    return id;
+                }
+            }
+        }
+
+        /** @brief Forget session `id`. Jobs already posted for it still run. */
+        bool remove(id_type id)
+        {
+            auto &shard = shard_of(id);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            if (shard.sessions.erase(id))
+            {
+                count.fetch_sub(1);
+                return true;
+            }
+            return false;
+        }
+
+        /** @brief Number of registered sessions. */
+        std::size_t size() const { return count.load(); }
+
+        /**
+         * @brief Call `f(procedure)` on this thread, exclusive with every other call for `id`.
+         * @return `false` if there is no such session.
+         */
+        template <class F>
+        bool with(id_type id, F &&f)
+        {
+            const auto session = find(id);
+            if (!session)
+            {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(session->mutex);
+            f(session->procedure);
+            return true;
+        }
+
+        /**
+         * @brief Run `job(procedure)` on `pool`, after every job posted earlier for `id`.
+         *
+         * Jobs should report their own errors; an exception escaping one is dropped.
+         * @return `false` if there is no such session (the job is not run).
+         */
+        bool post(id_type id, parallel::WorkStealingPool &pool, std::function<void(procedure_type &)> job)
+        {
+            const auto session = find(id);
+            if (!session)
+            {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(session->strand_mutex);
+            session->jobs.push_back(std::move(job));
+            if (!session->draining)
+            {
+                session->draining = true;
+                schedule(session, pool);
+            }
+            return true;
+        }
+
+    private:
+        struct Session
+        {
+            explicit Session(procedure_type proc) : procedure(std::move(proc)) {}
+            std::mutex mutex; // guards `procedure`
+            procedure_type procedure;
+            std::mutex strand_mutex; // guards `jobs` and `draining`
+            std::deque<std::function<void(procedure_type &)>> jobs;
+            bool draining = false; // a pool task owns the front of `jobs`
+        };
+        struct Shard
+        {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<id_type, std::shared_ptr<Session>> sessions;
+        };
+        static constexpr std::size_t n_shards = 16;
+
+        std::array<Shard, n_shards> shards;
+        std::random_device entropy;
+        std::mutex entropy_mutex; // std::random_device isn't safe to call concurrently
+        std::atomic<std::size_t> count{0};
+        const std::size_t max_sessions;
+
+        Shard &shard_of(id_type id) { return shards[id % n_shards]; }
+
+        id_type random_id()
+        {
+            std::lock_guard<std::mutex> lock(entropy_mutex);
+            id_type id = 0;
+            for (std::size_t bits = 0; bits < 64; bits += 32)
+            {
+                id = id << 32 | static_cast<std::uint32_t>(entropy());
+            }
+            return id;
+        }
+
+        std::shared_ptr<Session> find(id_type id)
+        {
+            auto &shard = shard_of(id);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            const auto it = shard.sessions.find(id);
+            return it == shard.sessions.end() ? nullptr : it->second;
+        }
+
+        // one job per pool task, then requeue behind the waiting work, so a busy session can't hog a worker
+        static void schedule(std::shared_ptr<Session> session, parallel::WorkStealingPool &pool, bool requeue = false)
+        {
+            auto task = [session, &pool]
+            {
+                std::function<void(procedure_type &)> job;
+                {
+                    std::lock_guard<std::mutex> lock(session->strand_mutex);
+                    job = std::move(session->jobs.front());
+                    session->jobs.pop_front();
+                }
+                {
+                    std::lock_guard<std::mutex> lock(session->mutex);
+#if defined(PSYDAPT_DISABLE_EXCEPTIONS)
+                    job(session->procedure);
+#else
+                    try
+                    {
+                        job(session->procedure);
+                    }
+                    catch (...)
+                    {
+                    }
+#endif
+                }
+                std::lock_guard<std::mutex> lock(session->strand_mutex);
+                if (session->jobs.empty())
+                {
+                    session->draining = false;
+                }
+                else
+                {
+                    schedule(session, pool, true);
+                }
+            };
+            if (requeue)
+            {
+                pool.defer(std::move(task));
+            }
+            else
+            {
+                pool.post(std::move(task));
+            }
+        }
+    };
+} // namespace psydapt::server
+
+#endif
@@ -0,0 +1,398 @@
+#ifndef PSYDAPT_SERVER_UNIX_SERVER_HPP
+#define PSYDAPT_SERVER_UNIX_SERVER_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../../config.hpp"
+#include "../parallel/work_stealing_pool.hpp"
+#include "protocol.hpp"
+#include "session_registry.hpp"
+
+/** @file
+ * @brief Class @ref psydapt::server::UnixServer
+ */
+namespace psydapt::server
+{
+    struct ServerParams
+    {
+        unsigned int n_threads = 0;      /// Pool workers running next()/update() (`0` for all cores).
+        std::size_t max_sessions = 0;    /// Refuse `Create` beyond this many live sessions (`0` for no limit).
+        int backlog = 64;                /// Pending connections queued by listen().
+        unsigned int socket_mode = 0600; /// Permissions of the socket file (the default admits only its owner).
+    };
+
+    /**
+     * @brief Serves procedures to local clients over a Unix-domain socket (POSIX only).
+     *
+     * One thread accepts connections and reads request frames (see protocol.hpp);
+     * each request runs on a @ref parallel::WorkStealingPool, queued on its session's
+     * strand in the @ref SessionRegistry, and the worker writes the reply. A client
+     * may pipeline requests for many sessions on one connection.
+     *
+     * Sessions are created by `factory` from the config number in a `Create`
+     * request; returning `std::nullopt` refuses it (e.g. after checking a model's
+     * `estimate_cost()`). Sessions outlive connections until closed. Replies are
+     * written by pool workers with blocking sends, so a client that stops reading
+     * stalls the worker serving it, but never the thread reading requests.
+     *
+     * The socket file is created with `ServerParams::socket_mode` (owner-only by
+     * default), and session ids are random tokens (see @ref SessionRegistry), so
+     * other local users can neither connect nor guess someone else's session.
+     */
+    template <class... Procedures>
+    class UnixServer
+    {
+    public:
+        using registry_type = SessionRegistry<Procedures...>;
+        using procedure_type = typename registry_type::procedure_type;
+        using factory_type = std::function<std::optional<procedure_type>(std::uint32_t config)>;
+
+        /** @brief Bind `path` and start serving (an existing socket at `path` is replaced). */
+        UnixServer(std::string path, factory_type factory, const ServerParams &params = ServerParams{})
+            : path(std::move(path)), factory(std::move(factory)), registry(params.max_sessions),
+              pool(std::make_unique<parallel::WorkStealingPool>(params.n_threads))
+        {
+            sockaddr_un addr{};
+            if (this->path.size() >= sizeof(addr.sun_path))
+            {
+                PSYDAPT_THROW(std::invalid_argument, "The socket path is too long.");
+            }
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, this->path.c_str(), this->path.size() + 1);
+            struct stat st;
+            if (::stat(this->path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            {
+                ::unlink(this->path.c_str());
+            }
+            listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            // restrict the socket before listen(), so no one else can connect in between
+            if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+                ::chmod(this->path.c_str(), static_cast<mode_t>(params.socket_mode)) < 0 ||
+                ::listen(listen_fd, params.backlog) < 0 || ::pipe(wake) < 0)
+            {
+                if (listen_fd >= 0)
+                {
+                    ::close(listen_fd);
+                }
+                PSYDAPT_THROW(std::runtime_error, "Couldn't listen on the socket path.");
+            }
+            ::fcntl(listen_fd, F_SETFL, ::fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+            loop_thread = std::thread([this]
+                                      { loop(); });
+        }
+        UnixServer(const UnixServer &) = delete;
+        UnixServer &operator=(const UnixServer &) = delete;
+        ~UnixServer() { stop(); }
+
+        /** @brief Stop accepting and reading, finish queued requests, and remove the socket. */
+        void stop()
+        {
+            if (!loop_thread.joinable())
+            {
+                return;
+            }
+            const char c = 0;
+            while (::write(wake[1], &c, 1) < 0 && errno == EINTR)
+            {
+            }
+            loop_thread.join();
+            pool.reset(); // runs what's queued, while the registry is still alive
+            ::close(listen_fd);
+            ::close(wake[0]);
+            ::close(wake[1]);
+            ::unlink(path.c_str());
+        }
+
+        /** @brief The live sessions. */
+        registry_type &sessions() { return registry; }
+
+    private:
+        struct Connection
+        {
+            explicit Connection(int fd) : fd(fd) {}
+            ~Connection() { ::close(fd); }
+            const int fd;
+            std::vector<unsigned char> in; // unparsed bytes (loop thread only)
+            std::mutex write_mutex;
+
+            void send(const protocol::Reply &rep)
+            {
+                std::vector<unsigned char> out;
+                protocol::encode(rep, out);
+                std::lock_guard<std::mutex> lock(write_mutex);
+                std::size_t sent = 0;
+                while (sent < out.size())
+                {
+                    const ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (n <= 0)
+                    {
+                        return; // the client is gone; its reads will fail too
+                    }
+                    sent += static_cast<std::size_t>(n);
+                }
+            }
+        };
+
+        const std::string path;
+        const factory_type factory;
+        registry_type registry;
+        std::unique_ptr<parallel::WorkStealingPool> pool;
+        int listen_fd = -1;
+        int wake[2] = {-1, -1}; // written by stop() to end loop()
+        std::thread loop_thread;
+
+        static protocol::Reply error(std::uint32_t id, std::string message)
+        {
+            protocol::Reply rep;
+            rep.id = id;
+            rep.op = protocol::Op::Error;
+            rep.error = std::move(message);
+            return rep;
+        }
+
+        void loop()
+        {
+            std::vector<std::shared_ptr<Connection>> conns;
+            std::vector<pollfd> fds;
+            unsigned char buf[4096];
+            for (;;)
+            {
+                fds.assign({{wake[0], POLLIN, 0}, {listen_fd, POLLIN, 0}});
+                for (const auto &c : conns)
+                {
+                    fds.push_back({c->fd, POLLIN, 0});
+                }
+                if (::poll(fds.data(), fds.size(), -1) < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return;
+                }
+                if (fds[0].revents)
+                {
+                    return;
+                }
+                if (fds[1].revents & POLLIN)
+                {
+                    for (int fd; (fd = ::accept(listen_fd, nullptr, nullptr)) >= 0;)
+                    {
+                        conns.push_back(std::make_shared<Connection>(fd));
+                    }
+                }
+                // walk backwards so closed connections can be erased in place
+                for (std::size_t k = fds.size() - 1; k >= 2; k--)
+                {
+                    if (!fds[k].revents)
+                    {
+                        continue;
+                    }
+                    auto &conn = conns[k - 2];
+                    const ssize_t n = ::read(conn->fd, buf, sizeof(buf));
+                    if ((n < 0 && errno == EINTR) || (n > 0 && consume(conn, buf, static_cast<std::size_t>(n))))
+                    {
+                        continue;
+                    }
+                    // EOF, error, or a malformed frame: drop the connection (queued replies still go out)
+                    ::shutdown(conn->fd, SHUT_RD);
+                    conns.erase(conns.begin() + static_cast<std::ptrdiff_t>(k - 2));
+                }
+            }
+        }
+
+        // append `n` bytes from the socket and dispatch every complete frame; false on a protocol error
+        bool consume(const std::shared_ptr<Connection> &conn, const unsigned char *data, std::size_t n)
+        {
+            auto &in = conn->in;
+            in.insert(in.end(), data, data + n);
+            std::size_t pos = 0;
+            bool ok = true;
+            while (ok)
+            {
+                const auto size = protocol::frame_size(in.data() + pos, in.size() - pos);
+                if (!size)
+                {
+                    break;
+                }
+                const auto req = *size ? protocol::decode_request(in.data() + pos, *size) : std::nullopt;
+                if (!req)
+                {
+                    ok = false;
+                    break;
+                }
+                dispatch(conn, *req);
+                pos += *size;
+            }
+            in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(pos));
+            return ok;
+        }
+
+        void dispatch(const std::shared_ptr<Connection> &conn, const protocol::Request &req)
+        {
+            if (req.op == protocol::Op::Create)
+            {
+                pool->post([this, conn, req]
+                           { create(*conn, req); });
+                return;
+            }
+            const bool found = registry.post(req.session, *pool, [this, conn, req](procedure_type &proc)
+                                             { conn->send(run(proc, req)); });
+            if (!found)
+            {
+                // not from this thread: a blocking send to a slow client would stall every connection
+                pool->post([conn, id = req.id]
+                           { conn->send(error(id, "Unknown session.")); });
+            }
+        }
+
+        void create(Connection &conn, const protocol::Request &req)
+        {
+            protocol::Reply rep;
+            rep.id = req.id;
+            rep.op = protocol::Op::Create;
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            try
+            {
+#endif
+                auto proc = factory(req.config);
+                if (!proc)
+                {
+                    conn.send(error(req.id, "Unknown or refused config."));
+                    return;
+                }
+                rep.session = registry.add(std::move(*proc));
+                if (!rep.session)
+                {
+                    conn.send(error(req.id, "Too many sessions."));
+                    return;
+                }
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            }
+            catch (const std::exception &e)
+            {
+                conn.send(error(req.id, e.what()));
+                return;
+            }
+#endif
+            conn.send(rep);
+        }
+
+        // a Next, Update or Close request, on the session's strand
+        protocol::Reply run(procedure_type &proc, const protocol::Request &req)
+        {
+            protocol::Reply rep;
+            rep.id = req.id;
+            rep.op = req.op;
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            try
+            {
+#endif
+                if (req.op == protocol::Op::Close)
+                {
+                    registry.remove(req.session);
+                    return rep;
+                }
+                std::optional<protocol::Reply> err;
+                std::visit([&](auto &p)
+                           {
+                               using stim_type = std::decay_t<decltype(p.next())>;
+                               constexpr std::size_t dim = std::is_scalar_v<stim_type> ? 1 : sizeof(stim_type) / sizeof(double);
+                               static_assert(dim <= protocol::max_stim_dim, "The stimulus doesn't fit in a frame.");
+                               if (req.op == protocol::Op::Next)
+                               {
+                                   const stim_type s = p.next();
+                                   rep.n_stim = static_cast<std::uint8_t>(dim);
+                                   if constexpr (std::is_scalar_v<stim_type>)
+                                   {
+                                       rep.stimulus[0] = s;
+                                   }
+                                   else
+                                   {
+                                       std::copy(s.begin(), s.end(), rep.stimulus.begin());
+                                   }
+                                   return;
+                               }
+                               std::optional<stim_type> s;
+                               if (req.n_stim)
+                               {
+                                   if (req.n_stim != dim)
+                                   {
+                                       err = error(req.id, "The stimulus has the wrong number of values.");
+                                       return;
+                                   }
+                                   if constexpr (std::is_scalar_v<stim_type>)
+                                   {
+                                       s = req.stimulus[0];
+                                   }
+                                   else
+                                   {
+                                       s.emplace();
+                                       std::copy_n(req.stimulus.begin(), dim, s->begin());
+                                   }
+                               }
+                               rep.should_continue = p.update(req.response, s);
+                           },
+                           proc);
+                if (err)
+                {
+                    return *err;
+                }
+#if !defined(PSYDAPT_DISABLE_EXCEPTIONS)
+            }
+            catch (const std::exception &e)
+            {
+                return error(req.id, e.what());
+            }
+#endif
+            return rep;
+        }
+    };
+} // namespace psydapt::server
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef PSYDAPT_SIMULATION_HPP
+#define PSYDAPT_SIMULATION_HPP
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../../config.hpp"
+#include "../base.hpp"
+#include "../psychometric.hpp"
+#include "../parallel/thread_pool.hpp"
+
+/** @file
+ * @brief Functions @ref psydapt::simulation::simulate, @ref psydapt::simulation::posterior_mean, class @ref psydapt::simulation::CounterRng
+ *
+ * Monte Carlo evaluation of adaptive procedures against simulated observers.
+ */
+namespace psydapt::simulation
+{
+    /**
+     * @brief Counter-based random bit generator.
+     *
+     * Each output is a pure function of `(key, counter)`, so a session's stream depends
+     * only on the master seed and the session index, never on thread scheduling.
+     * Satisfies UniformRandomBitGenerator, so it can be handed to `<random>` distributions.
+     */
+    class CounterRng
+    {
+    public:
+        using result_type = std::uint64_t;
+        CounterRng(std::uint64_t seed, std::uint64_t stream) : key(mix(seed ^ mix(stream + golden))) {}
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+        result_type operator()() { return mix(key + golden * ++counter); }
+        /** @brief Uniform double on [0, 1) with 53 bits of precision. */
+        double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+    private:
+        static constexpr std::uint64_t golden = 0x9e3779b97f4a7c15ULL;
+        std::uint64_t key;
+        std::uint64_t counter = 0;
+
+        // SplitMix64 finalizer
+        static constexpr std::uint64_t mix(std::uint64_t z)
+        {
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+    };
+
+    struct Settings
+    {
+        std::size_t n_sessions = 1000;   /// Number of independent simulated sessions.
+        std::size_t n_trials = 50;       /// Maximum trials per session (sessions may stop early).
+        unsigned int n_threads = 0;      /// Threads running sessions, including the caller (`0` for hardware concurrency).
+        std::uint64_t seed = 1;          /// Master seed; session `i` uses stream `i`.
+        double target = 0;               /// True value of the quantity being estimated (e.g. threshold).
+        double tolerance = 1;            /// Estimate must stay within `target ± tolerance` to meet criterion.
+    };
+
+    struct SessionResult
+    {
+        double estimate;                                 /// Estimate after the final trial.
+        std::size_t n_trials;                            /// Trials actually run.
+        std::optional<std::size_t> trials_to_criterion; /// First trial after which the estimate stayed within tolerance.
+    };
+
+    struct Summary
+    {
+        double mean;                      /// Mean of the final estimates.
+        double bias;                      /// `mean - target`.
+        double variance;                  /// Sample variance of the final estimates.
+        double rmse;                      /// Root mean squared error against `target`.
+        std::size_t n_converged;          /// Sessions that met the criterion.
+        double mean_trials_to_criterion;  /// Mean over converged sessions (NaN if none converged).
+        std::vector<SessionResult> sessions; /// Per-session results, in session order.
+    };
+
+    /** @brief Standard Weibull observer, matching @ref psydapt::questplus::Weibull's parameterisation. */
+    inline std::function<double(double)> weibull_observer(double threshold, double slope, double lower_asymptote,
+                                                          double lapse_rate, Scale scale = Scale::Log10)
+    {
+        return [=](double x)
+        { return psychometric::weibull(x, threshold, slope, lower_asymptote, lapse_rate, scale); };
+    }
+
+    namespace detail
+    {
+        template <class Procedure>
+        using stim_t = std::decay_t<decltype(std::declval<Procedure &>().next())>;
+
+        // so that simulate() deduces the procedure from the prototype alone, and takes plain functions as estimators
+        template <class Procedure>
+        struct estimator
+        {
+            using type = std::function<double(Procedure &, const stim_t<Procedure> &)>;
+        };
+
+        template <class Procedure, class = void>
+        struct has_fork : std::false_type
+        {
+        };
+        template <class Procedure>
+        struct has_fork<Procedure, std::void_t<decltype(std::declval<const Procedure &>().fork())>> : std::true_type
+        {
+        };
+
+        template <class Procedure, class = void>
+        struct has_set_sink : std::false_type
+        {
+        };
+        template <class Procedure>
+        struct has_set_sink<Procedure, std::void_t<decltype(std::declval<Procedure &>().set_sink(nullptr))>> : std::true_type
+        {
+        };
+
+        template <class Procedure, class = void>
+        struct has_mean : std::false_type
+        {
+        };
+        template <class Procedure>
+        struct has_mean<Procedure, std::void_t<decltype(std::declval<const Procedure &>().mean())>> : std::true_type
+        {
+        };
+
+        template <class Procedure, class = void>
+        struct has_posterior_grid : std::false_type
+        {
+        };
+        template <class Procedure>
+        struct has_posterior_grid<Procedure, std::void_t<decltype(std::declval<const Procedure &>().get_posterior()),
+                                                         decltype(std::declval<const Procedure &>().parameter_cell(0))>>
+            : std::true_type
+        {
+        };
+
+        // fork() where available (QUEST+), which shares the big tables and skips copying scratch;
+        // either way the session has no sink, since sessions run concurrently and sinks may be single-producer
+        template <class Procedure>
+        Procedure start_session(const Procedure &prototype)
+        {
+            if constexpr (has_fork<Procedure>::value)
+            {
+                return prototype.fork();
+            }
+            else
+            {
+                Procedure proc = prototype;
+                if constexpr (has_set_sink<Procedure>::value)
+                {
+                    proc.set_sink(nullptr);
+                }
+                return proc;
+            }
+        }
+    }
+
+    /**
+     * @brief Posterior mean of parameter `axis` (the threshold, for the bundled models).
+     *
+     * Works with any procedure that keeps a posterior: a QUEST+ grid (via `get_posterior()`
+     * and `parameter_cell()`), or anything with a `mean()` (QUEST, the particle filter).
+     * A staircase has no posterior, so this doesn't compile for one.
+     */
+    template <class Procedure>
+    double posterior_mean(const Procedure &proc, std::size_t axis = 0)
+    {
+        if constexpr (detail::has_posterior_grid<Procedure>::value)
+        {
+            const auto &post = proc.get_posterior();
+            double sum = 0;
+            for (std::size_t i = 0; i < post.size(); i++)
+            {
+                sum += post.data()[i] * proc.parameter_cell(i)[axis];
+            }
+            return sum;
+        }
+        else
+        {
+            static_assert(detail::has_mean<Procedure>::value, "posterior_mean needs a procedure with a posterior.");
+            if constexpr (std::is_scalar_v<std::decay_t<decltype(proc.mean())>>)
+            {
+                if (axis != 0)
+                {
+                    PSYDAPT_THROW(std::out_of_range, "This procedure estimates a single parameter.");
+                }
+                return proc.mean();
+            }
+            else
+            {
+                return proc.mean()[axis];
+            }
+        }
+    }
+
+    /**
+     * @brief Run many independent sessions of a procedure against a simulated observer.
+     *
+     * @param prototype Fully-constructed procedure. Each session starts from a copy (a
+     *        `fork()` where the procedure has one), so prior and likelihood tables are
+     *        computed once rather than per session. Sessions don't inherit its trial sink.
+     * @param observer Ground truth: probability of a `1` response for a given stimulus.
+     * @param settings Simulation settings.
+     * @param estimator Extracts the session's running estimate given the procedure and the
+     *        stimulus it just proposed. Defaults to @ref posterior_mean of the first parameter
+     *        for procedures that have a posterior; a staircase needs one passed explicitly.
+     */
+    template <class Procedure>
+    Summary simulate(const Procedure &prototype,
+                     const std::function<double(const detail::stim_t<Procedure> &)> &observer,
+                     const Settings &settings,
+                     typename detail::estimator<Procedure>::type estimator = nullptr)
+    {
+        using stim_type = detail::stim_t<Procedure>;
+        if (settings.n_sessions == 0)
+        {
+            PSYDAPT_THROW(std::invalid_argument, "At least one session is required.");
+        }
+        if (!estimator)
+        {
+            if constexpr (detail::has_posterior_grid<Procedure>::value || detail::has_mean<Procedure>::value)
+            {
+                estimator = [](Procedure &proc, const stim_type &)
+                { return posterior_mean(proc); };
+            }
+            else
+            {
+                PSYDAPT_THROW(std::invalid_argument, "An estimator is required for procedures without a posterior.");
+            }
+        }
+
+        Summary out{};
+        out.sessions.resize(settings.n_sessions);
+        const auto run_session = [&](std::size_t session)
+        {
+            CounterRng rng{settings.seed, session};
+            Procedure proc = detail::start_session(prototype);
+            std::vector<double> estimates;
+            estimates.reserve(settings.n_trials + 1);
+            std::size_t trial = 0;
+            bool cont = true;
+            while (cont && trial < settings.n_trials)
+            {
+                const stim_type x = proc.next();
+                estimates.push_back(estimator(proc, x));
+                cont = proc.update(rng.uniform() < observer(x) ? 1 : 0);
+                trial++;
+            }
+            if (cont)
+            {
+                // one more proposal, which incorporates the final response
+                const stim_type x = proc.next();
+                estimates.push_back(estimator(proc, x));
+            }
+            // scan backwards for the start of the final run within tolerance
+            std::size_t first_ok = estimates.size();
+            while (first_ok > 0 &&
+                   std::abs(estimates[first_ok - 1] - settings.target) <= settings.tolerance)
+            {
+                first_ok--;
+            }
+            auto &res = out.sessions[session];
+            res.estimate = estimates.back();
+            res.n_trials = trial;
+            if (first_ok < estimates.size())
+            {
+                // estimates[k] reflects k completed trials
+                res.trials_to_criterion = first_ok;
+            }
+        };
+        if (settings.n_threads == 1)
+        {
+            for (std::size_t session = 0; session < settings.n_sessions; session++)
+            {
+                run_session(session);
+            }
+        }
+        else
+        {
+            // the calling thread works too
+            parallel::ThreadPool pool{settings.n_threads == 0 ? 0 : settings.n_threads - 1};
+            pool.parallel_for(settings.n_sessions, run_session);
+        }
+
+        const double n = static_cast<double>(settings.n_sessions);
+        double sum = 0, sum_sq_err = 0, sum_ttc = 0;
+        for (const auto &res : out.sessions)
+        {
+            sum += res.estimate;
+            sum_sq_err += (res.estimate - settings.target) * (res.estimate - settings.target);
+            if (res.trials_to_criterion)
+            {
+                out.n_converged++;
+                sum_ttc += static_cast<double>(*res.trials_to_criterion);
+            }
+        }
+        out.mean = sum / n;
+        out.bias = out.mean - settings.target;
+        double ss = 0;
+        for (const auto &res : out.sessions)
+        {
+            ss += (res.estimate - out.mean) * (res.estimate - out.mean);
+        }
+        out.variance = settings.n_sessions > 1 ? ss / (n - 1) : 0;
+        out.rmse = std::sqrt(sum_sq_err / n);
+        out.mean_trials_to_criterion = out.n_converged ? sum_ttc / out.n_converged
+                                                       : std::numeric_limits<double>::quiet_NaN();
+        return out;
+    }
+} // namespace psydapt::simulation
+
+#endif
@@ -62,6 +62,7 @@ namespace psydapt::staircase
             // reserve 10x the number of expected trials (arbitrary)
             response_history.reserve(10 * settings.n_trials);
             stimulus_history.reserve(10 * settings.n_trials);
+            snapshots.reserve(10 * settings.n_trials);
             // handle n_reversals (default is 1)
             if (!params.n_reversals)
             {
@@ -165,6 +166,8 @@ namespace psydapt::staircase
             // update history of stimulus/response
             // if the user provides an stimulus value, use that
             // otherwise, fill in the last generated one
+            snapshots.push_back({trial_count, reversal_count, correct_count, current_direction,
+                                 step_size, next_stimulus, should_continue});
             stimulus_history.push_back(stimulus ? *stimulus : next_stimulus);
             response_history.push_back(response);
 
@@ -191,6 +194,7 @@ namespace psydapt::staircase
                 }
             }
 
+            log_trial(stimulus_history.back(), response);
             // check termination condition, and return false if we should stop
             trial_count++;
             if (reversal_count >= settings.n_reversals && stimulus_history.size() >= settings.n_trials)
@@ -200,7 +204,71 @@ namespace psydapt::staircase
             return should_continue;
         }
 
+        /**
+         * @brief Apply many trials at once, as if next() were called before each trial after the first.
+         *
+         * Replaying a session's own responses and stimuli therefore reproduces its state.
+         * Stops at the first trial after which the staircase is finished; later trials are not applied.
+         * @return Whether to continue the procedure.
+         */
+        bool update_many(const std::vector<int> &responses, const std::vector<double> &stimuli)
+        {
+            if (responses.size() != stimuli.size())
+            {
+                PSYDAPT_THROW(std::invalid_argument, "There must be one stimulus per response.");
+            }
+            for (std::size_t t = 0; t < responses.size(); t++)
+            {
+                if (t > 0)
+                {
+                    next();
+                }
+                if (!update(responses[t], stimuli[t]))
+                {
+                    return false;
+                }
+            }
+            return should_continue;
+        }
+
+        /** @brief Revert the most recent update() (and any next() since); call again to go further back.
+         *
+         * Restores the staircase state from just before that update(), so the next update()
+         * without an explicit stimulus applies to the value next() returned for the undone trial.
+         */
+        void undo()
+        {
+            if (snapshots.empty())
+            {
+                PSYDAPT_THROW(std::runtime_error, "There is no trial to undo.");
+            }
+            const auto &snap = snapshots.back();
+            trial_count = snap.trial_count;
+            reversal_count = snap.reversal_count;
+            correct_count = snap.correct_count;
+            current_direction = snap.current_direction;
+            step_size = snap.step_size;
+            next_stimulus = snap.next_stimulus;
+            should_continue = snap.should_continue;
+            snapshots.pop_back();
+            stimulus_history.pop_back();
+            response_history.pop_back();
+            trial_index--;
+        }
+
     private:
+        // state at the start of each update(), for undo()
+        struct Snapshot
+        {
+            unsigned int trial_count;
+            unsigned int reversal_count;
+            int correct_count;
+            int current_direction;
+            double step_size;
+            double next_stimulus;
+            bool should_continue;
+        };
+        std::vector<Snapshot> snapshots;
         unsigned int trial_count = 0;
         unsigned int reversal_count = 0; // use this rather than tracking the reversal intensities
         int correct_count = 0;           //
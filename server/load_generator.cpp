@@ -0,0 +1,312 @@
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Closed-loop load generator for psydapt_server. Usage:
+//   psydapt_loadgen <socket path> [config] [trials per session] [connections] [session counts...]
+// For each session count, opens the sessions spread over the connections, then keeps
+// every session busy: Next, then Update with a random response as soon as the stimulus
+// arrives, for the given number of trials. Prints request latency percentiles and
+// throughput per session count.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "psydapt/server/protocol.hpp"
+
+using namespace psydapt::server;
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+    class Client
+    {
+    public:
+        explicit Client(const std::string &path)
+        {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+            {
+                throw std::runtime_error("Couldn't connect to " + path);
+            }
+        }
+        ~Client() { ::close(fd); }
+
+        void send(const protocol::Request &req)
+        {
+            out.clear();
+            protocol::encode(req, out);
+            std::size_t sent = 0;
+            while (sent < out.size())
+            {
+                const ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    throw std::runtime_error("The server closed the connection.");
+                }
+                sent += static_cast<std::size_t>(n);
+            }
+        }
+
+        protocol::Reply receive()
+        {
+            for (;;)
+            {
+                const auto size = protocol::frame_size(in.data() + pos, in.size() - pos);
+                if (size && *size)
+                {
+                    const auto rep = protocol::decode_reply(in.data() + pos, *size);
+                    pos += *size;
+                    if (!rep)
+                    {
+                        throw std::runtime_error("Malformed reply.");
+                    }
+                    return *rep;
+                }
+                if (size)
+                {
+                    throw std::runtime_error("Malformed reply.");
+                }
+                in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(pos));
+                pos = 0;
+                unsigned char buf[4096];
+                const ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    throw std::runtime_error("The server closed the connection.");
+                }
+                in.insert(in.end(), buf, buf + n);
+            }
+        }
+
+    private:
+        int fd = -1;
+        std::vector<unsigned char> out, in;
+        std::size_t pos = 0;
+    };
+
+    struct Result
+    {
+        std::vector<double> latency_us;
+        std::size_t errors = 0;
+    };
+
+    // one connection's share of the sessions, driven until each has run `trials` trials
+    void drive(const std::string &path, std::uint32_t config, std::size_t n_sessions, std::size_t trials,
+               unsigned int seed, Result &result)
+    {
+        Client client(path);
+        std::mt19937 rng(seed);
+        std::uint32_t next_id = 1;
+        std::unordered_map<std::uint32_t, std::pair<clock_type::time_point, std::size_t>> in_flight; // id -> (sent, session slot)
+        std::vector<std::uint64_t> sessions(n_sessions);
+        std::vector<std::size_t> done(n_sessions, 0);
+        const auto request = [&](protocol::Request req, std::size_t slot)
+        {
+            req.id = next_id++;
+            in_flight[req.id] = {clock_type::now(), slot};
+            client.send(req);
+        };
+
+        for (std::size_t k = 0; k < n_sessions; k++)
+        {
+            protocol::Request req;
+            req.op = protocol::Op::Create;
+            req.config = config;
+            request(req, k);
+        }
+        std::size_t pending = n_sessions;
+        while (pending)
+        {
+            const auto rep = client.receive();
+            const auto it = in_flight.find(rep.id);
+            if (it == in_flight.end())
+            {
+                throw std::runtime_error("Reply to an unknown request.");
+            }
+            const std::size_t slot = it->second.second;
+            in_flight.erase(it);
+            if (rep.op == protocol::Op::Error)
+            {
+                throw std::runtime_error("Create failed: " + rep.error);
+            }
+            sessions[slot] = rep.session;
+            pending--;
+        }
+
+        // closed loop: every session has exactly one request outstanding until it's done
+        for (std::size_t k = 0; k < n_sessions; k++)
+        {
+            protocol::Request req;
+            req.op = protocol::Op::Next;
+            req.session = sessions[k];
+            request(req, k);
+        }
+        pending = n_sessions;
+        result.latency_us.reserve(2 * n_sessions * trials);
+        while (pending)
+        {
+            const auto rep = client.receive();
+            const auto now = clock_type::now();
+            if (rep.op == protocol::Op::Close)
+            {
+                continue;
+            }
+            const auto it = in_flight.find(rep.id);
+            if (it == in_flight.end())
+            {
+                throw std::runtime_error("Reply to an unknown request.");
+            }
+            const auto [sent, slot] = it->second;
+            in_flight.erase(it);
+            result.latency_us.push_back(std::chrono::duration<double, std::micro>(now - sent).count());
+            protocol::Request req;
+            req.session = sessions[slot];
+            if (rep.op == protocol::Op::Error)
+            {
+                result.errors++;
+            }
+            if (rep.op == protocol::Op::Next)
+            {
+                req.op = protocol::Op::Update;
+                req.response = static_cast<std::int32_t>(rng() % 2);
+                request(req, slot);
+            }
+            else if (++done[slot] < trials)
+            {
+                req.op = protocol::Op::Next;
+                request(req, slot);
+            }
+            else
+            {
+                req.op = protocol::Op::Close;
+                req.id = next_id++;
+                client.send(req); // not timed
+                pending--;
+            }
+        }
+    }
+
+    double percentile(std::vector<double> &v, double q)
+    {
+        if (v.empty())
+        {
+            return 0;
+        }
+        const std::size_t k = std::min(v.size() - 1, static_cast<std::size_t>(q * static_cast<double>(v.size())));
+        std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(k), v.end());
+        return v[k];
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <socket path> [config] [trials per session] [connections] [session counts...]\n", argv[0]);
+        return 1;
+    }
+    const std::string path = argv[1];
+    const auto config = static_cast<std::uint32_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0);
+    const std::size_t trials = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 20;
+    const std::size_t n_conn = std::max<std::size_t>(1, argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 4);
+    std::vector<std::size_t> counts;
+    for (int i = 5; i < argc; i++)
+    {
+        counts.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+    if (counts.empty())
+    {
+        counts = {1, 4, 16, 64, 256};
+    }
+
+    std::printf("%10s %10s %12s %12s %12s %14s\n", "sessions", "requests", "p50 (us)", "p99 (us)", "max (us)", "requests/s");
+    for (const std::size_t n : counts)
+    {
+        const std::size_t conns = std::min(n_conn, std::max<std::size_t>(n, 1));
+        std::vector<Result> results(conns);
+        std::vector<std::thread> threads;
+        const auto start = clock_type::now();
+        for (std::size_t c = 0; c < conns; c++)
+        {
+            // spread the sessions as evenly as possible
+            const std::size_t share = n / conns + (c < n % conns);
+            threads.emplace_back([&, c, share]
+                                 {
+                                     try
+                                     {
+                                         drive(path, config, share, trials, static_cast<unsigned int>(c + 1), results[c]);
+                                     }
+                                     catch (const std::exception &e)
+                                     {
+                                         std::fprintf(stderr, "connection %zu: %s\n", c, e.what());
+                                         results[c].errors++;
+                                     }
+                                 });
+        }
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        const double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        std::vector<double> all;
+        std::size_t errors = 0;
+        for (auto &r : results)
+        {
+            all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+            errors += r.errors;
+        }
+        const std::size_t n_req = all.size();
+        const double p50 = percentile(all, 0.5);
+        const double p99 = percentile(all, 0.99);
+        const double max = all.empty() ? 0 : *std::max_element(all.begin(), all.end());
+        std::printf("%10zu %10zu %12.1f %12.1f %12.1f %14.0f\n", n, n_req, p50, p99, max, static_cast<double>(n_req) / seconds);
+        if (errors)
+        {
+            std::printf("  (%zu errors)\n", errors);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+This file is part of psydapt.
+
+Copyright © 2021 Alexander Forrence <alex.forrence@gmail.com>
+
+psydapt is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+psydapt is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with psydapt.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Reference session server. Usage:
+//   psydapt_server <socket path> [n_threads] [max_sessions] [max_bytes_per_session]
+// Configs (the `Create` request's number):
+//   0: Weibull (dB, 41 intensities x 41 thresholds x 3 slopes x 3 lapse rates)
+//   1: CSF (26 contrasts x 21 spatial freqs; 11 x 11 x 5 parameter grid)
+//   2: 1-up/3-down staircase
+// Runs until SIGINT or SIGTERM.
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+
+#include "psydapt/questplus/csf.hpp"
+#include "psydapt/questplus/weibull.hpp"
+#include "psydapt/server/unix_server.hpp"
+#include "psydapt/staircase/staircase.hpp"
+
+using namespace psydapt;
+using Server = server::UnixServer<questplus::Weibull, questplus::CSF, staircase::Staircase>;
+
+static std::vector<double> range(double start, double stop, double step)
+{
+    std::vector<double> out;
+    for (double x = start; x <= stop + 1e-9; x += step)
+    {
+        out.push_back(x);
+    }
+    return out;
+}
+
+static questplus::Weibull::Params weibull_params()
+{
+    questplus::Weibull::Params p;
+    p.intensity = range(-40, 0, 1);
+    p.threshold = p.intensity;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.01, 0.02, 0.05};
+    p.stim_scale = Scale::dB;
+    return p;
+}
+
+static questplus::CSF::Params csf_params()
+{
+    questplus::CSF::Params p;
+    p.contrast = range(-50, 0, 2);
+    p.spatial_freq = range(0, 40, 2);
+    p.temporal_freq = {0};
+    p.min_thresh = range(-50, -30, 2);
+    p.c0 = range(-60, -40, 2);
+    p.cf = {0.8, 1., 1.2, 1.4, 1.6};
+    p.cw = {0};
+    p.slope = {3};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.01};
+    p.stim_scale = Scale::dB;
+    return p;
+}
+
+static staircase::Staircase::Params staircase_params()
+{
+    staircase::Staircase::Params p;
+    p.start_val = 0;
+    p.step_sizes = {8, 4, 2};
+    p.n_trials = 50;
+    p.n_up = 1;
+    p.n_down = 3;
+    p.apply_initial_rule = true;
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <socket path> [n_threads] [max_sessions] [max_bytes_per_session]\n";
+        return 1;
+    }
+    server::ServerParams params;
+    params.n_threads = argc > 2 ? static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 10)) : 0;
+    params.max_sessions = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 0;
+    const std::size_t max_bytes = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 0;
+
+    // each QUEST+ config builds its likelihood table once; sessions are fork()s that share
+    // it, so the per-session cost is the posterior and scratch space
+    const auto per_session = [](const auto &cost)
+    { return cost.posterior_bytes + cost.scratch_bytes; };
+    const auto wp = weibull_params();
+    const auto cp = csf_params();
+    const questplus::Weibull weibull_proto{wp};
+    const questplus::CSF csf_proto{cp};
+    const bool weibull_ok = !max_bytes || per_session(questplus::Weibull::estimate_cost(wp)) <= max_bytes;
+    const bool csf_ok = !max_bytes || per_session(questplus::CSF::estimate_cost(cp)) <= max_bytes;
+
+    const auto factory = [&](std::uint32_t config) -> std::optional<Server::procedure_type>
+    {
+        switch (config)
+        {
+        case 0:
+            if (!weibull_ok)
+            {
+                return std::nullopt;
+            }
+            return Server::procedure_type{weibull_proto.fork()};
+        case 1:
+            if (!csf_ok)
+            {
+                return std::nullopt;
+            }
+            return Server::procedure_type{csf_proto.fork()};
+        case 2:
+            return Server::procedure_type{std::in_place_type<staircase::Staircase>, staircase_params()};
+        default:
+            return std::nullopt;
+        }
+    };
+
+    // handle the stop signals here rather than on whichever thread they'd land on
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    Server srv{argv[1], factory, params};
+    std::cerr << "Listening on " << argv[1] << std::endl;
+    int sig = 0;
+    sigwait(&stop_signals, &sig);
+    srv.stop();
+    return 0;
+}
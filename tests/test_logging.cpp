@@ -0,0 +1,196 @@
+#include <Corrade/TestSuite/Tester.h>
+#include "Corrade/TestSuite/Compare/Container.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "psydapt/logging/async_file_sink.hpp"
+
+using namespace Corrade;
+
+struct TestLogging : TestSuite::Tester
+{
+    explicit TestLogging();
+
+    void csv();
+    void binary();
+    void writeFails();
+};
+
+TestLogging::TestLogging()
+{
+    addTests({&TestLogging::csv, &TestLogging::binary, &TestLogging::writeFails});
+}
+
+namespace
+{
+    using psydapt::logging::AsyncFileSink;
+    using psydapt::logging::FileSinkParams;
+    using psydapt::logging::Format;
+    using psydapt::logging::TrialRecord;
+
+    std::vector<TrialRecord<2>> makeRecords(std::size_t first, std::size_t n)
+    {
+        std::vector<TrialRecord<2>> out;
+        for (std::size_t i = first; i < first + n; i++)
+        {
+            TrialRecord<2> rec{};
+            rec.trial = i;
+            rec.stimulus = {0.1 * static_cast<double>(i) - 1.0 / 3, -20.0 + static_cast<double>(i)};
+            rec.response = static_cast<int>(i % 3) - 1;
+            if (i % 2)
+            {
+                rec.posterior_entropy = 2.0 / static_cast<double>(i + 7);
+            }
+            out.push_back(rec);
+        }
+        return out;
+    }
+
+    // push `recs` and wait for the writer; true if every record was written, none dropped or failed
+    bool logAll(const FileSinkParams &params, const std::vector<TrialRecord<2>> &recs)
+    {
+        AsyncFileSink<2> sink{params};
+        for (const auto &rec : recs)
+        {
+            sink.record(rec);
+        }
+        const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (sink.written() + sink.failed() < recs.size() && std::chrono::steady_clock::now() < give_up)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return sink.written() == recs.size() && sink.dropped() == 0 && sink.failed() == 0;
+    }
+
+    std::uint64_t readLe(const std::vector<unsigned char> &bytes, std::size_t &pos, std::size_t n)
+    {
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            v |= static_cast<std::uint64_t>(bytes[pos + i]) << (8 * i);
+        }
+        pos += n;
+        return v;
+    }
+
+    double readDouble(const std::vector<unsigned char> &bytes, std::size_t &pos)
+    {
+        const std::uint64_t v = readLe(bytes, pos, 8);
+        double out;
+        std::memcpy(&out, &v, sizeof(out));
+        return out;
+    }
+} // namespace
+
+// a new file gets a header, a second sink appends to it, and every value survives the round trip
+void TestLogging::csv()
+{
+    FileSinkParams params;
+    params.path = "psydapt_test_log.csv";
+    params.batch_size = 3;
+    std::remove(params.path.c_str());
+    const auto recs = makeRecords(0, 10), more = makeRecords(10, 4);
+    CORRADE_VERIFY(logAll(params, recs));
+    CORRADE_VERIFY(logAll(params, more));
+
+    std::ifstream in{params.path};
+    std::string line;
+    std::getline(in, line);
+    CORRADE_COMPARE(line, "trial,stimulus_0,stimulus_1,response,posterior_entropy");
+    std::vector<TrialRecord<2>> expected = recs;
+    expected.insert(expected.end(), more.begin(), more.end());
+    std::size_t n = 0;
+    while (std::getline(in, line))
+    {
+        CORRADE_VERIFY(n < expected.size());
+        const auto &rec = expected[n++];
+        const char *p = line.c_str();
+        char *end;
+        CORRADE_COMPARE(std::strtoull(p, &end, 10), rec.trial);
+        CORRADE_COMPARE(std::strtod(end + 1, &end), rec.stimulus[0]);
+        CORRADE_COMPARE(std::strtod(end + 1, &end), rec.stimulus[1]);
+        CORRADE_COMPARE(std::strtol(end + 1, &end, 10), rec.response);
+        CORRADE_COMPARE(*end, ',');
+        if (rec.posterior_entropy)
+        {
+            CORRADE_COMPARE(std::strtod(end + 1, &end), *rec.posterior_entropy);
+        }
+        else
+        {
+            CORRADE_COMPARE(*(end + 1), '\0');
+        }
+    }
+    CORRADE_COMPARE(n, expected.size());
+    in.close();
+    std::remove(params.path.c_str());
+}
+
+// the binary layout is little-endian on any host, with NaN for a missing entropy
+void TestLogging::binary()
+{
+    FileSinkParams params;
+    params.path = "psydapt_test_log.bin";
+    params.format = Format::Binary;
+    std::remove(params.path.c_str());
+    const auto recs = makeRecords(0, 9);
+    CORRADE_VERIFY(logAll(params, recs));
+
+    std::ifstream in{params.path, std::ios::binary};
+    const std::vector<unsigned char> bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    const std::size_t record_size = 8 + 8 * 2 + 4 + 8;
+    CORRADE_COMPARE(bytes.size(), 12 + recs.size() * record_size);
+    CORRADE_COMPARE(std::string(bytes.begin(), bytes.begin() + 8), "PSYDLOG1");
+    std::size_t pos = 8;
+    CORRADE_COMPARE(readLe(bytes, pos, 4), std::uint64_t{2});
+    for (const auto &rec : recs)
+    {
+        CORRADE_COMPARE(readLe(bytes, pos, 8), rec.trial);
+        CORRADE_COMPARE(readDouble(bytes, pos), rec.stimulus[0]);
+        CORRADE_COMPARE(readDouble(bytes, pos), rec.stimulus[1]);
+        CORRADE_COMPARE(static_cast<std::int32_t>(readLe(bytes, pos, 4)), rec.response);
+        const double entropy = readDouble(bytes, pos);
+        if (rec.posterior_entropy)
+        {
+            CORRADE_COMPARE(entropy, *rec.posterior_entropy);
+        }
+        else
+        {
+            CORRADE_VERIFY(std::isnan(entropy));
+        }
+    }
+    in.close();
+    std::remove(params.path.c_str());
+}
+
+// a file that won't take the header is reported straight away rather than as silently lost trials
+void TestLogging::writeFails()
+{
+    if (!std::ifstream{"/dev/full"})
+    {
+        CORRADE_SKIP("No /dev/full on this system.");
+    }
+    FileSinkParams params;
+    params.path = "/dev/full";
+    bool threw = false;
+    try
+    {
+        AsyncFileSink<2> sink{params};
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    CORRADE_VERIFY(threw);
+}
+
+CORRADE_TEST_MAIN(TestLogging)
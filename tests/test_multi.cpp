@@ -0,0 +1,228 @@
+#include <Corrade/TestSuite/Tester.h>
+#include "Corrade/TestSuite/Compare/Container.h"
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include "psydapt/staircase/staircase.hpp"
+#include "psydapt/questplus/weibull.hpp"
+#include "psydapt/multi/multi_procedure.hpp"
+#include "common.hpp"
+
+using namespace Corrade;
+
+struct TestMulti : TestSuite::Tester
+{
+    explicit TestMulti();
+
+    void matchesSolo();
+    void sequential();
+    void nextThrows();
+    void nextAndUpdate();
+};
+
+TestMulti::TestMulti()
+{
+    addTests({&TestMulti::matchesSolo, &TestMulti::sequential, &TestMulti::nextThrows});
+    addBenchmarks({&TestMulti::nextAndUpdate}, 10);
+}
+
+namespace
+{
+    using Multi = psydapt::multi::MultiProcedure<psydapt::staircase::Staircase, psydapt::questplus::Weibull>;
+
+    psydapt::staircase::Staircase::Params staircaseParams()
+    {
+        psydapt::staircase::Staircase::Params params;
+        params.n_trials = 20;
+        params.start_val = 0.8;
+        params.min_val = 0;
+        params.max_val = 1;
+        params.step_sizes = {0.1, 0.01, 0.001};
+        params.n_up = 1;
+        params.n_down = 3;
+        params.n_reversals = 4;
+        params.apply_initial_rule = true;
+        return params;
+    }
+
+    psydapt::questplus::Weibull::Params weibullParams()
+    {
+        psydapt::questplus::Weibull::Params p;
+        for (int i = -40; i <= 0; i++)
+        {
+            p.threshold.push_back(i);
+        }
+        p.intensity = p.threshold;
+        p.slope = {3.5};
+        p.lower_asymptote = {0.5};
+        p.lapse_rate = {0.02};
+        p.stim_scale = psydapt::Scale::dB;
+        return p;
+    }
+
+    std::vector<double> runSolo(psydapt::staircase::Staircase proc, const std::vector<int> &resp)
+    {
+        std::vector<double> out;
+        for (std::size_t i = 0; i < resp.size(); i++)
+        {
+            out.push_back(proc.next());
+            if (!proc.update(resp[i]))
+            {
+                break;
+            }
+        }
+        return out;
+    }
+
+    std::vector<double> runSolo(psydapt::questplus::Weibull proc, const std::vector<int> &resp, std::size_t n)
+    {
+        std::vector<double> out;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            out.push_back(proc.next());
+            proc.update(resp[i % resp.size()]);
+        }
+        return out;
+    }
+
+    // next() fails once, then counts up
+    struct Flaky
+    {
+        bool failed = false;
+        double value = 0;
+        double next()
+        {
+            if (!failed)
+            {
+                failed = true;
+                throw std::runtime_error("Transient failure.");
+            }
+            return value;
+        }
+        bool update(int, std::optional<double> = std::nullopt)
+        {
+            value++;
+            return true;
+        }
+    };
+} // namespace
+
+// interleaving (and background computation) must not change any condition's sequence
+void TestMulti::matchesSolo()
+{
+    using namespace psydapt;
+    const std::vector<int> resp = makeBasicResponseCycles(3, 4, 4, 20);
+
+    std::vector<Multi::procedure_type> procs;
+    procs.emplace_back(staircase::Staircase{staircaseParams()});
+    procs.emplace_back(questplus::Weibull{weibullParams()});
+    procs.emplace_back(staircase::Staircase{staircaseParams()});
+    multi::Params params;
+    params.n_threads = 2;
+    Multi multi{std::move(procs), params};
+
+    std::vector<std::vector<double>> seqs(3);
+    bool cont = true;
+    while (cont)
+    {
+        auto trial = multi.next();
+        auto &seq = seqs[trial.condition];
+        seq.push_back(std::get<double>(trial.stimulus));
+        cont = multi.update(resp[(seq.size() - 1) % resp.size()]);
+        // the Weibull condition never stops by itself
+        if (multi.finished(0) && multi.finished(2) && seq.size() >= resp.size())
+        {
+            break;
+        }
+    }
+    CORRADE_COMPARE_AS(seqs[0], runSolo(staircase::Staircase{staircaseParams()}, resp), TestSuite::Compare::Container);
+    CORRADE_COMPARE_AS(seqs[2], runSolo(staircase::Staircase{staircaseParams()}, resp), TestSuite::Compare::Container);
+    CORRADE_COMPARE_AS(seqs[1], runSolo(questplus::Weibull{weibullParams()}, resp, seqs[1].size()), TestSuite::Compare::Container);
+}
+
+void TestMulti::sequential()
+{
+    using namespace psydapt;
+    std::vector<Multi::procedure_type> procs;
+    procs.emplace_back(staircase::Staircase{staircaseParams()});
+    procs.emplace_back(questplus::Weibull{weibullParams()});
+    multi::Params params;
+    params.order = multi::Order::Sequential;
+    Multi multi{std::move(procs), params};
+
+    std::vector<std::size_t> conditions;
+    for (int i = 0; i < 6; i++)
+    {
+        conditions.push_back(multi.next().condition);
+        multi.update(i % 2);
+    }
+    CORRADE_COMPARE_AS(conditions, (std::vector<std::size_t>{0, 1, 0, 1, 0, 1}), TestSuite::Compare::Container);
+}
+
+// a next() that throws reaches the caller, and the condition carries on afterwards
+void TestMulti::nextThrows()
+{
+    psydapt::multi::Params params;
+    params.order = psydapt::multi::Order::Sequential;
+    psydapt::multi::MultiProcedure<Flaky> multi{{Flaky{}, Flaky{}}, params};
+    bool threw = false;
+    try
+    {
+        multi.next();
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    CORRADE_VERIFY(threw);
+    // retried rather than stuck waiting for an update()
+    auto trial = multi.next();
+    CORRADE_COMPARE(trial.condition, 0u);
+    CORRADE_COMPARE(std::get<double>(trial.stimulus), 0.0);
+    multi.update(1);
+    std::vector<std::size_t> conditions;
+    std::vector<double> stimuli;
+    // condition 1 fails once too, then both proceed in order
+    for (int i = 0; i < 4; i++)
+    {
+        try
+        {
+            trial = multi.next();
+        }
+        catch (const std::runtime_error &)
+        {
+            trial = multi.next();
+        }
+        conditions.push_back(trial.condition);
+        stimuli.push_back(std::get<double>(trial.stimulus));
+        multi.update(1);
+    }
+    CORRADE_COMPARE_AS(conditions, (std::vector<std::size_t>{1, 0, 1, 0}), TestSuite::Compare::Container);
+    CORRADE_COMPARE_AS(stimuli, (std::vector<double>{0, 1, 1, 2}), TestSuite::Compare::Container);
+}
+
+void TestMulti::nextAndUpdate()
+{
+    using namespace psydapt;
+    std::vector<Multi::procedure_type> procs;
+    for (int i = 0; i < 8; i++)
+    {
+        procs.emplace_back(questplus::Weibull{weibullParams()});
+    }
+    multi::Params params;
+    params.n_threads = 4;
+    Multi multi{std::move(procs), params};
+
+    double a{};
+    CORRADE_BENCHMARK(10)
+    {
+        for (std::size_t i = 0; i < 100; i++)
+        {
+            a += std::get<double>(multi.next().stimulus);
+            multi.update(i % 2);
+        }
+    }
+    CORRADE_VERIFY(a);
+}
+
+CORRADE_TEST_MAIN(TestMulti)
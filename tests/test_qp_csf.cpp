@@ -1,5 +1,9 @@
 #include <Corrade/TestSuite/Tester.h>
 #include "Corrade/TestSuite/Compare/Container.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
 #include <vector>
 #include "psydapt/questplus/csf.hpp"
 
@@ -10,84 +14,436 @@ struct TestQPCSF : TestSuite::Tester
     explicit TestQPCSF();
 
     void correctness();
+    void pruning();
+    void stimulusFilter();
+    void kernels();
+    void entropySurface();
+    void parallelConstruction();
+    void deadline();
+    void quantized();
     void nextAndUpdate();
+    void nextAndUpdateSubsampled();
+    void sweepDirect();
+#if defined(PSYDAPT_USE_BLAS)
+    void sweepBlas();
+#endif
 };
 
 TestQPCSF::TestQPCSF()
 {
-    addTests({&TestQPCSF::correctness});
-    addBenchmarks({&TestQPCSF::nextAndUpdate}, 10);
+    addTests({&TestQPCSF::correctness, &TestQPCSF::pruning, &TestQPCSF::stimulusFilter,
+              &TestQPCSF::kernels, &TestQPCSF::entropySurface, &TestQPCSF::parallelConstruction, &TestQPCSF::deadline,
+              &TestQPCSF::quantized});
+    addBenchmarks({&TestQPCSF::nextAndUpdate, &TestQPCSF::nextAndUpdateSubsampled}, 10);
+    // scoring every candidate of a large grid, per kernel
+    addBenchmarks({&TestQPCSF::sweepDirect}, 10);
+#if defined(PSYDAPT_USE_BLAS)
+    addBenchmarks({&TestQPCSF::sweepBlas}, 10);
+#endif
 }
 
+namespace
+{
+    psydapt::questplus::CSF::Params csfParams()
+    {
+        psydapt::questplus::CSF::Params p;
+        p.contrast = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30, -28, -26,
+                      -24, -22, -20, -18, -16, -14, -12, -10, -8, -6, -4, -2, 0};
+        p.spatial_freq = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 32,
+                          34, 36, 38, 40};
+        p.temporal_freq = {0};
+
+        p.min_thresh = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30};
+        p.c0 = {-60, -58, -56, -54, -52, -50, -48, -46, -44, -42, -40};
+        p.cf = {0.8, 1., 1.2, 1.4, 1.6};
+        p.cw = {0};
+        p.slope = {3};
+        p.lower_asymptote = {0.5};
+        p.lapse_rate = {0.01};
+
+        p.stim_scale = psydapt::Scale::dB;
+        return p;
+    }
+
+    // responses of the reference session, and the stimuli csfParams() must pick for them
+    std::vector<int> referenceResponses()
+    {
+        return {1, 0, 1, 1, 1,
+                1, 0, 1, 1, 1,
+                1, 1, 0, 1, 1,
+                1, 1, 1, 0, 0,
+                1, 1, 1, 1, 1,
+                1, 1, 0, 0, 1,
+                1, 1};
+    }
+    std::vector<double> referenceContrasts()
+    {
+        return {0, -4, 0, 0, -38, 0, -40, 0, -26, -26,
+                0, -36, -36, 0, -26, -26, -2, -26, -6, -26,
+                0, -26, 0, -26, -32, -32, -34, -34, 0, -26,
+                0, -26};
+    }
+    std::vector<double> referenceSpatialFreqs()
+    {
+        return {40, 40, 34, 36, 0, 38, 0, 38, 18, 18, 40, 0,
+                0, 40, 20, 20, 40, 22, 40, 20, 40, 18, 40, 18,
+                0, 0, 0, 0, 40, 18, 38, 18};
+    }
+} // namespace
+
+// the double, 16- and 8-bit tables all pick the reference sequence, with and without pruning
 void TestQPCSF::correctness()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+    p.history_params.undo_depth = 1;
+    for (const auto precision : {LikelihoodPrecision::Double, LikelihoodPrecision::UInt16, LikelihoodPrecision::UInt8})
+    {
+        for (const bool prune : {true, false})
+        {
+            p.storage_params.precision = precision;
+            p.pruning_params.enabled = prune;
+            CSF csf{p};
+            std::vector<double> pred_contrasts;
+            std::vector<double> pred_spat_freqs;
+            for (const int resp : referenceResponses())
+            {
+                auto n = csf.next();
+                pred_contrasts.push_back(n[0]);
+                pred_spat_freqs.push_back(n[1]);
+                csf.update(resp);
+            }
+            CORRADE_COMPARE_AS(pred_contrasts, referenceContrasts(), TestSuite::Compare::Container);
+            CORRADE_COMPARE_AS(pred_spat_freqs, referenceSpatialFreqs(), TestSuite::Compare::Container);
+
+            // undo divides the same (possibly converted) row back out
+            const auto before = csf.get_posterior();
+            csf.update(1);
+            csf.undo();
+            double diff = 0;
+            for (std::size_t i = 0; i < before.size(); i++)
+            {
+                diff = std::max(diff, std::abs(before.data()[i] - csf.get_posterior().data()[i]));
+            }
+            CORRADE_VERIFY(diff < 1e-12);
+        }
+    }
+}
+
+// pruned and exhaustive searches must pick identical stimuli
+void TestQPCSF::pruning()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+
+    p.pruning_params.enabled = true;
+    CSF pruned{p};
+    p.pruning_params.enabled = false;
+    CSF exhaustive{p};
+    for (std::size_t i = 0; i < 60; i++)
+    {
+        const auto a = pruned.next();
+        const auto b = exhaustive.next();
+        CORRADE_COMPARE(a[0], b[0]);
+        CORRADE_COMPARE(a[1], b[1]);
+        // respond "seen" when above a fixed, frequency-dependent contrast
+        const int resp = a[0] > -40 + 0.5 * a[1] ? 1 : (i % 7 == 0);
+        pruned.update(resp);
+        exhaustive.update(resp);
+    }
+}
+
+void TestQPCSF::stimulusFilter()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+
+    // a filter that keeps everything changes the table layout, but not the choices
+    CSF full{p};
+    p.stimulus_filter = [](const std::array<double, 3> &)
+    { return true; };
+    CSF kept{p};
+    // no high contrasts at high spatial frequencies
+    const auto displayable = [](const std::array<double, 3> &x)
+    { return x[0] <= -20 || x[1] <= 20; };
+    p.stimulus_filter = displayable;
+    CSF masked{p};
+    for (std::size_t i = 0; i < 32; i++)
+    {
+        const auto a = full.next();
+        const auto b = kept.next();
+        CORRADE_COMPARE(a[0], b[0]);
+        CORRADE_COMPARE(a[1], b[1]);
+        const auto c = masked.next();
+        CORRADE_VERIFY(displayable(c));
+        const int resp = (i / 2) % 2;
+        full.update(resp);
+        kept.update(resp);
+        masked.update(resp);
+    }
+}
+
+// building the likelihood table on several threads gives exactly the serial table
+void TestQPCSF::parallelConstruction()
 {
     using namespace psydapt::questplus;
     CSF::Params p;
-    p.contrast = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30, -28, -26,
-                  -24, -22, -20, -18, -16, -14, -12, -10, -8, -6, -4, -2, 0};
-    p.spatial_freq = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 32,
-                      34, 36, 38, 40};
-    p.temporal_freq = {0};
-
-    p.min_thresh = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30};
-    p.c0 = {-60, -58, -56, -54, -52, -50, -48, -46, -44, -42, -40};
+    p.contrast = {-50, -45, -40, -35, -30, -25, -20, -15, -10, -5, 0};
+    p.spatial_freq = {0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40};
+    p.temporal_freq = {0, 8};
+
+    p.min_thresh = {-50, -45, -40, -35, -30};
+    p.c0 = {-60, -55, -50, -45, -40};
     p.cf = {0.8, 1., 1.2, 1.4, 1.6};
-    p.cw = {0};
+    p.cw = {0, 0.1};
     p.slope = {3};
     p.lower_asymptote = {0.5};
     p.lapse_rate = {0.01};
-
     p.stim_scale = psydapt::Scale::dB;
+    p.pruning_params.enabled = false;
 
-    CSF csf{p};
+    for (const bool filtered : {false, true})
+    {
+        if (filtered)
+        {
+            p.stimulus_filter = [](const std::array<double, 3> &x)
+            { return x[0] <= -20 || x[1] <= 20; };
+        }
+        CSF serial{p};
+        p.construction_params.n_threads = 4;
+        CSF threaded{p};
+        p.construction_params.n_threads = 1;
+        for (std::size_t i = 0; i < 8; i++)
+        {
+            const auto a = serial.next();
+            const auto b = threaded.next();
+            CORRADE_VERIFY(a == b);
+            // every score is computed from the likelihood table, so they match bit for bit
+            const auto &pa = serial.get_response_probability();
+            const auto &pb = threaded.get_response_probability();
+            CORRADE_VERIFY(std::equal(pa.begin(), pa.end(), pb.begin(), pb.end()));
+            const auto &ea = serial.get_expected_entropy();
+            const auto &eb = threaded.get_expected_entropy();
+            CORRADE_VERIFY(std::equal(ea.begin(), ea.end(), eb.begin(), eb.end()));
+            const int resp = (i / 2) % 2;
+            serial.update(resp);
+            threaded.update(resp);
+            const auto &qa = serial.get_posterior();
+            const auto &qb = threaded.get_posterior();
+            CORRADE_VERIFY(std::equal(qa.begin(), qa.end(), qb.begin(), qb.end()));
+        }
+    }
+}
+
+// with time to spare, next(deadline) matches next(); with none, it still returns a scored stimulus
+void TestQPCSF::deadline()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+
+    const auto later = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    const std::chrono::steady_clock::time_point long_ago{};
+    for (const bool prune : {true, false})
+    {
+        p.pruning_params.enabled = prune;
+        CSF plain{p};
+        CSF anytime{p};
+        for (std::size_t i = 0; i < 30; i++)
+        {
+            const auto a = plain.next();
+            const auto b = anytime.next(later);
+            CORRADE_VERIFY(anytime.sweep_complete());
+            CORRADE_COMPARE(a[0], b[0]);
+            CORRADE_COMPARE(a[1], b[1]);
+            const int resp = a[0] > -40 + 0.5 * a[1] ? 1 : (i % 7 == 0);
+            plain.update(resp);
+            anytime.update(resp);
+        }
+
+        // out of time: only the previous trial's best is scored, and picked again
+        const auto c = anytime.next(long_ago);
+        CORRADE_VERIFY(!anytime.sweep_complete());
+        const auto &eh = anytime.get_expected_entropy();
+        CORRADE_COMPARE(std::count_if(eh.begin(), eh.end(), [](double v)
+                                      { return std::isfinite(v); }),
+                        std::ptrdiff_t{1});
+        const auto d = anytime.next(long_ago);
+        CORRADE_COMPARE(c[0], d[0]);
+        CORRADE_COMPARE(c[1], d[1]);
+        anytime.update(1);
+    }
+
+    // with nothing to go on, the first candidate is still one of the most informative
+    p.pruning_params.enabled = false;
+    CSF full{p};
+    CSF rushed{p};
+    full.next();
+    rushed.next(long_ago);
+    const auto &all = full.get_expected_entropy();
+    const auto &one = rushed.get_expected_entropy();
+    const auto picked = std::find_if(one.begin(), one.end(), [](double v)
+                                     { return std::isfinite(v); }) -
+                        one.begin();
+    const auto better = std::count_if(all.begin(), all.end(), [&](double v)
+                                      { return v < all.data()[picked]; });
+    CORRADE_VERIFY(static_cast<std::size_t>(better) < all.size() / 20);
+}
+
+// a quarter and an eighth of the table, plus a little per block (correctness() checks their choices)
+void TestQPCSF::quantized()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+    p.storage_params.precision = LikelihoodPrecision::Double;
+    p.pruning_params.enabled = false;
+    const auto full = CSF::estimate_cost(p).likelihood_bytes;
+    p.storage_params.precision = LikelihoodPrecision::UInt16;
+    const auto half_word = CSF::estimate_cost(p).likelihood_bytes;
+    p.storage_params.precision = LikelihoodPrecision::UInt8;
+    const auto byte = CSF::estimate_cost(p).likelihood_bytes;
+    CORRADE_VERIFY(half_word < full / 3);
+    CORRADE_VERIFY(byte < full / 6);
+}
+
+// random two-response likelihood table (with some zeros) and normalised posterior
+static void random_table(std::size_t n_stim, std::size_t n_param, std::vector<double> &lik, std::vector<double> &post)
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> unif;
+    lik.resize(2 * n_stim * n_param);
+    post.resize(n_param);
+    for (std::size_t i = 0; i < n_stim * n_param; i++)
+    {
+        const double v = i % 7 ? unif(rng) : 0;
+        lik[i] = 1 - v;
+        lik[n_stim * n_param + i] = v;
+    }
+    double total = 0;
+    for (auto &p : post)
+    {
+        p = unif(rng);
+        total += p;
+    }
+    for (auto &p : post)
+    {
+        p /= total;
+    }
+}
+
+// the (possibly dispatched) expected-entropy kernels against a plain std::log sum
+void TestQPCSF::kernels()
+{
+    using namespace psydapt::questplus;
+    const std::size_t n_stim = 40, n_param = 300;
+    std::vector<double> lik, post;
+    random_table(n_stim, n_param, lik, post);
+#if defined(PSYDAPT_USE_BLAS)
+    const auto llogl = detail::likelihood_log_likelihood(lik.data(), lik.size());
+    std::vector<double> pk(2 * n_stim), H(2 * n_stim), EH(n_stim), work(2 * (n_param + 2 * n_stim));
+    detail::expected_entropy_blas(lik.data(), llogl.data(), post.data(), 2, n_stim, n_param,
+                                  pk.data(), H.data(), EH.data(), work.data());
+#endif
+    for (std::size_t s = 0; s < n_stim; s++)
+    {
+        double expected = 0;
+        for (std::size_t r = 0; r < 2; r++)
+        {
+            const double *l = lik.data() + (r * n_stim + s) * n_param;
+            double pk = 0, h = 0;
+            for (std::size_t i = 0; i < n_param; i++)
+            {
+                pk += l[i] * post[i];
+            }
+            for (std::size_t i = 0; i < n_param; i++)
+            {
+                const double q = l[i] * post[i] / pk;
+                h -= q > 0 ? q * std::log(q) : 0;
+            }
+            expected += pk * h;
+        }
+        const double eh = detail::expected_entropy(lik.data(), post.data(), 2, n_stim, n_param, s);
+        CORRADE_VERIFY(std::abs(eh - expected) < 1e-12 * expected);
+#if defined(PSYDAPT_USE_BLAS)
+        CORRADE_VERIFY(std::abs(EH[s] - expected) < 1e-12 * expected);
+#endif
+    }
+}
 
-    std::vector<int> resps = {1, 0, 1, 1, 1,
-                              1, 0, 1, 1, 1,
-                              1, 1, 0, 1, 1,
-                              1, 1, 1, 0, 0,
-                              1, 1, 1, 1, 1,
-                              1, 1, 0, 0, 1,
-                              1, 1};
-
-    std::vector<double> expected_contrasts{0, -4, 0, 0, -38, 0, -40, 0, -26, -26,
-                                           0, -36, -36, 0, -26, -26, -2, -26, -6, -26,
-                                           0, -26, 0, -26, -32, -32, -34, -34, 0, -26,
-                                           0, -26};
-    std::vector<double> expected_spat_freqs{40, 40, 34, 36, 0, 38, 0, 38, 18, 18, 40, 0,
-                                            0, 40, 20, 20, 40, 22, 40, 20, 40, 18, 40, 18,
-                                            0, 0, 0, 0, 40, 18, 38, 18};
-    std::vector<double> pred_contrasts;
-    std::vector<double> pred_spat_freqs;
-    for (std::size_t i = 0; i < resps.size(); i++)
-    {
-        auto n = csf.next();
-        pred_contrasts.push_back(n[0]);
-        pred_spat_freqs.push_back(n[1]);
-        csf.update(resps[i]);
-    }
-    CORRADE_COMPARE_AS(pred_contrasts, expected_contrasts, TestSuite::Compare::Container);
-    CORRADE_COMPARE_AS(pred_spat_freqs, expected_spat_freqs, TestSuite::Compare::Container);
+// the whole expected-entropy surface from next() against the textbook computation: for every
+// stimulus and response, form the updated posterior from psychometric() and take its entropy
+void TestQPCSF::entropySurface()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+    p.pruning_params.enabled = false;
+    CSF csf{p};
+    const auto resps = referenceResponses();
+    for (std::size_t t = 0; t < 6; t++)
+    {
+        csf.next();
+        csf.update(resps[t]);
+    }
+    csf.next();
+    const auto &post = csf.get_posterior();
+    const auto &eh = csf.get_expected_entropy();
+    std::vector<double> q(post.size());
+    double err = 0;
+    std::size_t s = 0;
+    for (const double c : p.contrast)
+    {
+        for (const double f : p.spatial_freq)
+        {
+            for (const double w : p.temporal_freq)
+            {
+                double expected = 0;
+                for (int r = 0; r < 2; r++)
+                {
+                    double pk = 0;
+                    for (std::size_t i = 0; i < post.size(); i++)
+                    {
+                        const double pc = CSF::psychometric(p, {c, f, w}, csf.parameter_cell(i));
+                        q[i] = (r ? pc : 1 - pc) * post.data()[i];
+                        pk += q[i];
+                    }
+                    double h = 0;
+                    for (const double v : q)
+                    {
+                        h -= v > 0 ? v / pk * std::log(v / pk) : 0;
+                    }
+                    expected += pk * h;
+                }
+                err = std::max(err, std::abs(eh.data()[s++] - expected) / expected);
+            }
+        }
+    }
+    CORRADE_COMPARE(s, eh.size());
+    CORRADE_VERIFY(err < 1e-10);
 }
 
 void TestQPCSF::nextAndUpdate()
 {
     using namespace psydapt::questplus;
-    CSF::Params p;
-    p.contrast = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30, -28, -26,
-                  -24, -22, -20, -18, -16, -14, -12, -10, -8, -6, -4, -2, 0};
-    p.spatial_freq = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 32,
-                      34, 36, 38, 40};
-    p.temporal_freq = {0};
-
-    p.min_thresh = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30};
-    p.c0 = {-60, -58, -56, -54, -52, -50, -48, -46, -44, -42, -40};
-    p.cf = {0.8, 1., 1.2, 1.4, 1.6};
-    p.cw = {0};
-    p.slope = {3};
-    p.lower_asymptote = {0.5};
-    p.lapse_rate = {0.01};
+    auto p = csfParams();
 
-    p.stim_scale = psydapt::Scale::dB;
+    CSF csf{p};
+
+    double a{};
+    CORRADE_BENCHMARK(10)
+    {
+        for (std::size_t i = 0; i < 10; i++)
+        {
+            a += csf.next()[0];
+            csf.update(i % 2);
+        }
+    }
+    CORRADE_VERIFY(a);
+}
+
+void TestQPCSF::nextAndUpdateSubsampled()
+{
+    using namespace psydapt::questplus;
+    auto p = csfParams();
+    p.subsample_params.fraction = 0.2;
 
     CSF csf{p};
 
@@ -103,4 +459,42 @@ void TestQPCSF::nextAndUpdate()
     CORRADE_VERIFY(a);
 }
 
+static constexpr std::size_t sweep_stim = 600, sweep_param = 5000;
+
+void TestQPCSF::sweepDirect()
+{
+    using namespace psydapt::questplus;
+    std::vector<double> lik, post;
+    random_table(sweep_stim, sweep_param, lik, post);
+    std::vector<double> pk(2 * sweep_stim), H(2 * sweep_stim);
+    double a{};
+    CORRADE_BENCHMARK(1)
+    {
+        for (std::size_t s = 0; s < sweep_stim; s++)
+        {
+            a += detail::expected_entropy(lik.data(), post.data(), 2, sweep_stim, sweep_param, s, pk.data(), H.data());
+        }
+    }
+    CORRADE_VERIFY(a);
+}
+
+#if defined(PSYDAPT_USE_BLAS)
+void TestQPCSF::sweepBlas()
+{
+    using namespace psydapt::questplus;
+    std::vector<double> lik, post;
+    random_table(sweep_stim, sweep_param, lik, post);
+    const auto llogl = detail::likelihood_log_likelihood(lik.data(), lik.size());
+    std::vector<double> pk(2 * sweep_stim), H(2 * sweep_stim), EH(sweep_stim), work(2 * (sweep_param + 2 * sweep_stim));
+    double a{};
+    CORRADE_BENCHMARK(1)
+    {
+        detail::expected_entropy_blas(lik.data(), llogl.data(), post.data(), 2, sweep_stim, sweep_param,
+                                      pk.data(), H.data(), EH.data(), work.data());
+        a += EH[0];
+    }
+    CORRADE_VERIFY(a);
+}
+#endif
+
 CORRADE_TEST_MAIN(TestQPCSF)
@@ -0,0 +1,89 @@
+#include <Corrade/TestSuite/Tester.h>
+#include "Corrade/TestSuite/Compare/Container.h"
+#include <cmath>
+#include <vector>
+#include "psydapt/questplus/weibull.hpp"
+#include "psydapt/questplus/csf.hpp"
+#include "psydapt/questplus/particle.hpp"
+#include "psydapt/simulation/simulation.hpp"
+
+using namespace Corrade;
+
+struct TestQPParticle : TestSuite::Tester
+{
+    explicit TestQPParticle();
+
+    void weibullThreshold();
+    void csfNextAndUpdate();
+};
+
+TestQPParticle::TestQPParticle()
+{
+    addTests({&TestQPParticle::weibullThreshold});
+    addBenchmarks({&TestQPParticle::csfNextAndUpdate}, 10);
+}
+
+void TestQPParticle::weibullThreshold()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.intensity.push_back(i);
+        p.threshold.push_back(i);
+    }
+    p.slope = {2, 3, 4, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+
+    questplus::ParticleFilter<questplus::Weibull> pf{p};
+    const double true_threshold = -17.3;
+    const auto observer = simulation::weibull_observer(true_threshold, 3.5, 0.5, 0.02, Scale::dB);
+    simulation::CounterRng rng{3, 0};
+    for (std::size_t i = 0; i < 80; i++)
+    {
+        const double x = pf.next();
+        pf.update(rng.uniform() < observer(x) ? 1 : 0);
+    }
+    CORRADE_VERIFY(std::abs(pf.mean()[0] - true_threshold) < 4);
+    // single-valued parameters never move
+    CORRADE_COMPARE(pf.mean()[2], 0.5);
+}
+
+void TestQPParticle::csfNextAndUpdate()
+{
+    using namespace psydapt::questplus;
+    CSF::Params p;
+    p.contrast = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30, -28, -26,
+                  -24, -22, -20, -18, -16, -14, -12, -10, -8, -6, -4, -2, 0};
+    p.spatial_freq = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 32,
+                      34, 36, 38, 40};
+    p.temporal_freq = {0};
+
+    p.min_thresh = {-50, -48, -46, -44, -42, -40, -38, -36, -34, -32, -30};
+    p.c0 = {-60, -58, -56, -54, -52, -50, -48, -46, -44, -42, -40};
+    p.cf = {0.8, 1., 1.2, 1.4, 1.6};
+    p.cw = {0};
+    p.slope = {3};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.01};
+    p.stim_scale = psydapt::Scale::dB;
+
+    ParticleParams pp;
+    pp.n_particles = 500;
+    ParticleFilter<CSF> pf{p, pp};
+
+    double a{};
+    CORRADE_BENCHMARK(10)
+    {
+        for (std::size_t i = 0; i < 10; i++)
+        {
+            a += pf.next()[0];
+            pf.update(i % 2);
+        }
+    }
+    CORRADE_VERIFY(a);
+}
+
+CORRADE_TEST_MAIN(TestQPParticle)
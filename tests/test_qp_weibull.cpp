@@ -1,7 +1,14 @@
 #include <Corrade/TestSuite/Tester.h>
 #include "Corrade/TestSuite/Compare/Container.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
 #include <vector>
 #include "psydapt/questplus/weibull.hpp"
+#include "psydapt/simulation/simulation.hpp"
 
 using namespace Corrade;
 
@@ -10,12 +17,32 @@ struct TestQPWeibull : TestSuite::Tester
     explicit TestQPWeibull();
 
     void threshold();
+    void compactHistory();
+    void accessors();
+    void refinement();
+    void subsample();
+    void pruning();
+    void entropySurface();
+    void parameterFilter();
+    void stopping();
+    void suspendResume();
+    void fork();
+    void undo();
+    void updateMany();
+    void estimateCost();
+    void twoStep();
     void nextAndUpdate();
 };
 
 TestQPWeibull::TestQPWeibull()
 {
-    addTests({&TestQPWeibull::threshold});
+    addTests({&TestQPWeibull::threshold, &TestQPWeibull::compactHistory, &TestQPWeibull::accessors,
+              &TestQPWeibull::refinement, &TestQPWeibull::subsample,
+              &TestQPWeibull::pruning, &TestQPWeibull::entropySurface, &TestQPWeibull::parameterFilter,
+              &TestQPWeibull::stopping, &TestQPWeibull::suspendResume,
+              &TestQPWeibull::fork, &TestQPWeibull::undo,
+              &TestQPWeibull::updateMany, &TestQPWeibull::estimateCost,
+              &TestQPWeibull::twoStep});
     addBenchmarks({&TestQPWeibull::nextAndUpdate}, 10);
 }
 
@@ -56,6 +83,710 @@ void TestQPWeibull::threshold()
     CORRADE_COMPARE_AS(pred_contrasts, expected_contrasts, TestSuite::Compare::Container);
 }
 
+// live state is handed out by reference, so repeated calls see the same storage
+void TestQPWeibull::accessors()
+{
+    using namespace psydapt::questplus;
+    Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {3.5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = psydapt::Scale::dB;
+    p.pruning_params.enabled = false;
+    // refining rewrites the posterior too
+    p.refinement_params.every = 2;
+
+    Weibull weibull{p};
+    const double *post = weibull.get_posterior().data();
+    const double *eh_data = weibull.get_expected_entropy().data();
+    for (std::size_t i = 0; i < 5; i++)
+    {
+        const double x = weibull.next();
+        // the entropy map's minimum is the proposed stimulus
+        const auto &eh = weibull.get_expected_entropy();
+        const auto best = std::min_element(eh.begin(), eh.end()) - eh.begin();
+        CORRADE_COMPARE(p.intensity[best], x);
+        CORRADE_COMPARE(weibull.get_response_probability().shape()[0], std::size_t{2});
+        weibull.update(i % 2);
+    }
+    CORRADE_VERIFY(weibull.get_posterior().data() == post);
+    CORRADE_VERIFY(weibull.get_expected_entropy().data() == eh_data);
+    CORRADE_COMPARE(std::accumulate(weibull.get_posterior().begin(), weibull.get_posterior().end(), 0.0), 1.0);
+    CORRADE_COMPARE(weibull.get_stimulus_history().size(), std::size_t{5});
+    CORRADE_COMPARE(weibull.get_response_history().back(), 0);
+    CORRADE_VERIFY(!weibull.get_compact_history());
+}
+
+void TestQPWeibull::compactHistory()
+{
+    using namespace psydapt::questplus;
+    Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {3.5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = psydapt::Scale::dB;
+    p.history_params.compact = true;
+    p.history_params.capacity = 10;
+
+    Weibull weibull{p};
+    std::vector<double> pred_contrasts;
+    std::vector<int> responses;
+    for (std::size_t i = 0; i < 32; i++)
+    {
+        pred_contrasts.push_back(weibull.next());
+        responses.push_back((i / 3) % 2);
+        weibull.update(responses.back());
+    }
+    // only the last 10 trials are kept, and decode to the same grid values
+    CORRADE_COMPARE(weibull.history_size(), std::size_t{10});
+    std::vector<double> stored_contrasts;
+    std::vector<int> stored_responses;
+    for (const auto &trial : weibull.trials())
+    {
+        stored_contrasts.push_back(trial.stimulus);
+        stored_responses.push_back(trial.response);
+    }
+    CORRADE_COMPARE(weibull.trials().size(), std::size_t{10});
+    CORRADE_COMPARE(weibull.stimulus_at(9), pred_contrasts.back());
+    CORRADE_COMPARE_AS(stored_contrasts, std::vector<double>(pred_contrasts.end() - 10, pred_contrasts.end()),
+                       TestSuite::Compare::Container);
+    CORRADE_COMPARE_AS(stored_responses, std::vector<int>(responses.end() - 10, responses.end()),
+                       TestSuite::Compare::Container);
+    // the plain vectors aren't kept, so asking for them is an error rather than an empty history
+    int threw = 0;
+    try
+    {
+        weibull.get_stimulus_history();
+    }
+    catch (const std::runtime_error &)
+    {
+        threw++;
+    }
+    try
+    {
+        weibull.get_response_history();
+    }
+    catch (const std::runtime_error &)
+    {
+        threw++;
+    }
+    CORRADE_COMPARE(threw, 2);
+}
+
+void TestQPWeibull::refinement()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    // coarse: 4 dB spacing, threshold off-grid
+    p.threshold = {-40, -36, -32, -28, -24, -20, -16, -12, -8, -4, 0};
+    for (int i = -40; i <= 0; i++)
+    {
+        p.intensity.push_back(i);
+    }
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+    p.refinement_params.every = 10;
+
+    questplus::Weibull weibull{p};
+    const double true_threshold = -17.3;
+    const auto observer = simulation::weibull_observer(true_threshold, 3.5, 0.5, 0.02, Scale::dB);
+    simulation::CounterRng rng{1, 0};
+    for (std::size_t i = 0; i < 60; i++)
+    {
+        const double x = weibull.next();
+        weibull.update(rng.uniform() < observer(x) ? 1 : 0);
+    }
+    const auto &threshold = weibull.get_parameters()[0];
+    // same number of points, tighter spacing, still covering the truth
+    CORRADE_COMPARE(threshold.size(), p.threshold.size());
+    CORRADE_VERIFY(threshold.back() - threshold.front() < 40);
+    CORRADE_VERIFY(threshold.front() <= true_threshold);
+    CORRADE_VERIFY(threshold.back() >= true_threshold);
+    // single-valued axes are left alone
+    CORRADE_COMPARE(weibull.get_parameters()[2].size(), std::size_t{1});
+}
+
+// scoring a fraction of the grid per trial should barely change the estimate quality
+void TestQPWeibull::subsample()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+
+    const double true_threshold = -17.3;
+    const auto observer = simulation::weibull_observer(true_threshold, 3.5, 0.5, 0.02, Scale::dB);
+    simulation::Settings settings;
+    settings.n_sessions = 200;
+    settings.n_trials = 40;
+    settings.target = true_threshold;
+
+    // the default estimate is the posterior mean of the threshold (measured: rmse 1.26 dB scoring everything,
+    // 1.18-1.24 dB subsampled)
+    const auto full = simulation::simulate(questplus::Weibull{p}, observer, settings);
+    for (const double fraction : {0.5, 0.25, 0.1})
+    {
+        for (const bool low_discrepancy : {false, true})
+        {
+            p.subsample_params.fraction = fraction;
+            p.subsample_params.low_discrepancy = low_discrepancy;
+            const auto sub = simulation::simulate(questplus::Weibull{p}, observer, settings);
+            CORRADE_VERIFY(sub.rmse < full.rmse + 0.1);
+        }
+    }
+}
+
+// pruned and exhaustive searches must pick identical stimuli
+void TestQPWeibull::pruning()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3, 3.5, 4, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+
+    p.pruning_params.enabled = true;
+    questplus::Weibull pruned{p};
+    p.pruning_params.enabled = false;
+    questplus::Weibull exhaustive{p};
+    const auto observer = simulation::weibull_observer(-17.3, 3.5, 0.5, 0.02, Scale::dB);
+    simulation::CounterRng rng{3, 0};
+    for (std::size_t i = 0; i < 80; i++)
+    {
+        const double x = pruned.next();
+        CORRADE_COMPARE(x, exhaustive.next());
+        const int resp = rng.uniform() < observer(x) ? 1 : 0;
+        pruned.update(resp);
+        exhaustive.update(resp);
+    }
+    // pruning is opt-in: by default every candidate's expected entropy is reported
+    p.pruning_params = questplus::PruningParams{};
+    questplus::Weibull plain{p};
+    plain.next();
+    const auto &eh = plain.get_expected_entropy();
+    CORRADE_VERIFY(std::all_of(eh.begin(), eh.end(), [](double v)
+                               { return std::isfinite(v); }));
+}
+
+// the expected-entropy surface from next() against the textbook computation (see TestQPCSF::entropySurface)
+void TestQPWeibull::entropySurface()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0, 0.02};
+    p.stim_scale = Scale::dB;
+    questplus::Weibull weibull{p};
+    for (std::size_t t = 0; t < 8; t++)
+    {
+        const double x = weibull.next();
+        weibull.update(x > -17 || t % 3 == 0);
+    }
+    weibull.next();
+    const auto &post = weibull.get_posterior();
+    const auto &eh = weibull.get_expected_entropy();
+    CORRADE_COMPARE(eh.size(), p.intensity.size());
+    std::vector<double> q(post.size());
+    double err = 0;
+    for (std::size_t s = 0; s < p.intensity.size(); s++)
+    {
+        double expected = 0;
+        for (int r = 0; r < 2; r++)
+        {
+            double pk = 0;
+            for (std::size_t i = 0; i < post.size(); i++)
+            {
+                const double pc = questplus::Weibull::psychometric(p, {p.intensity[s]}, weibull.parameter_cell(i));
+                q[i] = (r ? pc : 1 - pc) * post.data()[i];
+                pk += q[i];
+            }
+            double h = 0;
+            for (const double v : q)
+            {
+                h -= v > 0 ? v / pk * std::log(v / pk) : 0;
+            }
+            expected += pk * h;
+        }
+        err = std::max(err, std::abs(eh.data()[s] - expected) / expected);
+    }
+    CORRADE_VERIFY(err < 1e-10);
+}
+
+// filtering out whole slices must behave exactly like never having them
+void TestQPWeibull::parameterFilter()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+    questplus::Weibull dense{p};
+
+    p.lapse_rate = {0.02, 0.6};
+    p.parameter_filter = [](const std::array<double, 4> &theta)
+    { return theta[2] + theta[3] < 1; };
+    questplus::Weibull filtered{p};
+
+    for (std::size_t i = 0; i < 30; i++)
+    {
+        CORRADE_COMPARE(dense.next(), filtered.next());
+        dense.update((i / 3) % 2);
+        filtered.update((i / 3) % 2);
+    }
+    for (std::size_t i = 0; i < 41 * 3; i += 7)
+    {
+        CORRADE_VERIFY(dense.parameter_cell(i) == filtered.parameter_cell(i));
+    }
+}
+
+void TestQPWeibull::stopping()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+    const auto observer = simulation::weibull_observer(-17.3, 3.5, 0.5, 0.02, Scale::dB);
+
+    const auto run = [&observer](const questplus::Weibull::Params &params)
+    {
+        questplus::Weibull weibull{params};
+        simulation::CounterRng rng{5, 0};
+        std::size_t n = 0;
+        bool cont = true;
+        while (cont && n < 500)
+        {
+            const double x = weibull.next();
+            cont = weibull.update(rng.uniform() < observer(x) ? 1 : 0);
+            n++;
+        }
+        return n;
+    };
+
+    auto limited = p;
+    limited.stopping_params.max_trials = 25;
+    CORRADE_COMPARE(run(limited), std::size_t{25});
+
+    auto entropy = p;
+    entropy.stopping_params.entropy = 2.0;
+    const auto n_entropy = run(entropy);
+    CORRADE_VERIFY(n_entropy > 1 && n_entropy < 500);
+    // same session, so a lower target can only be reached later
+    entropy.stopping_params.entropy = 1.5;
+    CORRADE_VERIFY(run(entropy) >= n_entropy);
+
+    auto interval = p;
+    interval.stopping_params.credible_intervals.push_back({0, 6, 0.9});
+    interval.stopping_params.min_trials = 10;
+    const auto n_interval = run(interval);
+    CORRADE_VERIFY(n_interval >= 10 && n_interval < 500);
+}
+
+// suspending between trials must not change anything
+void TestQPWeibull::suspendResume()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3, 3.5, 4, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0, 0.02, 0.04};
+    p.stim_scale = Scale::dB;
+
+    questplus::Weibull plain{p};
+    questplus::Weibull idle{p};
+    const auto observer = simulation::weibull_observer(-17.3, 3.5, 0.5, 0.02, Scale::dB);
+    simulation::CounterRng rng{7, 0};
+    for (std::size_t i = 0; i < 40; i++)
+    {
+        const double x = plain.next();
+        CORRADE_COMPARE(x, idle.next());
+        const int resp = rng.uniform() < observer(x) ? 1 : 0;
+        plain.update(resp);
+        if (i % 3 == 0)
+        {
+            idle.suspend();
+            CORRADE_VERIFY(idle.suspended());
+            CORRADE_COMPARE(idle.get_posterior().size(), std::size_t{0});
+        }
+        idle.update(resp);
+        CORRADE_VERIFY(!idle.suspended());
+        CORRADE_VERIFY(std::equal(plain.get_posterior().begin(), plain.get_posterior().end(),
+                                  idle.get_posterior().begin()));
+    }
+    // lossy: negligible cells are dropped, the rest still sums to one
+    idle.suspend(1e-9);
+    idle.resume();
+    const auto &post = idle.get_posterior();
+    CORRADE_VERIFY(std::count(post.begin(), post.end(), 0.0) > 0);
+    CORRADE_VERIFY(std::abs(std::accumulate(post.begin(), post.end(), 0.0) - 1) < 1e-12);
+}
+
+// a fork continues exactly like the original, and neither sees the other's trials
+void TestQPWeibull::fork()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+
+    questplus::Weibull original{p};
+    for (std::size_t i = 0; i < 10; i++)
+    {
+        original.next();
+        original.update(i % 3 != 0);
+    }
+    const std::vector<double> before(original.get_posterior().begin(), original.get_posterior().end());
+    auto ahead = original.fork();
+    CORRADE_COMPARE(ahead.history_size(), original.history_size());
+    for (std::size_t i = 0; i < 5; i++)
+    {
+        ahead.next();
+        ahead.update(0);
+    }
+    CORRADE_COMPARE(original.history_size(), std::size_t{10});
+    CORRADE_VERIFY(std::equal(before.begin(), before.end(), original.get_posterior().begin()));
+
+    auto twin = original.fork();
+    for (std::size_t i = 0; i < 10; i++)
+    {
+        CORRADE_COMPARE(twin.next(), original.next());
+        twin.update(i % 2);
+        original.update(i % 2);
+    }
+}
+
+// undoing mis-keyed responses (by division, or by replay with undo_depth = 0) leaves the clean session
+void TestQPWeibull::undo()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0, 0.02}; // zero lapse makes some likelihoods exactly zero
+    p.stim_scale = Scale::dB;
+
+    for (const std::size_t depth : {std::size_t{16}, std::size_t{0}})
+    {
+        p.history_params.undo_depth = depth;
+        questplus::Weibull clean{p};
+        questplus::Weibull corrected{p};
+        for (std::size_t i = 0; i < 30; i++)
+        {
+            const double x = clean.next();
+            CORRADE_COMPARE(corrected.next(), x);
+            const int resp = (i / 3) % 2;
+            clean.update(resp);
+            if (i % 4 == 1)
+            {
+                corrected.update(1 - resp);
+                corrected.next();
+                corrected.undo();
+            }
+            corrected.update(resp);
+            CORRADE_COMPARE(corrected.history_size(), clean.history_size());
+        }
+        const auto &a = clean.get_posterior();
+        const auto &b = corrected.get_posterior();
+        for (std::size_t i = 0; i < a.size(); i++)
+        {
+            CORRADE_VERIFY(std::abs(a.data()[i] - b.data()[i]) <= 1e-12 * a.data()[i]);
+        }
+    }
+}
+
+// a batch of archived trials gives (up to rounding) the posterior of updating one at a time
+void TestQPWeibull::updateMany()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0, 0.02};
+    p.stim_scale = Scale::dB;
+
+    questplus::Weibull live{p};
+    const auto observer = simulation::weibull_observer(-17.3, 3.5, 0.5, 0.02, Scale::dB);
+    simulation::CounterRng rng{11, 0};
+    std::vector<int> responses;
+    std::vector<double> stimuli;
+    for (std::size_t i = 0; i < 60; i++)
+    {
+        stimuli.push_back(live.next());
+        responses.push_back(rng.uniform() < observer(stimuli.back()) ? 1 : 0);
+        live.update(responses.back());
+    }
+    questplus::Weibull batch{p};
+    batch.update_many(responses, stimuli);
+    CORRADE_COMPARE(batch.history_size(), live.history_size());
+    const auto &a = live.get_posterior();
+    const auto &b = batch.get_posterior();
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        CORRADE_VERIFY(std::abs(a.data()[i] - b.data()[i]) <= 1e-9 * a.data()[i] + 1e-300);
+    }
+    CORRADE_COMPARE(batch.next(), live.next());
+
+    // stops where update() would
+    p.stopping_params.max_trials = 25;
+    questplus::Weibull capped{p};
+    CORRADE_VERIFY(!capped.update_many(responses, stimuli));
+    CORRADE_COMPARE(capped.history_size(), std::size_t{25});
+
+    // trials that rule out every parameter value, even after a refinement, change nothing
+    questplus::Weibull::Params q;
+    for (int i = -40; i <= -20; i += 2)
+    {
+        q.threshold.push_back(i);
+    }
+    q.intensity = p.intensity;
+    q.slope = {5};
+    q.lower_asymptote = {0.5};
+    q.lapse_rate = {0};
+    q.stim_scale = Scale::dB;
+    q.refinement_params.every = 10;
+    questplus::Weibull strict{q};
+    strict.update(1, -30);
+    const std::vector<double> before(strict.get_posterior().begin(), strict.get_posterior().end());
+    const double *strict_post = strict.get_posterior().data();
+    std::vector<int> rs(15, 1);
+    std::vector<double> xs(15, -30);
+    // a miss at 0 dB is impossible for every threshold on the grid
+    rs.back() = 0;
+    xs.back() = 0;
+    bool threw = false;
+    try
+    {
+        strict.update_many(rs, xs);
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    CORRADE_VERIFY(threw);
+    CORRADE_COMPARE(strict.history_size(), std::size_t{1});
+    CORRADE_VERIFY(strict.get_posterior().data() == strict_post);
+    CORRADE_COMPARE_AS(strict.get_parameters()[0], q.threshold, TestSuite::Compare::Container);
+    CORRADE_COMPARE_AS(std::vector<double>(strict.get_posterior().begin(), strict.get_posterior().end()), before,
+                       TestSuite::Compare::Container);
+}
+
+void TestQPWeibull::estimateCost()
+{
+    using namespace psydapt::questplus;
+    Weibull::Params p;
+    p.intensity.resize(30);
+    std::iota(p.intensity.begin(), p.intensity.end(), -40);
+    p.threshold.resize(20);
+    std::iota(p.threshold.begin(), p.threshold.end(), -35);
+    p.slope = {2, 3.5, 5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.01, 0.02};
+    p.stim_scale = psydapt::Scale::dB;
+    p.pruning_params.enabled = false;
+
+    const Cost cost = Weibull::estimate_cost(p);
+    CORRADE_COMPARE(cost.posterior_bytes, 120 * sizeof(double));
+#if !defined(PSYDAPT_USE_BLAS)
+    CORRADE_COMPARE(cost.likelihood_bytes, 2 * 30 * 120 * sizeof(double));
+    CORRADE_COMPARE(cost.scratch_bytes, 5 * 30 * sizeof(double));
+#endif
+    CORRADE_COMPARE(cost.total_bytes(), cost.likelihood_bytes + cost.posterior_bytes + cost.scratch_bytes);
+    CORRADE_VERIFY(cost.next_flops > 2 * 30 * 120);
+    CORRADE_VERIFY(cost.update_flops > 120);
+
+    // sizes match what the procedure actually allocates
+    p.construction_params.max_bytes = cost.total_bytes();
+    Weibull weibull{p};
+    weibull.next();
+    CORRADE_COMPARE(weibull.get_posterior().size() * sizeof(double), cost.posterior_bytes);
+#if !defined(PSYDAPT_USE_BLAS)
+    CORRADE_COMPARE((weibull.get_response_probability().size() + weibull.get_response_entropy().size() +
+                     weibull.get_expected_entropy().size()) *
+                        sizeof(double),
+                    cost.scratch_bytes);
+#endif
+
+    // pruning bounds and subsampling buffers only add memory; subsampling cuts next()
+    p.pruning_params.enabled = true;
+    p.subsample_params.fraction = 0.25;
+    const Cost pruned = Weibull::estimate_cost(p);
+    CORRADE_VERIFY(pruned.likelihood_bytes > cost.likelihood_bytes);
+    CORRADE_VERIFY(pruned.scratch_bytes > cost.scratch_bytes);
+    CORRADE_COMPARE(pruned.next_flops, 0.25 * cost.next_flops);
+
+    // each thread scoring the second step gets its own row and posterior
+    p.pruning_params.enabled = false;
+    p.subsample_params.fraction = 1;
+    p.stim_selection_method = StimSelectionMethod::TwoStepEntropy;
+    const Cost lookahead = Weibull::estimate_cost(p);
+    p.lookahead_params.n_threads = 3;
+    CORRADE_COMPARE(Weibull::estimate_cost(p).scratch_bytes, lookahead.scratch_bytes + 2 * 2 * 120 * sizeof(double));
+
+    // absurd grids saturate rather than wrap
+    p.threshold.resize(1 << 20);
+    p.intensity.resize(1 << 20);
+    p.slope.resize(1 << 20);
+    p.lapse_rate.resize(1 << 20);
+    CORRADE_COMPARE(Weibull::estimate_cost(p).total_bytes(), std::numeric_limits<std::size_t>::max());
+}
+
+void TestQPWeibull::twoStep()
+{
+    using namespace psydapt::questplus;
+    Weibull::Params p;
+    p.intensity = {-20, -18, -16, -14, -12, -10, -8, -6, -4, -2, 0};
+    p.threshold = p.intensity;
+    p.slope = {2, 4};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = psydapt::Scale::dB;
+    p.pruning_params.enabled = false;
+    p.stim_selection_method = StimSelectionMethod::TwoStepEntropy;
+    p.lookahead_params.top_k = static_cast<unsigned int>(p.intensity.size());
+
+    // against brute force: each first stimulus is worth sum_r pk * (best one-step entropy after r)
+    Weibull weibull{p};
+    for (std::size_t i = 0; i < 5; i++)
+    {
+        const double stim = weibull.next();
+        weibull.update(stim > -12);
+    }
+    const double chosen = weibull.next();
+    const auto pk = weibull.get_response_probability();
+    double best_value = std::numeric_limits<double>::infinity();
+    double best_stim = 0;
+    for (std::size_t s = 0; s < p.intensity.size(); s++)
+    {
+        double value = 0;
+        for (int r = 0; r < 2; r++)
+        {
+            Weibull after = weibull;
+            after.update(r, p.intensity[s]);
+            after.next();
+            const auto &eh = after.get_expected_entropy();
+            value += pk(r, s) * *std::min_element(eh.begin(), eh.end());
+        }
+        if (value < best_value)
+        {
+            best_value = value;
+            best_stim = p.intensity[s];
+        }
+    }
+    CORRADE_COMPARE(chosen, best_stim);
+
+    // threads and second-step pruning don't change the choice; top_k = 1 is greedy
+    p.lookahead_params.top_k = 4;
+    Weibull serial{p};
+    p.lookahead_params.n_threads = 4;
+    Weibull threaded{p};
+    p.pruning_params.enabled = true;
+    Weibull pruned{p};
+    p.lookahead_params.top_k = 1;
+    Weibull one{p};
+    p.stim_selection_method = StimSelectionMethod::MinEntropy;
+    Weibull greedy{p};
+    for (std::size_t i = 0; i < 15; i++)
+    {
+        const double a = serial.next();
+        CORRADE_COMPARE(threaded.next(), a);
+        CORRADE_COMPARE(pruned.next(), a);
+        CORRADE_COMPARE(one.next(), greedy.next());
+        const int resp = a > -12 || i % 5 == 0;
+        serial.update(resp);
+        threaded.update(resp, a);
+        pruned.update(resp, a);
+        one.update(resp);
+        greedy.update(resp);
+    }
+
+    // the lookahead needs the full one-step sweep, so neither subsampling nor a deadline can cut it short
+    int threw = 0;
+    try
+    {
+        serial.next(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw++;
+    }
+    p.stim_selection_method = StimSelectionMethod::TwoStepEntropy;
+    p.subsample_params.fraction = 0.5;
+    try
+    {
+        Weibull subsampled{p};
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw++;
+    }
+    CORRADE_COMPARE(threw, 2);
+}
+
 void TestQPWeibull::nextAndUpdate()
 {
     using namespace psydapt::questplus;
@@ -0,0 +1,185 @@
+#include <Corrade/TestSuite/Tester.h>
+#include "Corrade/TestSuite/Compare/Container.h"
+#include <cmath>
+#include <vector>
+#include "psydapt/quest/quest.hpp"
+#include "psydapt/simulation/simulation.hpp"
+
+using namespace Corrade;
+
+struct TestQuest : TestSuite::Tester
+{
+    explicit TestQuest();
+
+    void bruteForce();
+    void converges();
+    void undo();
+    void nextAndUpdate();
+};
+
+TestQuest::TestQuest()
+{
+    addTests({&TestQuest::bruteForce, &TestQuest::converges, &TestQuest::undo});
+    addBenchmarks({&TestQuest::nextAndUpdate}, 100);
+}
+
+namespace
+{
+    using psydapt::quest::Quest;
+
+    Quest::Params questParams()
+    {
+        Quest::Params p;
+        p.t_guess = -1;
+        p.t_guess_sd = 0.5;
+        p.n_trials = 60;
+        p.range = 4;
+        p.grain = 0.02;
+        return p;
+    }
+} // namespace
+
+// the shifted-template posterior matches prior * product of likelihoods, computed directly
+void TestQuest::bruteForce()
+{
+    using namespace psydapt;
+    for (const bool db : {false, true})
+    {
+        auto p = questParams();
+        if (db)
+        {
+            p.stim_scale = Scale::dB;
+            p.t_guess = -20;
+            p.t_guess_sd = 6;
+            p.grain = 0.5;
+            p.range = 60;
+            p.p_threshold = 0.75;
+        }
+        Quest quest{p};
+        const auto grid = quest.threshold_grid();
+        CORRADE_COMPARE(grid.size(), static_cast<std::size_t>(std::lround(p.range / p.grain)) + 1);
+        std::vector<double> log_post(grid.size());
+        for (std::size_t k = 0; k < grid.size(); k++)
+        {
+            const double z = (grid[k] - p.t_guess) / p.t_guess_sd;
+            log_post[k] = -0.5 * z * z;
+        }
+        simulation::CounterRng rng{7, db};
+        for (int t = 0; t < 40; t++)
+        {
+            // on-lattice stimuli, some well outside the threshold grid
+            const double x = p.t_guess + std::round((rng.uniform() - 0.5) * 2 * p.range / p.grain) * p.grain;
+            const int r = rng.uniform() < 0.6;
+            quest.update(r, x);
+            for (std::size_t k = 0; k < grid.size(); k++)
+            {
+                const double pc = Quest::psychometric(p, x, grid[k]);
+                log_post[k] += std::log(r ? pc : 1 - pc);
+            }
+        }
+        double top = log_post[0], total = 0;
+        for (const double l : log_post)
+        {
+            top = std::max(top, l);
+        }
+        std::vector<double> expected(grid.size());
+        for (std::size_t k = 0; k < grid.size(); k++)
+        {
+            expected[k] = std::exp(log_post[k] - top);
+            total += expected[k];
+        }
+        const auto post = quest.posterior();
+        double err = 0;
+        for (std::size_t k = 0; k < grid.size(); k++)
+        {
+            err = std::max(err, std::abs(post[k] - expected[k] / total));
+        }
+        CORRADE_VERIFY(err < 1e-12);
+    }
+    // p_threshold moves the curve so that the threshold is where it says
+    auto p = questParams();
+    p.p_threshold = 0.82;
+    CORRADE_VERIFY(std::abs(Quest::psychometric(p, 0.3, 0.3) - 0.82) < 1e-12);
+}
+
+void TestQuest::converges()
+{
+    using namespace psydapt;
+    using psydapt::quest::Estimator;
+    const double true_threshold = -1.37;
+    for (const auto est : {Estimator::Mean, Estimator::Mode, Estimator::Quantile})
+    {
+        auto p = questParams();
+        p.estimator = est;
+        p.n_trials = 200;
+        p.stop_sd = 0.05;
+        Quest quest{p};
+        const auto observer = simulation::weibull_observer(true_threshold, p.slope, p.lower_asymptote, p.lapse_rate);
+        simulation::CounterRng rng{11, static_cast<std::uint64_t>(est)};
+        bool cont = true;
+        while (cont)
+        {
+            const double x = quest.next();
+            cont = quest.update(rng.uniform() < observer(x) ? 1 : 0);
+        }
+        CORRADE_VERIFY(quest.sd() < 0.05);
+        CORRADE_VERIFY(quest.get_stimulus_history().size() < 200);
+        CORRADE_VERIFY(std::abs(quest.mean() - true_threshold) < 0.2);
+    }
+}
+
+// mis-keyed responses that are undone leave the clean session's posterior and stimuli
+void TestQuest::undo()
+{
+    auto p = questParams();
+    Quest clean{p}, corrected{p};
+    psydapt::simulation::CounterRng rng{5, 0};
+    for (int t = 0; t < 30; t++)
+    {
+        const int r = rng.uniform() < 0.7;
+        const double x = clean.next();
+        CORRADE_COMPARE(corrected.next(), x);
+        clean.update(r);
+        if (t % 7 == 3)
+        {
+            corrected.update(1 - r);
+            corrected.next();
+            corrected.update(r, x + 0.4);
+            corrected.undo();
+            corrected.undo();
+        }
+        corrected.update(r);
+    }
+    const auto a = clean.posterior(), b = corrected.posterior();
+    double err = 0;
+    for (std::size_t k = 0; k < a.size(); k++)
+    {
+        err = std::max(err, std::abs(a[k] - b[k]));
+    }
+    CORRADE_VERIFY(err < 1e-12);
+    CORRADE_COMPARE(corrected.next(), clean.next());
+    CORRADE_COMPARE_AS(corrected.get_stimulus_history(), clean.get_stimulus_history(), TestSuite::Compare::Container);
+
+    // a batch stops where the procedure does
+    p.n_trials = 5;
+    Quest batch{p};
+    CORRADE_VERIFY(!batch.update_many({1, 0, 1, 1, 0, 1, 1, 1}, {-1, -1.2, -0.8, -1, -1.4, -1, -0.6, -1}));
+    CORRADE_COMPARE(batch.get_stimulus_history().size(), 5u);
+}
+
+void TestQuest::nextAndUpdate()
+{
+    auto p = questParams();
+    p.grain = 0.002; // 2001 grid points
+    CORRADE_BENCHMARK(1)
+    {
+        Quest quest{p};
+        for (int t = 0; t < 60; t++)
+        {
+            quest.next();
+            quest.update(t % 4 != 0);
+        }
+    }
+}
+
+CORRADE_TEST_MAIN(TestQuest)
@@ -0,0 +1,334 @@
+#include <Corrade/TestSuite/Tester.h>
+#include "Corrade/TestSuite/Compare/Container.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "psydapt/parallel/work_stealing_pool.hpp"
+#include "psydapt/server/protocol.hpp"
+#include "psydapt/server/session_registry.hpp"
+#include "psydapt/server/unix_server.hpp"
+#include "psydapt/staircase/staircase.hpp"
+
+using namespace Corrade;
+
+struct TestServer : TestSuite::Tester
+{
+    explicit TestServer();
+
+    void workStealing();
+    void protocolRoundTrip();
+    void strandOrder();
+    void strandFairness();
+    void endToEnd();
+};
+
+TestServer::TestServer()
+{
+    addTests({&TestServer::workStealing, &TestServer::protocolRoundTrip, &TestServer::strandOrder,
+              &TestServer::strandFairness, &TestServer::endToEnd});
+}
+
+namespace
+{
+    using psydapt::staircase::Staircase;
+    namespace protocol = psydapt::server::protocol;
+
+    Staircase::Params staircaseParams()
+    {
+        Staircase::Params params;
+        params.n_trials = 20;
+        params.start_val = 0.8;
+        params.min_val = 0;
+        params.max_val = 1;
+        params.step_sizes = {0.1, 0.01};
+        params.n_up = 1;
+        params.n_down = 3;
+        params.apply_initial_rule = true;
+        return params;
+    }
+
+    // blocking request/reply over a fresh connection
+    class Client
+    {
+    public:
+        explicit Client(const std::string &path)
+        {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            ok = fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        }
+        ~Client() { ::close(fd); }
+        bool ok;
+
+        void send(const protocol::Request &req)
+        {
+            std::vector<unsigned char> out;
+            protocol::encode(req, out);
+            ::send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+        }
+        std::optional<protocol::Reply> receive()
+        {
+            for (;;)
+            {
+                const auto size = protocol::frame_size(in.data(), in.size());
+                if (size && *size)
+                {
+                    const auto rep = protocol::decode_reply(in.data(), *size);
+                    in.erase(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(*size));
+                    return rep;
+                }
+                unsigned char buf[256];
+                const ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n <= 0)
+                {
+                    return std::nullopt;
+                }
+                in.insert(in.end(), buf, buf + n);
+            }
+        }
+
+    private:
+        int fd = -1;
+        std::vector<unsigned char> in;
+    };
+} // namespace
+
+void TestServer::workStealing()
+{
+    psydapt::parallel::WorkStealingPool pool(4);
+    CORRADE_COMPARE(pool.size(), 4u);
+    // tasks that fan out more tasks from inside the pool
+    std::atomic<int> sum{0};
+    std::vector<std::future<void>> outer;
+    for (int i = 0; i < 32; i++)
+    {
+        outer.push_back(pool.submit([&pool, &sum, i]
+                                    {
+                                        for (int j = 0; j < 32; j++)
+                                        {
+                                            pool.post([&sum, i, j]
+                                                      { sum += i * 32 + j; });
+                                        }
+                                    }));
+    }
+    for (auto &f : outer)
+    {
+        f.get();
+    }
+    auto answer = pool.submit([]
+                              { return 42; });
+    CORRADE_COMPARE(answer.get(), 42);
+    // posted tasks finish before the pool is gone
+    {
+        psydapt::parallel::WorkStealingPool other(2);
+        for (int k = 0; k < 1024; k++)
+        {
+            other.post([&sum]
+                       { sum += 1; });
+        }
+    }
+    while (sum.load() != 1024 * 1023 / 2 + 1024)
+    {
+        std::this_thread::yield();
+    }
+    CORRADE_COMPARE(sum.load(), 1024 * 1023 / 2 + 1024);
+}
+
+void TestServer::protocolRoundTrip()
+{
+    protocol::Request req;
+    req.id = 7;
+    req.op = protocol::Op::Update;
+    req.session = 0x0123456789abcdefULL;
+    req.response = 1;
+    req.n_stim = 3;
+    req.stimulus = {-0.5, 1e-300, 42};
+    std::vector<unsigned char> buf;
+    protocol::encode(req, buf);
+    const auto size = protocol::frame_size(buf.data(), buf.size());
+    CORRADE_VERIFY(size && *size == buf.size());
+    // incomplete frames aren't ready yet
+    CORRADE_VERIFY(!protocol::frame_size(buf.data(), buf.size() - 1));
+    const auto back = protocol::decode_request(buf.data(), buf.size());
+    CORRADE_VERIFY(back);
+    CORRADE_COMPARE(back->id, 7u);
+    CORRADE_VERIFY(back->op == protocol::Op::Update);
+    CORRADE_COMPARE(back->session, req.session);
+    CORRADE_COMPARE(back->response, 1);
+    CORRADE_COMPARE(back->n_stim, 3);
+    CORRADE_VERIFY(back->stimulus == req.stimulus);
+
+    protocol::Reply rep;
+    rep.id = 9;
+    rep.op = protocol::Op::Error;
+    rep.error = "Unknown session.";
+    buf.clear();
+    protocol::encode(rep, buf);
+    const auto err = protocol::decode_reply(buf.data(), buf.size());
+    CORRADE_VERIFY(err && err->op == protocol::Op::Error);
+    CORRADE_COMPARE(err->error, rep.error);
+
+    // truncated bodies and unknown opcodes are rejected rather than read past
+    buf.clear();
+    protocol::encode(req, buf);
+    buf[0] -= 8;
+    CORRADE_VERIFY(!protocol::decode_request(buf.data(), buf.size() - 8));
+    buf[8] = 99;
+    CORRADE_VERIFY(!protocol::decode_request(buf.data(), buf.size() - 8));
+    const unsigned char huge[4] = {0xff, 0xff, 0xff, 0xff};
+    CORRADE_COMPARE(*protocol::frame_size(huge, 4), 0u);
+}
+
+// jobs posted for one session run one at a time, in order, while other sessions proceed
+void TestServer::strandOrder()
+{
+    psydapt::server::SessionRegistry<Staircase> registry(2);
+    const auto a = registry.add(Staircase{staircaseParams()});
+    const auto b = registry.add(Staircase{staircaseParams()});
+    CORRADE_VERIFY(a && b && a != b);
+    CORRADE_COMPARE(registry.add(Staircase{staircaseParams()}), 0u);
+    CORRADE_COMPARE(registry.size(), 2u);
+
+    std::vector<int> order_a, order_b;
+    {
+        psydapt::parallel::WorkStealingPool pool(4);
+        for (int k = 0; k < 500; k++)
+        {
+            registry.post(a, pool, [&order_a, k](auto &)
+                          { order_a.push_back(k); });
+            registry.post(b, pool, [&order_b, k](auto &)
+                          { order_b.push_back(k); });
+        }
+        CORRADE_VERIFY(!registry.post(12345, pool, [](auto &) {}));
+    }
+    CORRADE_COMPARE(order_a.size(), 500u);
+    CORRADE_COMPARE(order_b.size(), 500u);
+    bool in_order = true;
+    for (int k = 0; k < 500; k++)
+    {
+        in_order = in_order && order_a[k] == k && order_b[k] == k;
+    }
+    CORRADE_VERIFY(in_order);
+    CORRADE_VERIFY(registry.remove(a));
+    CORRADE_VERIFY(!registry.remove(a));
+    CORRADE_COMPARE(registry.size(), 1u);
+}
+
+// a session with a backlog gives way to other waiting sessions after each job
+void TestServer::strandFairness()
+{
+    psydapt::server::SessionRegistry<Staircase> registry;
+    const auto a = registry.add(Staircase{staircaseParams()});
+    const auto b = registry.add(Staircase{staircaseParams()});
+    std::vector<std::string> order;
+    {
+        psydapt::parallel::WorkStealingPool pool(1);
+        // hold the only worker until both sessions have queued work
+        std::promise<void> started, go;
+        auto held = pool.submit([&started, f = go.get_future()]() mutable
+                                {
+                                    started.set_value();
+                                    f.wait();
+                                });
+        started.get_future().wait();
+        registry.post(b, pool, [&order](auto &)
+                      { order.push_back("b0"); });
+        for (int k = 0; k < 3; k++)
+        {
+            registry.post(a, pool, [&order, k](auto &)
+                          { order.push_back("a" + std::to_string(k)); });
+        }
+        go.set_value();
+        held.get();
+    }
+    CORRADE_COMPARE_AS(order, (std::vector<std::string>{"a0", "b0", "a1", "a2"}), TestSuite::Compare::Container);
+}
+
+// a remote session gives exactly the stimuli a local staircase does
+void TestServer::endToEnd()
+{
+    using Server = psydapt::server::UnixServer<Staircase>;
+    const std::string path = "/tmp/psydapt_test_server_" + std::to_string(::getpid()) + ".sock";
+    psydapt::server::ServerParams params;
+    params.n_threads = 2;
+    Server server{path, [](std::uint32_t config) -> std::optional<Server::procedure_type>
+                  {
+                      if (config != 0)
+                      {
+                          return std::nullopt;
+                      }
+                      return Server::procedure_type{Staircase{staircaseParams()}};
+                  },
+                  params};
+    // only the owner may connect
+    struct stat st;
+    CORRADE_VERIFY(::stat(path.c_str(), &st) == 0);
+    CORRADE_COMPARE(st.st_mode & 0777, 0600u);
+    Client client(path);
+    CORRADE_VERIFY(client.ok);
+
+    protocol::Request req;
+    req.id = 1;
+    req.op = protocol::Op::Create;
+    req.config = 3;
+    client.send(req);
+    auto rep = client.receive();
+    CORRADE_VERIFY(rep && rep->op == protocol::Op::Error);
+
+    req.config = 0;
+    client.send(req);
+    rep = client.receive();
+    CORRADE_VERIFY(rep && rep->op == protocol::Op::Create);
+    const std::uint64_t session = rep->session;
+    CORRADE_COMPARE(server.sessions().size(), 1u);
+
+    Staircase local{staircaseParams()};
+    const std::vector<int> responses{1, 1, 1, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1};
+    bool same = true;
+    for (std::size_t i = 0; i < responses.size(); i++)
+    {
+        req.id = static_cast<std::uint32_t>(10 + i);
+        req.op = protocol::Op::Next;
+        req.session = session;
+        client.send(req);
+        // pipelined: the update is queued behind the next() on the session's strand
+        req.op = protocol::Op::Update;
+        req.response = responses[i];
+        client.send(req);
+        const auto stim = client.receive();
+        const auto upd = client.receive();
+        const double expected = local.next();
+        const bool cont = local.update(responses[i]);
+        same = same && stim && stim->op == protocol::Op::Next && stim->n_stim == 1 &&
+               stim->stimulus[0] == expected && upd && upd->op == protocol::Op::Update &&
+               upd->should_continue == cont;
+    }
+    CORRADE_VERIFY(same);
+
+    // a stimulus with the wrong dimension is an error, not a crash
+    req.n_stim = 2;
+    client.send(req);
+    rep = client.receive();
+    CORRADE_VERIFY(rep && rep->op == protocol::Op::Error);
+
+    req.op = protocol::Op::Close;
+    client.send(req);
+    rep = client.receive();
+    CORRADE_VERIFY(rep && rep->op == protocol::Op::Close);
+    CORRADE_COMPARE(server.sessions().size(), 0u);
+    req.op = protocol::Op::Next;
+    client.send(req);
+    rep = client.receive();
+    CORRADE_VERIFY(rep && rep->op == protocol::Op::Error);
+}
+
+CORRADE_TEST_MAIN(TestServer)
@@ -0,0 +1,151 @@
+#include <Corrade/TestSuite/Tester.h>
+#include "Corrade/TestSuite/Compare/Container.h"
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "psydapt/staircase/staircase.hpp"
+#include "psydapt/questplus/weibull.hpp"
+#include "psydapt/simulation/simulation.hpp"
+
+using namespace Corrade;
+
+struct TestSimulation : TestSuite::Tester
+{
+    explicit TestSimulation();
+
+    void reproducible();
+    void weibullBias();
+    void staircaseSessions();
+};
+
+TestSimulation::TestSimulation()
+{
+    addTests({&TestSimulation::reproducible, &TestSimulation::weibullBias});
+    addBenchmarks({&TestSimulation::staircaseSessions}, 10);
+}
+
+namespace
+{
+    // a staircase has no posterior; its running estimate is where it's currently testing
+    double lastStimulus(psydapt::staircase::Staircase &, const double &x)
+    {
+        return x;
+    }
+
+    psydapt::staircase::Staircase::Params staircaseParams()
+    {
+        psydapt::staircase::Staircase::Params params;
+        params.start_val = 0;
+        params.step_sizes = {0.1, 0.05};
+        params.n_trials = 60;
+        params.n_up = 1;
+        params.n_down = 3;
+        params.apply_initial_rule = true;
+        params.stim_scale = psydapt::Scale::Linear;
+        return params;
+    }
+
+    struct CountingSink : psydapt::logging::TrialSink<1>
+    {
+        std::atomic<int> n{0};
+        void record(const psydapt::logging::TrialRecord<1> &) noexcept override { n++; }
+    };
+} // namespace
+
+// results must not depend on how sessions were spread over threads
+void TestSimulation::reproducible()
+{
+    using namespace psydapt;
+    staircase::Staircase stair{staircaseParams()};
+    // sessions are copies, but mustn't all write to the prototype's sink
+    const auto sink = std::make_shared<CountingSink>();
+    stair.set_sink(sink);
+    const auto observer = simulation::weibull_observer(-0.5, 3.5, 0.5, 0.01);
+    simulation::Settings settings;
+    settings.n_sessions = 200;
+    settings.n_trials = 60;
+    settings.target = -0.5;
+    settings.tolerance = 0.15;
+
+    settings.n_threads = 1;
+    const auto serial = simulation::simulate(stair, observer, settings, lastStimulus);
+    settings.n_threads = 4;
+    const auto parallel = simulation::simulate(stair, observer, settings, lastStimulus);
+
+    std::vector<double> serial_est, parallel_est;
+    for (std::size_t i = 0; i < settings.n_sessions; i++)
+    {
+        serial_est.push_back(serial.sessions[i].estimate);
+        parallel_est.push_back(parallel.sessions[i].estimate);
+    }
+    CORRADE_COMPARE_AS(parallel_est, serial_est, TestSuite::Compare::Container);
+    CORRADE_COMPARE(parallel.n_converged, serial.n_converged);
+    CORRADE_COMPARE(sink->n.load(), 0);
+
+    // without a posterior there's nothing to default the estimate to, and no sessions means no summary
+    int threw = 0;
+    try
+    {
+        simulation::simulate(stair, observer, settings);
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw++;
+    }
+    settings.n_sessions = 0;
+    try
+    {
+        simulation::simulate(stair, observer, settings, lastStimulus);
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw++;
+    }
+    CORRADE_COMPARE(threw, 2);
+}
+
+void TestSimulation::weibullBias()
+{
+    using namespace psydapt;
+    questplus::Weibull::Params p;
+    for (int i = -40; i <= 0; i++)
+    {
+        p.threshold.push_back(i);
+    }
+    p.intensity = p.threshold;
+    p.slope = {3.5};
+    p.lower_asymptote = {0.5};
+    p.lapse_rate = {0.02};
+    p.stim_scale = Scale::dB;
+    questplus::Weibull weibull{p};
+
+    simulation::Settings settings;
+    settings.n_sessions = 100;
+    settings.n_trials = 40;
+    settings.target = -20;
+    settings.tolerance = 3;
+    const auto summary = simulation::simulate(weibull, simulation::weibull_observer(-20, 3.5, 0.5, 0.02, Scale::dB), settings);
+    // the default estimate is the posterior mean of the threshold (measured: bias -0.09 dB, 97 of 100 converged)
+    CORRADE_VERIFY(std::abs(summary.bias) < 0.5);
+    CORRADE_VERIFY(summary.n_converged > settings.n_sessions * 9 / 10);
+}
+
+void TestSimulation::staircaseSessions()
+{
+    using namespace psydapt;
+    staircase::Staircase stair{staircaseParams()};
+    const auto observer = simulation::weibull_observer(-0.5, 3.5, 0.5, 0.01);
+    simulation::Settings settings;
+    settings.n_sessions = 10000;
+    settings.target = -0.5;
+
+    double a{};
+    CORRADE_BENCHMARK(10)
+    {
+        a += simulation::simulate(stair, observer, settings, lastStimulus).mean;
+    }
+    CORRADE_VERIFY(a);
+}
+
+CORRADE_TEST_MAIN(TestSimulation)
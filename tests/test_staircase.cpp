@@ -1,6 +1,7 @@
 #include <Corrade/TestSuite/Tester.h>
 #include "Corrade/TestSuite/Compare/Container.h"
 #include <vector>
+#include <memory>
 #include "psydapt/staircase/staircase.hpp"
 #include "common.hpp"
 
@@ -12,12 +13,16 @@ struct TestStaircase : TestSuite::Tester
 
     void linear();
     void log();
+    void sink();
+    void undo();
+    void updateMany();
     void nextAndUpdate();
 };
 
 TestStaircase::TestStaircase()
 {
-    addTests({&TestStaircase::linear, &TestStaircase::log});
+    addTests({&TestStaircase::linear, &TestStaircase::log, &TestStaircase::sink, &TestStaircase::undo,
+              &TestStaircase::updateMany});
     addBenchmarks({&TestStaircase::nextAndUpdate}, 100);
 }
 
@@ -97,6 +102,149 @@ void TestStaircase::log()
     CORRADE_COMPARE_AS(pred_vals, true_vals, TestSuite::Compare::Container);
 }
 
+namespace
+{
+    struct VectorSink : psydapt::logging::TrialSink<1>
+    {
+        std::vector<psydapt::logging::TrialRecord<1>> records;
+        void record(const psydapt::logging::TrialRecord<1> &rec) noexcept override
+        {
+            records.push_back(rec);
+        }
+    };
+} // namespace
+
+void TestStaircase::sink()
+{
+    using namespace psydapt::staircase;
+    Staircase::Params params;
+    params.n_trials = 20;
+    params.start_val = 0.8;
+    params.min_val = 0;
+    params.max_val = 1;
+    params.step_sizes = {0.1, 0.01, 0.001};
+    params.n_up = 1;
+    params.n_down = 3;
+    params.n_reversals = 4;
+    params.apply_initial_rule = true;
+
+    Staircase stare{params};
+    auto sink = std::make_shared<VectorSink>();
+    stare.set_sink(sink);
+
+    std::vector<int> sim_resp = makeBasicResponseCycles(3, 4, 4, 20);
+    std::vector<double> pred_vals;
+    bool cont = true;
+    for (std::size_t i = 0; cont; i++)
+    {
+        pred_vals.push_back(stare.next());
+        cont = stare.update(sim_resp[i]);
+    }
+
+    std::vector<double> logged_vals;
+    std::vector<int> logged_resp;
+    for (std::size_t i = 0; i < sink->records.size(); i++)
+    {
+        CORRADE_COMPARE(sink->records[i].trial, static_cast<std::uint64_t>(i));
+        CORRADE_VERIFY(!sink->records[i].posterior_entropy);
+        logged_vals.push_back(sink->records[i].stimulus[0]);
+        logged_resp.push_back(sink->records[i].response);
+    }
+    CORRADE_COMPARE_AS(logged_vals, pred_vals, TestSuite::Compare::Container);
+    CORRADE_COMPARE_AS(logged_resp, sim_resp, TestSuite::Compare::Container);
+}
+
+// mis-keyed responses that are undone must leave the same trajectory as in linear()
+void TestStaircase::undo()
+{
+    using namespace psydapt::staircase;
+    Staircase::Params params;
+    params.n_trials = 20;
+    params.start_val = 0.8;
+    params.min_val = 0;
+    params.max_val = 1;
+    params.step_sizes = {0.1, 0.01, 0.001};
+    params.n_up = 1;
+    params.n_down = 3;
+    params.n_reversals = 4;
+    params.apply_initial_rule = true;
+    params.stim_scale = psydapt::Scale::Linear;
+
+    Staircase stare{params};
+    std::vector<int> sim_resp = makeBasicResponseCycles(3, 4, 4, 20);
+    std::vector<double> pred_vals;
+    std::vector<double> true_vals{0.8, 0.7, 0.6, 0.5, 0.4, 0.41, 0.42, 0.43, 0.44, 0.44, 0.44,
+                                  0.439, 0.439, 0.44, 0.441, 0.442, 0.443, 0.443, 0.443, 0.442};
+    bool cont = true;
+    for (int counter = 0; cont; counter++)
+    {
+        pred_vals.push_back(stare.next());
+        if (counter % 4 == 1)
+        {
+            // wrong key, noticed straight away
+            stare.update(1 - sim_resp[counter]);
+            stare.undo();
+        }
+        else if (counter % 4 == 2)
+        {
+            // wrong key, noticed after the next stimulus was drawn
+            stare.update(1 - sim_resp[counter]);
+            stare.next();
+            stare.undo();
+        }
+        cont = stare.update(sim_resp[counter]);
+    }
+    CORRADE_COMPARE_AS(pred_vals, true_vals, TestSuite::Compare::Container);
+    CORRADE_COMPARE(stare.get_response_history().size(), true_vals.size());
+}
+
+// replaying the first trials in one batch must continue exactly like the live staircase
+void TestStaircase::updateMany()
+{
+    using namespace psydapt::staircase;
+    Staircase::Params params;
+    params.n_trials = 20;
+    params.start_val = 0.8;
+    params.min_val = 0;
+    params.max_val = 1;
+    params.step_sizes = {0.1, 0.01, 0.001};
+    params.n_up = 1;
+    params.n_down = 3;
+    params.n_reversals = 4;
+    params.apply_initial_rule = true;
+    params.stim_scale = psydapt::Scale::Linear;
+
+    Staircase live{params};
+    std::vector<int> sim_resp = makeBasicResponseCycles(3, 4, 4, 20);
+    std::vector<double> stims;
+    for (std::size_t i = 0; i < 12; i++)
+    {
+        stims.push_back(live.next());
+        live.update(sim_resp[i]);
+    }
+    Staircase replay{params};
+    replay.next();
+    replay.update_many(std::vector<int>(sim_resp.begin(), sim_resp.begin() + 12), stims);
+    bool cont = true;
+    for (std::size_t i = 12; cont; i++)
+    {
+        CORRADE_COMPARE(replay.next(), live.next());
+        live.update(sim_resp[i]);
+        cont = replay.update(sim_resp[i]);
+    }
+    CORRADE_COMPARE_AS(replay.get_stimulus_history(), live.get_stimulus_history(), TestSuite::Compare::Container);
+
+    // trials past the end of the staircase are not applied
+    std::vector<double> all = live.get_stimulus_history();
+    std::vector<int> all_resp(sim_resp.begin(), sim_resp.begin() + static_cast<std::ptrdiff_t>(all.size()));
+    all.insert(all.end(), {0.5, 0.5});
+    all_resp.insert(all_resp.end(), {0, 0});
+    Staircase full{params};
+    full.next();
+    CORRADE_VERIFY(!full.update_many(all_resp, all));
+    CORRADE_COMPARE_AS(full.get_stimulus_history(), live.get_stimulus_history(), TestSuite::Compare::Container);
+}
+
 void TestStaircase::nextAndUpdate()
 {
     using namespace psydapt::staircase;